@@ -34,6 +34,7 @@
 #include <qlat/qcd-smear.h>
 #include <qlat/qcd-topology.h>
 #include <qlat/fermion-action.h>
+#include <qlat/qcd-dirac.h>
 
 QLAT_START_NAMESPACE
 
@@ -116,6 +117,63 @@ inline void read_floats_fp16(Vector<float> out, const Vector<uint8_t> fp_data, c
   read_floats_fp16(out.data(), (const uint8_t*)buffer.data(), out.size(), nsc);
 }
 
+inline void write_floats(Vector<uint8_t> fp_data, const Vector<float> in)
+  // inverse of read_floats
+{
+  qassert(in.data_size() == fp_data.size());
+  memcpy(fp_data.data(), in.data(), fp_data.size());
+  to_from_little_endian_32(fp_data);
+}
+
+inline unsigned short map_fp16_exp(const float max)
+  // the smallest e with unmap_fp16_exp(e) >= max
+{
+  if (not (max > 0.0)) {
+    return 0;
+  }
+  const double base = 1.4142135623730950488;
+  int e = (int)std::ceil(std::log(max) / std::log(base)) + USHRT_MAX / 2;
+  e = std::max(0, std::min((int)USHRT_MAX, e));
+  while (e < USHRT_MAX and unmap_fp16_exp(e) < max) {
+    e += 1;
+  }
+  return e;
+}
+
+inline void write_floats_fp16(uint8_t* ptr, const float* in, const int64_t n, const int nsc)
+  // inverse of read_floats_fp16 up to the 16 bits rounding
+  // each group of nsc floats shares the exponent of its largest absolute value
+{
+  const int64_t nsites = n / nsc;
+  qassert(n % nsc == 0);
+  unsigned short* out = (unsigned short*)ptr;
+  for (int64_t site = 0;site<nsites;site++) {
+    const float* ev = &in[site*nsc];
+    unsigned short* bptr = &out[site*(nsc + 1)];
+    float max = 0.0;
+    for (int i=0;i<nsc;i++) {
+      max = std::max(max, std::abs(ev[i]));
+    }
+    const unsigned short exp = map_fp16_exp(max);
+    bptr[0] = exp;
+    max = unmap_fp16_exp(exp);
+    const float min = -max;
+    for (int i=0;i<nsc;i++) {
+      bptr[1+i] = max > 0.0 ? fp_map(ev[i], min, max, USHRT_MAX) : USHRT_MAX / 2;
+    }
+  }
+}
+
+inline void write_floats_fp16(Vector<uint8_t> fp_data, const Vector<float> in, const int nsc)
+{
+  const long size = fp_16_size(in.size(), nsc);
+  qassert(fp_data.size() == size);
+  std::vector<uint16_t> buffer(size / sizeof(uint16_t));
+  write_floats_fp16((uint8_t*)buffer.data(), in.data(), in.size(), nsc);
+  to_from_little_endian_16(get_data(buffer));
+  memcpy(fp_data.data(), buffer.data(), fp_data.size());
+}
+
 struct CompressedEigenSystemInfo
 {
   bool initialized;
@@ -359,6 +417,7 @@ inline Geometry get_geo_from_cesi(const CompressedEigenSystemInfo& cesi, const i
     const Coordinate& new_size_node = Coordinate())
 {
   GeometryNode geon;
+  geon.initialized = true;
   Coordinate node_site;
   if (new_size_node == Coordinate()) {
     geon.size_node = cesi.total_site / cesi.node_site;
@@ -370,6 +429,7 @@ inline Geometry get_geo_from_cesi(const CompressedEigenSystemInfo& cesi, const i
   geon.id_node = id_node;
   geon.num_node = product(geon.size_node);
   geon.coor_node = coordinate_from_index(geon.id_node, geon.size_node);
+  geon.comm = get_comm();
   Geometry geo_full;
   geo_full.init(geon, 1, node_site);
   return geo_full;
@@ -677,7 +737,7 @@ inline void save_block_data(
     const CompressedEigenSystemInfo& cesi,
     VFile& fp)
 {
-  TIMER("load_block_data");
+  TIMER("save_block_data");
   const Vector<uint8_t> data = cesd.get_elems_const(xl);
   const int block_idx = index_from_coordinate(xl, cesi.node_block);
   const int block_size = product(cesi.node_block);
@@ -798,7 +858,7 @@ inline crc32_t save_node_data(
 {
   TIMER_VERBOSE_FLOPS("save_node_data");
   const Geometry& geo = cesd.geo;
-  crc32_t crc_node;
+  crc32_t crc_node = 0;
   const int idx_size = product(geo.geon.size_node);
   const int idx = geo.geon.id_node;
   const int dir_idx = compute_dist_file_dir_id(idx, idx_size);
@@ -874,6 +934,57 @@ inline void load_block(
   }
 }
 
+inline void save_block(
+    CompressedEigenSystemData& cesd, const Coordinate& xl,
+    const CompressedEigenSystemBases& cesb, const CompressedEigenSystemCoefs& cesc,
+    const CompressedEigenSystemInfo& cesi)
+  // inverse of load_block up to the rounding of the fp16 parts
+{
+  TIMER("save_block");
+  const Vector<ComplexF> bases = cesb.get_elems_const(xl);
+  const Vector<ComplexF> coefs = cesc.get_elems_const(xl);
+  Vector<uint8_t> data = cesd.get_elems(xl);
+  qassert(cesb.c_size_vec == cesb.ls * cesb.block_vol_eo * HalfVector::c_size);
+  std::vector<ComplexF> buffer(cesb.n_basis * cesb.c_size_vec);
+  for (int i = 0; i < cesb.n_basis; ++i) {
+    for (int s = 0; s < cesb.ls; ++s) {
+      for (long index = 0; index < cesb.block_vol_eo; ++index) {
+        memcpy(
+            &buffer[i * cesb.c_size_vec + (s * cesb.block_vol_eo + index) * HalfVector::c_size],
+            &bases[i * cesb.c_size_vec + (index * cesb.ls + s) * HalfVector::c_size],
+            HalfVector::c_size * sizeof(ComplexF));
+      }
+    }
+  }
+  {
+    const long c_size = cesi.nkeep_single * cesb.c_size_vec;
+    const long d_size = c_size * sizeof(ComplexF);
+    write_floats(
+        Vector<uint8_t>(data.data() + cesd.bases_offset_single, d_size),
+        Vector<float>((float*)buffer.data(), c_size * 2));
+  }
+  {
+    const long c_size = cesi.nkeep_fp16 * cesb.c_size_vec;
+    const long d_size = fp_16_size(c_size * 2, 24);
+    write_floats_fp16(
+        Vector<uint8_t>(data.data() + cesd.bases_offset_fp16, d_size),
+        Vector<float>((float*)(buffer.data() + cesi.nkeep_single * cesb.c_size_vec), c_size * 2),
+        24);
+  }
+  for (int i = 0; i < cesc.n_vec; ++i) {
+    const Vector<float> coef((float*)&coefs[i * cesc.c_size_vec], cesc.c_size_vec * 2);
+    Vector<uint8_t> dc(&data[cesd.coefs_offset + i * cesd.coef_size], cesd.coef_size);
+    write_floats(
+        Vector<uint8_t>(dc.data(), cesi.nkeep_single * sizeof(ComplexF)),
+        Vector<float>(coef.data(), cesi.nkeep_single * 2));
+    write_floats_fp16(
+        Vector<uint8_t>(dc.data() + cesi.nkeep_single * sizeof(ComplexF),
+          fp_16_size(cesi.nkeep_fp16 * 2, cesi.FP16_COEF_EXP_SHARE_FLOATS)),
+        Vector<float>(coef.data() + cesi.nkeep_single * 2, cesi.nkeep_fp16 * 2),
+        cesi.FP16_COEF_EXP_SHARE_FLOATS);
+  }
+}
+
 inline std::vector<crc32_t> load_node(
     CompressedEigenSystemBases& cesb, CompressedEigenSystemCoefs& cesc,
     const CompressedEigenSystemInfo& cesi,
@@ -1008,6 +1119,88 @@ inline void decompress_eigen_system(
   }
 }
 
+inline std::vector<long> get_block_odd_site_indices(const Geometry& geo, const Coordinate& block_site, const Coordinate& bxl)
+  // the local indices of the odd sites (eo_parity) of the block bxl in the order of the compressed format,
+  // i.e. the site xl is at index_from_coordinate(xl % block_site, block_site) / 2
+{
+  qassert(block_site[0] % 2 == 0);
+  const long block_vol = product(block_site);
+  std::vector<long> ret(block_vol / 2, -1);
+  for (long i = 0; i < block_vol; ++i) {
+    const Coordinate xl = bxl * block_site + coordinate_from_index(i, block_site);
+    if (1 == eo_parity(geo.coordinate_g_from_l(xl))) {
+      qassert(ret[i / 2] == -1);
+      ret[i / 2] = geo.index_from_coordinate(xl);
+    }
+  }
+  return ret;
+}
+
+inline void compress_eigen_system(
+    CompressedEigenSystemBases& cesb,
+    CompressedEigenSystemCoefs& cesc,
+    const std::vector<FermionField5d>& evecs,
+    const Coordinate& block_site,
+    const int nkeep)
+  // interface
+  // evecs are FermionField5d (multiplicity ls) with only the odd sites used, e.g. from lanczos_dwf
+  // the bases of each block are orthonormalized (Householder QR) from the first nkeep vectors
+  // and the coefs are the components of all the vectors on them
+  // cesb and cesc will be reinitialized
+{
+  TIMER_VERBOSE_FLOPS("compress_eigen_system");
+  const int n_vec = evecs.size();
+  qassert(0 < nkeep and nkeep <= n_vec);
+  const Geometry& geo = evecs[0].geo;
+  const int ls = geo.multiplicity;
+  const Geometry geo_full = geo_reform(geo);
+  cesb.init();
+  cesc.init();
+  init_compressed_eigen_system_bases(cesb, nkeep, geo_full, block_site, ls);
+  init_compressed_eigen_system_coefs(cesc, n_vec, nkeep, geo_full, block_site, ls);
+  const long c_size_vec = cesb.c_size_vec;
+  const long site_size = ls * HalfVector::c_size;
+  qassert(nkeep <= c_size_vec);
+  const Geometry& geo_b = cesb.geo;
+  timer.flops += geo_b.local_volume() * 8 * c_size_vec * nkeep * (2 * nkeep + n_vec);
+#pragma omp parallel for
+  for (long bindex = 0; bindex < geo_b.local_volume(); ++bindex) {
+    const Coordinate bxl = geo_b.coordinate_from_index(bindex);
+    const std::vector<long> sindices = get_block_odd_site_indices(geo, block_site, bxl);
+    Eigen::MatrixXcd x(c_size_vec, nkeep);
+    for (int i = 0; i < nkeep; ++i) {
+      for (long bidx = 0; bidx < (long)sindices.size(); ++bidx) {
+        const Complex* p = (const Complex*)evecs[i].get_elems_const(sindices[bidx]).data();
+        for (long m = 0; m < site_size; ++m) {
+          x(bidx * site_size + m, i) = p[m];
+        }
+      }
+    }
+    const Eigen::HouseholderQR<Eigen::MatrixXcd> qr(x);
+    const Eigen::MatrixXcd q = qr.householderQ() * Eigen::MatrixXcd::Identity(c_size_vec, nkeep);
+    Vector<ComplexF> bases = cesb.get_elems(bindex);
+    for (int j = 0; j < nkeep; ++j) {
+      for (long m = 0; m < c_size_vec; ++m) {
+        bases[j * c_size_vec + m] = ComplexF(q(m, j));
+      }
+    }
+    Vector<ComplexF> coefs = cesc.get_elems(bindex);
+    Eigen::VectorXcd v(c_size_vec);
+    for (int i = 0; i < n_vec; ++i) {
+      for (long bidx = 0; bidx < (long)sindices.size(); ++bidx) {
+        const Complex* p = (const Complex*)evecs[i].get_elems_const(sindices[bidx]).data();
+        for (long m = 0; m < site_size; ++m) {
+          v(bidx * site_size + m) = p[m];
+        }
+      }
+      const Eigen::VectorXcd c = q.adjoint() * v;
+      for (int j = 0; j < nkeep; ++j) {
+        coefs[i * nkeep + j] = ComplexF(c(j));
+      }
+    }
+  }
+}
+
 inline void convert_half_vector(HalfVector& hv, const BlockedHalfVector& bhv)
 {
   TIMER("convert_half_vector");
@@ -1048,6 +1241,35 @@ inline void convert_half_vectors(std::vector<HalfVector>& hvs, std::vector<Block
   clear(bhvs);
 }
 
+inline void convert_fermion_field_5d(FermionField5d& ff, const BlockedHalfVector& bhv)
+  // the odd sites (eo_parity) of ff from bhv and the even sites set to zero
+  // inverse of the blocking of compress_eigen_system
+  // ff will use the machine geometry
+{
+  TIMER("convert_fermion_field_5d");
+  const Coordinate& block_site = bhv.block_site;
+  const int ls = bhv.ls;
+  ff.init();
+  ff.init(Geometry(bhv.geo_full.total_site(), ls));
+  qassert(is_matching_geo(ff.geo, bhv.geo_full));
+  set_zero(ff);
+  const Geometry& geo = ff.geo;
+  const Geometry& geo_b = bhv.geo;
+  const long site_size = ls * HalfVector::c_size;
+#pragma omp parallel for
+  for (long bindex = 0; bindex < geo_b.local_volume(); ++bindex) {
+    const Coordinate bxl = geo_b.coordinate_from_index(bindex);
+    const std::vector<long> sindices = get_block_odd_site_indices(geo, block_site, bxl);
+    const Vector<ComplexF> block = bhv.get_elems_const(bindex);
+    for (long bidx = 0; bidx < (long)sindices.size(); ++bidx) {
+      Complex* p = (Complex*)ff.get_elems(sindices[bidx]).data();
+      for (long m = 0; m < site_size; ++m) {
+        p[m] = block[bidx * site_size + m];
+      }
+    }
+  }
+}
+
 inline void convert_half_vector_bfm_format(Vector<ComplexF> bfm_data, const HalfVector& hv)
   // interface
   // bfm will have t_dir simd layout
@@ -1112,6 +1334,102 @@ inline long load_compressed_eigen_vectors(
   return total_bytes;
 }
 
+inline CompressedEigenSystemInfo make_compressed_eigen_system_info(
+    const CompressedEigenSystemBases& cesb, const CompressedEigenSystemCoefs& cesc,
+    const int nkeep_single, const int fp16_coef_exp_share_floats)
+  // the first nkeep_single bases and components are saved in single precision, the others in fp16
+  // crcs are set to zero
+{
+  CompressedEigenSystemDenseInfo cesdi;
+  cesdi.total_site = cesb.geo_full.total_site();
+  cesdi.node_site = cesb.geo_full.node_site;
+  cesdi.block_site = cesb.block_site;
+  cesdi.ls = cesb.ls;
+  cesdi.neig = cesc.n_vec;
+  cesdi.nkeep = cesb.n_basis;
+  cesdi.nkeep_single = nkeep_single;
+  cesdi.FP16_COEF_EXP_SHARE_FLOATS = fp16_coef_exp_share_floats;
+  qassert(fp16_coef_exp_share_floats > 0);
+  qassert((cesdi.nkeep - nkeep_single) * 2 % fp16_coef_exp_share_floats == 0);
+  return populate_eigen_system_info(cesdi, std::vector<crc32_t>(product(cesb.geo_full.geon.size_node), 0));
+}
+
+inline long save_compressed_eigen_vectors(
+    const std::vector<double>& eigen_values,
+    CompressedEigenSystemInfo& cesi,
+    const CompressedEigenSystemBases& cesb,
+    const CompressedEigenSystemCoefs& cesc,
+    const std::string& path)
+  // interface
+  // inverse of load_compressed_eigen_vectors, cesi.crcs will be set
+  // cesb and cesc have the machine geometry
+{
+  TIMER_VERBOSE_FLOPS("save_compressed_eigen_vectors");
+  qassert((long)eigen_values.size() == cesi.neig);
+  long total_bytes = 0;
+  qmkdir_info(path);
+  CompressedEigenSystemData cesd;
+  init_compressed_eigen_system_data(cesd, cesi, get_id_node(), get_size_node());
+  qassert(geo_remult(cesb.geo) == geo_remult(cesc.geo));
+  qassert(is_matching_geo(cesd.geo, cesb.geo));
+  {
+    const Geometry& geo = cesd.geo;
+#pragma omp parallel for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      save_block(cesd, xl, cesb, cesc, cesi);
+    }
+  }
+  std::vector<crc32_t>& crcs = cesi.crcs;
+  crcs.assign(product(get_size_node()), 0);
+  const int n_cycle = std::max(1, get_num_node() / dist_write_par_limit());
+  {
+    long bytes = 0;
+    for (int i = 0; i < n_cycle; ++i) {
+      TIMER_VERBOSE_FLOPS("save_compressed_eigen_vectors-save-cycle");
+      if (get_id_node() % n_cycle == i) {
+        crcs[get_id_node()] = save_node_data(cesd, cesi, path);
+        bytes = get_data(cesd).data_size();
+      } else {
+        bytes = 0;
+      }
+      glb_sum(bytes);
+      displayln_info(fname + ssprintf(": cycle / n_cycle = %4d / %4d", i + 1, n_cycle));
+      timer.flops += bytes;
+      total_bytes += bytes;
+    }
+    timer.flops += total_bytes;
+  }
+  glb_sum_byte_vec(get_data(crcs));
+  if (get_id_node() == 0) {
+    FILE* fp = qopen(path + "/eigen-values.txt.partial", "w");
+    qassert(fp != NULL);
+    displayln(ssprintf("%ld", (long)eigen_values.size()), fp);
+    for (long k = 0; k < (long)eigen_values.size(); ++k) {
+      displayln(ssprintf("%.17E", eigen_values[k]), fp);
+    }
+    qclose(fp);
+    qrename(path + "/eigen-values.txt.partial", path + "/eigen-values.txt");
+  }
+  write_compressed_eigen_system_info(cesi, path);
+  return total_bytes;
+}
+
+inline long save_compressed_eigen_vectors(
+    const std::vector<double>& eigen_values,
+    const std::vector<FermionField5d>& eigen_vectors,
+    const Coordinate& block_site, const int nkeep, const int nkeep_single,
+    const int fp16_coef_exp_share_floats, const std::string& path)
+  // interface
+  // compress the odd site eigen vectors (e.g. from lanczos_dwf) and save them
+{
+  CompressedEigenSystemBases cesb;
+  CompressedEigenSystemCoefs cesc;
+  compress_eigen_system(cesb, cesc, eigen_vectors, block_site, nkeep);
+  CompressedEigenSystemInfo cesi = make_compressed_eigen_system_info(cesb, cesc, nkeep_single, fp16_coef_exp_share_floats);
+  return save_compressed_eigen_vectors(eigen_values, cesi, cesb, cesc, path);
+}
+
 inline crc32_t save_half_vectors(const std::vector<HalfVector>& hvs, const std::string& fn, const bool is_saving_crc = false, const bool is_bfm_format = false)
   // if is_bfm_format then will apply t_dir simd
   // always big endianness
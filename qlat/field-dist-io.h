@@ -20,16 +20,20 @@ inline int& dist_read_par_limit() {
   return npar;
 }
 
-inline std::vector<Geometry> make_dist_io_geos(const Coordinate& total_site, const int multiplicity, const Coordinate& new_size_node)
+inline std::vector<Geometry> make_dist_io_geos(const Coordinate& total_site, const int multiplicity, const Coordinate& new_size_node,
+    const GeometryNode& geon_io)
+  // new geometries (of new_size_node) handled by this node of geon_io
 {
   TIMER("make_dist_io_geos");
   const Coordinate new_node_site = total_site / new_size_node;
   const int new_num_node = product(new_size_node);
   std::vector<Geometry> ret;
-  const int min_size_chunk = new_num_node / get_num_node();
-  const int remain = new_num_node % get_num_node();
-  const int size_chunk = get_id_node() < remain ? min_size_chunk + 1 : min_size_chunk;
-  const int chunk_start = get_id_node() * min_size_chunk + (get_id_node() < remain ? get_id_node() : remain);
+  const int num_node = geon_io.num_node;
+  const int id_node = geon_io.id_node;
+  const int min_size_chunk = new_num_node / num_node;
+  const int remain = new_num_node % num_node;
+  const int size_chunk = id_node < remain ? min_size_chunk + 1 : min_size_chunk;
+  const int chunk_start = id_node * min_size_chunk + (id_node < remain ? id_node : remain);
   const int chunk_end = std::min(new_num_node, chunk_start + size_chunk);
   for (int new_id_node = chunk_start; new_id_node < chunk_end; ++new_id_node) {
     GeometryNode geon;
@@ -38,6 +42,7 @@ inline std::vector<Geometry> make_dist_io_geos(const Coordinate& total_site, con
     geon.id_node = new_id_node;
     geon.size_node = new_size_node;
     geon.coor_node = coordinate_from_index(new_id_node, new_size_node);
+    geon.comm = geon_io.comm;
     Geometry new_geo;
     new_geo.init(geon, multiplicity, new_node_site);
     ret.push_back(new_geo);
@@ -45,6 +50,11 @@ inline std::vector<Geometry> make_dist_io_geos(const Coordinate& total_site, con
   return ret;
 }
 
+inline std::vector<Geometry> make_dist_io_geos(const Coordinate& total_site, const int multiplicity, const Coordinate& new_size_node)
+{
+  return make_dist_io_geos(total_site, multiplicity, new_size_node, get_geometry_node());
+}
+
 inline int dist_mkdir(const std::string& path, const int num_node, const mode_t mode = default_dir_mode())
 {
   int ret = 0;
@@ -472,6 +482,8 @@ struct ShufflePlanKey
 {
   Coordinate total_site;
   Coordinate new_size_node;
+  GeometryNode geon;
+  // node geometry (and communicator) of the field to be shuffled
 };
 
 inline bool operator<(const ShufflePlanKey& x, const ShufflePlanKey& y)
@@ -480,8 +492,18 @@ inline bool operator<(const ShufflePlanKey& x, const ShufflePlanKey& y)
     return true;
   } else if (y.new_size_node < x.new_size_node) {
     return false;
+  } else if (x.total_site < y.total_site) {
+    return true;
+  } else if (y.total_site < x.total_site) {
+    return false;
+  } else if (x.geon.comm != y.geon.comm) {
+    return std::memcmp(&x.geon.comm, &y.geon.comm, sizeof(MPI_Comm)) < 0;
+  } else if (x.geon.size_node < y.geon.size_node) {
+    return true;
+  } else if (y.geon.size_node < x.geon.size_node) {
+    return false;
   } else {
-    return x.total_site < y.total_site;
+    return x.geon.id_node < y.geon.id_node;
   }
 }
 
@@ -526,9 +548,9 @@ inline ShufflePlan make_shuffle_plan(const ShufflePlanKey& spk)
   qassert(new_size_node * new_node_site == total_site);
   const int new_num_node = product(new_size_node);
   Geometry geo;
-  geo.init(total_site, 1);
+  geo.init(spk.geon, 1, total_site / spk.geon.size_node);
   const int num_node = geo.geon.num_node;
-  std::vector<Geometry> new_geos = make_dist_io_geos(geo.total_site(), geo.multiplicity, new_size_node);
+  std::vector<Geometry> new_geos = make_dist_io_geos(geo.total_site(), geo.multiplicity, new_size_node, geo.geon);
   ShufflePlan ret;
   // total_send_size
   ret.total_send_size = geo.local_volume();
@@ -685,14 +707,21 @@ inline const ShufflePlan& get_shuffle_plan(const ShufflePlanKey& spk)
   return get_shuffle_plan_cache()[spk];
 }
 
-inline const ShufflePlan& get_shuffle_plan(const Coordinate& total_site, const Coordinate& new_size_node)
+inline const ShufflePlan& get_shuffle_plan(const Coordinate& total_site, const Coordinate& new_size_node,
+    const GeometryNode& geon)
 {
   ShufflePlanKey spk;
   spk.total_site = total_site;
   spk.new_size_node = new_size_node;
+  spk.geon = geon;
   return get_shuffle_plan(spk);
 }
 
+inline const ShufflePlan& get_shuffle_plan(const Coordinate& total_site, const Coordinate& new_size_node)
+{
+  return get_shuffle_plan(total_site, new_size_node, get_geometry_node());
+}
+
 template <class M>
 void shuffle_field(std::vector<Field<M> >& fs, const Field<M>& f, const Coordinate& new_size_node)
 {
@@ -703,10 +732,11 @@ void shuffle_field(std::vector<Field<M> >& fs, const Field<M>& f, const Coordina
     fs[0] = f;
     return;
   }
-  sync_node();
+  const MPI_Comm& comm = geo.geon.comm;
+  sync_node(comm);
   TIMER_VERBOSE_FLOPS("shuffle_field");
-  const ShufflePlan& sp = get_shuffle_plan(geo.total_site(), new_size_node);
-  const long total_bytes = sp.total_send_size * geo.multiplicity * sizeof(M) * get_num_node();
+  const ShufflePlan& sp = get_shuffle_plan(geo.total_site(), new_size_node, geo.geon);
+  const long total_bytes = sp.total_send_size * geo.multiplicity * sizeof(M) * geo.geon.num_node;
   timer.flops += total_bytes;
   std::vector<M> send_buffer(sp.total_send_size * geo.multiplicity);
 #pragma omp parallel for
@@ -719,7 +749,7 @@ void shuffle_field(std::vector<Field<M> >& fs, const Field<M>& f, const Coordina
   }
   std::vector<M> recv_buffer(sp.total_recv_size * geo.multiplicity);
   {
-    sync_node();
+    sync_node(comm);
     TIMER_VERBOSE_FLOPS("shuffle_field-comm");
     timer.flops += total_bytes;
     std::vector<MPI_Request> send_reqs(sp.send_msg_infos.size());
@@ -730,20 +760,20 @@ void shuffle_field(std::vector<Field<M> >& fs, const Field<M>& f, const Coordina
       for (size_t i = 0; i < sp.send_msg_infos.size(); ++i) {
         const ShufflePlanMsgInfo& mi = sp.send_msg_infos[i];
         MPI_Isend(&send_buffer[mi.idx * geo.multiplicity], mi.size * geo.multiplicity * sizeof(M), MPI_BYTE, mi.id_node,
-            mpi_tag, get_comm(), &send_reqs[i]);
+            mpi_tag, comm, &send_reqs[i]);
       }
       for (size_t i = 0; i < sp.recv_msg_infos.size(); ++i) {
         const ShufflePlanMsgInfo& mi = sp.recv_msg_infos[i];
         MPI_Irecv(&recv_buffer[mi.idx * geo.multiplicity], mi.size * geo.multiplicity * sizeof(M), MPI_BYTE, mi.id_node,
-            mpi_tag, get_comm(), &recv_reqs[i]);
+            mpi_tag, comm, &recv_reqs[i]);
       }
     }
     MPI_Waitall(recv_reqs.size(), recv_reqs.data(), MPI_STATUS_IGNORE);
     MPI_Waitall(send_reqs.size(), send_reqs.data(), MPI_STATUS_IGNORE);
-    sync_node();
+    sync_node(comm);
   }
   clear(send_buffer);
-  const std::vector<Geometry> new_geos = make_dist_io_geos(geo.total_site(), geo.multiplicity, new_size_node);
+  const std::vector<Geometry> new_geos = make_dist_io_geos(geo.total_site(), geo.multiplicity, new_size_node, geo.geon);
   fs.resize(new_geos.size());
   for (size_t i = 0; i < fs.size(); ++i) {
     fs[i].init(new_geos[i]);
@@ -782,10 +812,11 @@ void shuffle_field_back(Field<M>& f, const std::vector<Field<M> >& fs, const Coo
     f = fs[0];
     return;
   }
-  sync_node();
+  const MPI_Comm& comm = geo.geon.comm;
+  sync_node(comm);
   TIMER_VERBOSE_FLOPS("shuffle_field_back");
-  const ShufflePlan& sp = get_shuffle_plan(geo.total_site(), new_size_node);
-  const long total_bytes = sp.total_send_size * geo.multiplicity * sizeof(M) * get_num_node();
+  const ShufflePlan& sp = get_shuffle_plan(geo.total_site(), new_size_node, geo.geon);
+  const long total_bytes = sp.total_send_size * geo.multiplicity * sizeof(M) * geo.geon.num_node;
   timer.flops += total_bytes;
   std::vector<M> recv_buffer(sp.total_recv_size * geo.multiplicity);
 #pragma omp parallel for
@@ -798,7 +829,7 @@ void shuffle_field_back(Field<M>& f, const std::vector<Field<M> >& fs, const Coo
   }
   std::vector<M> send_buffer(sp.total_send_size * geo.multiplicity);
   {
-    sync_node();
+    sync_node(comm);
     TIMER_VERBOSE_FLOPS("shuffle_field-comm");
     timer.flops += total_bytes;
     std::vector<MPI_Request> send_reqs(sp.send_msg_infos.size());
@@ -809,12 +840,12 @@ void shuffle_field_back(Field<M>& f, const std::vector<Field<M> >& fs, const Coo
       for (size_t i = 0; i < sp.recv_msg_infos.size(); ++i) {
         const ShufflePlanMsgInfo& mi = sp.recv_msg_infos[i];
         MPI_Isend(&recv_buffer[mi.idx * geo.multiplicity], mi.size * geo.multiplicity * sizeof(M), MPI_BYTE, mi.id_node,
-            mpi_tag, get_comm(), &recv_reqs[i]);
+            mpi_tag, comm, &recv_reqs[i]);
       }
       for (size_t i = 0; i < sp.send_msg_infos.size(); ++i) {
         const ShufflePlanMsgInfo& mi = sp.send_msg_infos[i];
         MPI_Irecv(&send_buffer[mi.idx * geo.multiplicity], mi.size * geo.multiplicity * sizeof(M), MPI_BYTE, mi.id_node,
-            mpi_tag, get_comm(), &send_reqs[i]);
+            mpi_tag, comm, &send_reqs[i]);
       }
     }
     for (size_t i = 0; i < recv_reqs.size(); ++i) {
@@ -823,7 +854,7 @@ void shuffle_field_back(Field<M>& f, const std::vector<Field<M> >& fs, const Coo
     for (size_t i = 0; i < send_reqs.size(); ++i) {
       MPI_Wait(&send_reqs[i], MPI_STATUS_IGNORE);
     }
-    sync_node();
+    sync_node(comm);
   }
   clear(recv_buffer);
 #pragma omp parallel for
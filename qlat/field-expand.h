@@ -61,6 +61,36 @@ inline void set_marks_field_1(CommMarks& marks, const Geometry& geo, const std::
   }
 }
 
+inline void set_marks_field_dirs(CommMarks& marks, const Geometry& geo, const std::string& tag)
+  // tag is a list of dirs as "0 -4 2"
+  // mark coordinate_shifts(x, dir) for all the local x and the listed dirs
+{
+  TIMER_VERBOSE("set_marks_field_dirs");
+  std::vector<int> dirs;
+  const char* s = tag.c_str();
+  int dir, n;
+  while (1 == sscanf(s, "%d%n", &dir, &n)) {
+    qassert(-DIMN <= dir && dir < DIMN);
+    dirs.push_back(dir);
+    s += n;
+  }
+  marks.init();
+  marks.init(geo);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    for (int i = 0; i < (int)dirs.size(); ++i) {
+      const Coordinate xl1 = coordinate_shifts(xl, dirs[i]);
+      if (geo.is_on_node(xl1) and !geo.is_local(xl1)) {
+        Vector<int8_t> v = marks.get_elems(xl1);
+        for (int m = 0; m < geo.multiplicity; ++m) {
+          v[m] = 1;
+        }
+      }
+    }
+  }
+}
+
 struct CommPackInfo
 {
   long offset;
@@ -102,6 +132,9 @@ inline bool operator<(const CommPlanKey& x, const CommPlanKey& y)
     return true;
   } else if (y.tag < x.tag) {
     return false;
+  } else if (x.geo.geon.comm != y.geo.geon.comm) {
+    // show(geo) does not include the communicator
+    return std::memcmp(&x.geo.geon.comm, &y.geo.geon.comm, sizeof(MPI_Comm)) < 0;
   } else {
     const std::string xgeo = show(x.geo);
     const std::string ygeo = show(y.geo);
@@ -140,25 +173,29 @@ inline CommPlan make_comm_plan(const CommMarks& marks)
 {
   TIMER_VERBOSE("make_comm_plan");
   const Geometry& geo = marks.geo;
+  const GeometryNode& geon = geo.geon;
   CommPlan ret;
   ret.total_send_size = 0;
   ret.total_recv_size = 0;
   //
   std::map<int,std::vector<long> > src_id_node_g_offsets; // src node id ; vector of g_offset
+  std::map<int,std::vector<long> > src_id_node_offsets; // src node id ; vector of offset
+  // the same g_offset can appear at several offsets if the expanded field wraps around
   for (long offset = 0; offset < geo.local_volume_expanded() * geo.multiplicity; ++offset) {
     const int8_t r = marks.get_elem(offset);
     if (r != 0) {
       int id_node;
       long g_offset;
       g_offset_id_node_from_offset(g_offset, id_node, offset, geo);
-      if (id_node != get_id_node()) {
-        qassert(0 <= id_node and id_node < get_num_node());
+      if (id_node != geon.id_node) {
+        qassert(0 <= id_node and id_node < geon.num_node);
         src_id_node_g_offsets[id_node].push_back(g_offset);
+        src_id_node_offsets[id_node].push_back(offset);
       }
     }
   }
   //
-  std::vector<long> src_id_node_count(get_num_node(), 0); // number of total send pkgs for each node
+  std::vector<long> src_id_node_count(geon.num_node, 0); // number of total send pkgs for each node
   {
     long count = 0;
     for (std::map<int,std::vector<long> >::const_iterator it = src_id_node_g_offsets.cbegin(); it != src_id_node_g_offsets.cend(); ++it) {
@@ -174,8 +211,8 @@ inline CommPlan make_comm_plan(const CommMarks& marks)
     // ret.total_recv_size finish
     // ret.recv_msg_infos finish
   }
-  glb_sum(get_data(src_id_node_count));
-  ret.send_msg_infos.resize(src_id_node_count[get_id_node()]);
+  glb_sum_long_vec(get_data(src_id_node_count), geon.comm);
+  ret.send_msg_infos.resize(src_id_node_count[geon.id_node]);
   //
   std::map<int,std::vector<long> > dst_id_node_g_offsets; // dst node id ; vector of g_offset
   {
@@ -187,17 +224,17 @@ inline CommPlan make_comm_plan(const CommMarks& marks)
       int k = 0;
       for (std::map<int,std::vector<long> >::const_iterator it = src_id_node_g_offsets.cbegin(); it != src_id_node_g_offsets.cend(); ++it) {
         CommMsgInfo& cmi = send_send_msg_infos[k];
-        cmi.id_node = get_id_node();
+        cmi.id_node = geon.id_node;
         cmi.buffer_idx = 0;
         cmi.size = it->second.size();
         MPI_Isend(&cmi, sizeof(CommMsgInfo), MPI_BYTE, it->first,
-            mpi_tag, get_comm(), &send_reqs[k]);
+            mpi_tag, geon.comm, &send_reqs[k]);
         k += 1;
       }
       for (int i = 0; i < ret.send_msg_infos.size(); ++i) {
         CommMsgInfo& cmi = ret.send_msg_infos[i];
         MPI_Recv(&cmi, sizeof(CommMsgInfo), MPI_BYTE, MPI_ANY_SOURCE,
-            mpi_tag, get_comm(), MPI_STATUS_IGNORE);
+            mpi_tag, geon.comm, MPI_STATUS_IGNORE);
         dst_id_node_g_offsets[cmi.id_node].resize(cmi.size);
       }
       MPI_Waitall(send_reqs.size(), send_reqs.data(), MPI_STATUS_IGNORE);
@@ -207,7 +244,7 @@ inline CommPlan make_comm_plan(const CommMarks& marks)
       int k = 0;
       for (std::map<int,std::vector<long> >::const_iterator it = src_id_node_g_offsets.cbegin(); it != src_id_node_g_offsets.cend(); ++it) {
         MPI_Isend((void*)it->second.data(), it->second.size(), MPI_LONG, it->first,
-            mpi_tag, get_comm(), &send_reqs[k]);
+            mpi_tag, geon.comm, &send_reqs[k]);
         k += 1;
       }
       k = 0;
@@ -219,7 +256,7 @@ inline CommPlan make_comm_plan(const CommMarks& marks)
         cmi.size = it->second.size();
         count += cmi.size;
         MPI_Irecv(it->second.data(), it->second.size(), MPI_LONG, it->first,
-            mpi_tag, get_comm(), &recv_reqs[k]);
+            mpi_tag, geon.comm, &recv_reqs[k]);
         k += 1;
       }
       ret.total_send_size = count;
@@ -234,14 +271,13 @@ inline CommPlan make_comm_plan(const CommMarks& marks)
     int k = 0;
     for (std::map<int,std::vector<long> >::const_iterator it = src_id_node_g_offsets.cbegin(); it != src_id_node_g_offsets.cend(); ++it) {
       const int src_id_node = it->first;
-      const std::vector<long>& g_offsets = it->second;
+      const std::vector<long>& offsets = src_id_node_offsets[src_id_node];
       qassert(src_id_node == ret.recv_msg_infos[k].id_node);
       qassert(current_buffer_idx == ret.recv_msg_infos[k].buffer_idx);
-      qassert(g_offsets.size() == ret.recv_msg_infos[k].size);
+      qassert(offsets.size() == ret.recv_msg_infos[k].size);
       long current_offset = -1;
-      for (long i = 0; i < g_offsets.size(); ++i) {
-        const long g_offset = g_offsets[i];
-        const long offset = offset_from_g_offset(g_offset, geo);
+      for (long i = 0; i < offsets.size(); ++i) {
+        const long offset = offsets[i];
         if (offset != current_offset) {
           CommPackInfo cpi;
           cpi.offset = offset;
@@ -337,7 +373,8 @@ void refresh_expanded(Field<M>& f, const CommPlan& plan)
     memcpy(&send_buffer[cpi.buffer_idx], &f.get_elem(cpi.offset), cpi.size * sizeof(M));
   }
   {
-    sync_node();
+    const MPI_Comm& comm = f.geo.geon.comm;
+    sync_node(comm);
     TIMER_FLOPS("refresh_expanded-comm");
     timer.flops += (plan.total_recv_size + plan.total_send_size) * sizeof(M) / 2;
     std::vector<MPI_Request> send_reqs(plan.send_msg_infos.size());
@@ -348,17 +385,17 @@ void refresh_expanded(Field<M>& f, const CommPlan& plan)
       for (size_t i = 0; i < plan.send_msg_infos.size(); ++i) {
         const CommMsgInfo& cmi = plan.send_msg_infos[i];
         MPI_Isend(&send_buffer[cmi.buffer_idx], cmi.size * sizeof(M), MPI_BYTE, cmi.id_node,
-            mpi_tag, get_comm(), &send_reqs[i]);
+            mpi_tag, comm, &send_reqs[i]);
       }
       for (size_t i = 0; i < plan.recv_msg_infos.size(); ++i) {
         const CommMsgInfo& cmi = plan.recv_msg_infos[i];
         MPI_Irecv(&recv_buffer[cmi.buffer_idx], cmi.size * sizeof(M), MPI_BYTE, cmi.id_node,
-            mpi_tag, get_comm(), &recv_reqs[i]);
+            mpi_tag, comm, &recv_reqs[i]);
       }
     }
     MPI_Waitall(recv_reqs.size(), recv_reqs.data(), MPI_STATUS_IGNORE);
     MPI_Waitall(send_reqs.size(), send_reqs.data(), MPI_STATUS_IGNORE);
-    sync_node();
+    sync_node(comm);
   }
 #pragma omp parallel for
   for (long i = 0; i < plan.recv_pack_infos.size(); ++i) {
@@ -367,6 +404,88 @@ void refresh_expanded(Field<M>& f, const CommPlan& plan)
   }
 }
 
+template <class M>
+struct RefreshExpandedRequest
+  // the state of a split-phase refresh_expanded
+  // f should not be modified in between refresh_expanded_begin and refresh_expanded_end
+{
+  Field<M>* f;
+  const CommPlan* plan;
+  std::vector<M> send_buffer;
+  std::vector<M> recv_buffer;
+  std::vector<MPI_Request> reqs;
+  //
+  RefreshExpandedRequest()
+  {
+    f = NULL;
+    plan = NULL;
+  }
+};
+
+template <class M>
+void refresh_expanded_begin(RefreshExpandedRequest<M>& req, Field<M>& f, const CommPlan& plan)
+  // pack and start the messages, the local sites can be used until refresh_expanded_end
+{
+  TIMER_FLOPS("refresh_expanded_begin");
+  timer.flops += (plan.total_recv_size + plan.total_send_size) * sizeof(M) / 2;
+  qassert(NULL == req.f);
+  req.f = &f;
+  req.plan = &plan;
+  req.send_buffer.resize(plan.total_send_size);
+  req.recv_buffer.resize(plan.total_recv_size);
+#pragma omp parallel for
+  for (long i = 0; i < plan.send_pack_infos.size(); ++i) {
+    const CommPackInfo& cpi = plan.send_pack_infos[i];
+    memcpy(&req.send_buffer[cpi.buffer_idx], &f.get_elem(cpi.offset), cpi.size * sizeof(M));
+  }
+  const MPI_Comm& comm = f.geo.geon.comm;
+  const int mpi_tag = 11;
+  req.reqs.resize(plan.send_msg_infos.size() + plan.recv_msg_infos.size());
+  for (size_t i = 0; i < plan.recv_msg_infos.size(); ++i) {
+    const CommMsgInfo& cmi = plan.recv_msg_infos[i];
+    MPI_Irecv(&req.recv_buffer[cmi.buffer_idx], cmi.size * sizeof(M), MPI_BYTE, cmi.id_node,
+        mpi_tag, comm, &req.reqs[i]);
+  }
+  for (size_t i = 0; i < plan.send_msg_infos.size(); ++i) {
+    const CommMsgInfo& cmi = plan.send_msg_infos[i];
+    MPI_Isend(&req.send_buffer[cmi.buffer_idx], cmi.size * sizeof(M), MPI_BYTE, cmi.id_node,
+        mpi_tag, comm, &req.reqs[plan.recv_msg_infos.size() + i]);
+  }
+}
+
+template <class M>
+void refresh_expanded_end(RefreshExpandedRequest<M>& req)
+  // wait for the messages and unpack
+{
+  TIMER("refresh_expanded_end");
+  qassert(NULL != req.f);
+  Field<M>& f = *req.f;
+  const CommPlan& plan = *req.plan;
+  {
+    TIMER("refresh_expanded_end-wait");
+    MPI_Waitall(req.reqs.size(), req.reqs.data(), MPI_STATUS_IGNORE);
+  }
+#pragma omp parallel for
+  for (long i = 0; i < plan.recv_pack_infos.size(); ++i) {
+    const CommPackInfo& cpi = plan.recv_pack_infos[i];
+    memcpy(&f.get_elem(cpi.offset), &req.recv_buffer[cpi.buffer_idx], cpi.size * sizeof(M));
+  }
+  req.f = NULL;
+  req.plan = NULL;
+}
+
+inline bool is_interior(const Coordinate& xl, const Geometry& geo, const int thick)
+  // whether all the sites within distance thick of the local site xl
+  // (in each direction) are local, i.e. do not depend on the expanded part
+{
+  for (int mu = 0; mu < DIMN; ++mu) {
+    if (geo.geon.size_node[mu] > 1 && (xl[mu] < thick || xl[mu] >= geo.node_site[mu] - thick)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 template <class M>
 void refresh_expanded(Field<M>& f, const SetMarksField& set_marks_field = set_marks_field_all, const std::string& tag = "")
 {
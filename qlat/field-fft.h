@@ -179,7 +179,7 @@ void fft_complex_field_dirs(Field<M>& field, const Coordinate& dirs)
     {
       TIMER_FLOPS("fft_complex_field_dirs-get_data");
       timer.flops += get_data_size(fields);
-      get_data_plus_mu(get_data(fieldr), get_data(fields), dir);
+      get_data_plus_mu(get_data(fieldr), get_data(fields), dir, geo.geon);
     }
     std::swap(fields, fieldr);
     geos.geon.coor_node[dir] = mod(geos.geon.coor_node[dir] + 1, geos.geon.size_node[dir]);
@@ -213,7 +213,7 @@ void fft_complex_field_dirs(Field<M>& field, const Coordinate& dirs)
     {
       TIMER_FLOPS("fft_complex_field_dirs-get_data");
       timer.flops += get_data_size(fields);
-      get_data_plus_mu(get_data(fieldr), get_data(fields), dir);
+      get_data_plus_mu(get_data(fieldr), get_data(fields), dir, geo.geon);
     }
     std::swap(fields, fieldr);
     geos.geon.coor_node[dir] = mod(geos.geon.coor_node[dir] + 1, geos.geon.size_node[dir]);
@@ -226,7 +226,7 @@ template<class M>
 void fft_complex_field(Field<M>& field, const bool isForward = true)
 {
   TIMER_FLOPS("fft_complex_field");
-  timer.flops += get_data(field).data_size() * get_num_node();
+  timer.flops += get_data(field).data_size() * field.geo.geon.num_node;
   // forward compute
   // field(k) <- \sum_{x} exp( - ii * 2 pi * k * x ) field(x)
   // backwards compute
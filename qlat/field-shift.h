@@ -0,0 +1,66 @@
+#pragma once
+
+#include <qlat/config.h>
+#include <qlat/utils.h>
+#include <qlat/field.h>
+#include <qlat/field-expand.h>
+
+QLAT_START_NAMESPACE
+
+inline void set_marks_field_shift(CommMarks& marks, const Geometry& geo, const std::string& tag)
+  // tag is the shift as "x y z t"
+  // mark x + shift for all the local x
+{
+  TIMER_VERBOSE("set_marks_field_shift");
+  Coordinate shift;
+  qassert(4 == sscanf(tag.c_str(), "%d %d %d %d", &shift[0], &shift[1], &shift[2], &shift[3]));
+  marks.init();
+  marks.init(geo);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const Coordinate xl1 = xl + shift;
+    if (!geo.is_local(xl1)) {
+      Vector<int8_t> v = marks.get_elems(xl1);
+      for (int m = 0; m < geo.multiplicity; ++m) {
+        v[m] = 1;
+      }
+    }
+  }
+}
+
+template <class M>
+void field_shift(Field<M>& f, const Field<M>& f0, const Coordinate& shift)
+  // f(x) = f0(x + shift) with periodic boundary condition, f can be f0
+  // the comm plan is cached by the geometry and the shift
+  // only the sites needed are exchanged (a halo of the size of the shift)
+{
+  TIMER("field_shift");
+  const Geometry geo = geo_resize(f0.geo);
+  const Coordinate s = smod(shift, geo.total_site());
+  Coordinate expansion_left, expansion_right;
+  for (int mu = 0; mu < DIMN; ++mu) {
+    // directions not split across nodes are wrapped by geo.mirror
+    if (geo.geon.size_node[mu] != 1) {
+      expansion_left[mu] = std::max(-s[mu], 0);
+      expansion_right[mu] = std::max(s[mu], 0);
+    }
+  }
+  Field<M> f1;
+  f1.init(geo_resize(geo, expansion_left, expansion_right));
+  f1 = f0;
+  refresh_expanded(f1, set_marks_field_shift, ssprintf("%d %d %d %d", s[0], s[1], s[2], s[3]));
+  f.init(geo);
+  qassert(is_matching_geo_mult(geo, f.geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<M> v = f.get_elems(xl);
+    const Vector<M> v1 = f1.get_elems_const(xl + s);
+    for (int m = 0; m < geo.multiplicity; ++m) {
+      v[m] = v1[m];
+    }
+  }
+}
+
+QLAT_END_NAMESPACE
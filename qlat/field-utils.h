@@ -43,11 +43,48 @@ std::vector<M> field_sum(const Field<M>& f)
   return vec;
 }
 
+template<class M>
+std::vector<M> field_glb_sum_double_exact(const Field<M>& f)
+  // result does not depend on the node and thread layout
+{
+  TIMER("field_glb_sum_double_exact");
+  const Geometry& geo = f.geo;
+  const int n = geo.multiplicity * sizeof(M) / sizeof(double);
+  std::vector<ExactDoubleSum> sums(n);
+#pragma omp parallel
+  {
+    std::vector<ExactDoubleSum> psums(n);
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      const Vector<M> fvec = f.get_elems_const(xl);
+      const double* p = (const double*)fvec.data();
+      for (int i = 0; i < n; ++i) {
+        psums[i].add(p[i]);
+      }
+    }
+#pragma omp critical
+    for (int i = 0; i < n; ++i) {
+      sums[i].add(psums[i]);
+    }
+  }
+  glb_sum(get_data(sums), geo.geon.comm);
+  std::vector<M> vec(geo.multiplicity);
+  double* p = (double*)vec.data();
+  for (int i = 0; i < n; ++i) {
+    p[i] = sums[i].get();
+  }
+  return vec;
+}
+
 template<class M>
 std::vector<M> field_glb_sum_double(const Field<M>& f)
 {
+  if (glb_sum_reproducible()) {
+    return field_glb_sum_double_exact(f);
+  }
   std::vector<M> vec = field_sum(f);
-  glb_sum_double_vec(Vector<M>(vec));
+  glb_sum_double_vec(Vector<M>(vec), f.geo.geon.comm);
   return vec;
 }
 
@@ -55,7 +92,7 @@ template<class M>
 std::vector<M> field_glb_sum_long(const Field<M>& f)
 {
   std::vector<M> vec = field_sum(f);
-  glb_sum_long_vec(Vector<M>(vec));
+  glb_sum_long_vec(Vector<M>(vec), f.geo.geon.comm);
   return vec;
 }
 
@@ -81,7 +118,7 @@ std::vector<M> field_project_mom(const Field<M>& f, const CoordinateD& mom)
       ret[m] += std::polar(1.0, -phase) * v[m];
     }
   }
-  glb_sum_double_vec(get_data(ret));
+  glb_sum_double_vec(get_data(ret), geo.geon.comm);
   return ret;
 }
 
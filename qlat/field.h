@@ -243,7 +243,7 @@ double norm(const Field<M>& f)
 #pragma omp for nowait
     for (long index = 0; index < geo.local_volume(); ++index) {
       Coordinate x = geo.coordinate_from_index(index);
-      Vector<M> fx = f.get_elems(x);
+      const Vector<M> fx = f.get_elems_const(x);
       for (int m = 0; m < geo.multiplicity; ++m) {
         psum += norm(fx[m]);
       }
@@ -255,7 +255,7 @@ double norm(const Field<M>& f)
       }
     }
   }
-  glb_sum(sum);
+  glb_sum_double_vec(get_data(sum), geo.geon.comm);
   return sum;
 }
 
@@ -245,6 +245,173 @@ inline ColorMatrix make_color_matrix_exp(const ColorMatrix& a)
   return t3;
 }
 
+inline ColorMatrix make_tr_less_anti_herm_matrix(const ColorMatrix& m)
+  // (m - m^dag) / 2 - tr(m - m^dag) / 2 / NUM_COLOR
+{
+  ColorMatrix ret = 0.5 * (m - matrix_adjoint(m));
+  const Complex tr = matrix_trace(ret) / (double)NUM_COLOR;
+  for (int i = 0; i < NUM_COLOR; ++i) {
+    ret(i,i) -= tr;
+  }
+  return ret;
+}
+
+struct ColorMatrixExpCoefs
+  // exp(i Q) = f[0] + f[1] Q + f[2] Q^2 for traceless hermitian Q
+  // b1[j] = d f[j] / d c1 and b2[j] = d f[j] / d c0 with
+  // c1 = tr(Q^2) / 2 and c0 = tr(Q^3) / 3 = det(Q)
+  // (Morningstar & Peardon, hep-lat/0311018)
+{
+  Complex f[3];
+  Complex b1[3];
+  Complex b2[3];
+};
+
+inline void set_color_matrix_exp_coefs_series(ColorMatrixExpCoefs& coefs, const double c0, const double c1)
+  // Taylor series of exp(i Q) with Q^n = p[0] + p[1] Q + p[2] Q^2 reduced by
+  // Q^3 = c0 + c1 Q, accurate for c1 < 0.1
+{
+  double p[3] = { 1.0, 0.0, 0.0 };
+  double dp1[3] = { 0.0, 0.0, 0.0 };
+  double dp0[3] = { 0.0, 0.0, 0.0 };
+  Complex t = 1.0;
+  for (int j = 0; j < 3; ++j) {
+    coefs.f[j] = 0.0;
+    coefs.b1[j] = 0.0;
+    coefs.b2[j] = 0.0;
+  }
+  for (int n = 0; n < 18; ++n) {
+    for (int j = 0; j < 3; ++j) {
+      coefs.f[j] += t * p[j];
+      coefs.b1[j] += t * dp1[j];
+      coefs.b2[j] += t * dp0[j];
+    }
+    const double q[3] = { p[2] * c0, p[0] + p[2] * c1, p[1] };
+    const double dq1[3] = { dp1[2] * c0, dp1[0] + dp1[2] * c1 + p[2], dp1[1] };
+    const double dq0[3] = { dp0[2] * c0 + p[2], dp0[0] + dp0[2] * c1, dp0[1] };
+    for (int j = 0; j < 3; ++j) {
+      p[j] = q[j];
+      dp1[j] = dq1[j];
+      dp0[j] = dq0[j];
+    }
+    t *= Complex(0.0, 1.0 / (n + 1));
+  }
+}
+
+inline void set_color_matrix_exp_coefs(ColorMatrixExpCoefs& coefs, const double c0_, const double c1,
+    const bool is_derivative = false)
+  // b1 and b2 are only set if is_derivative
+{
+  if (c1 < 0.1) {
+    // the closed form loses precision as 1 / c1 (1 / c1^2 for b1 and b2)
+    set_color_matrix_exp_coefs_series(coefs, c0_, c1);
+    return;
+  }
+  const bool is_negative = c0_ < 0;
+  const double c0 = is_negative ? -c0_ : c0_;
+  const double c0_max = 2.0 * std::pow(c1 / 3.0, 1.5);
+  const double theta = std::acos(std::min(1.0, c0 / c0_max));
+  const double u = std::sqrt(c1 / 3.0) * std::cos(theta / 3.0);
+  const double w = std::sqrt(c1) * std::sin(theta / 3.0);
+  const double u2 = u * u;
+  const double w2 = w * w;
+  const double cos_w = std::cos(w);
+  const double xi0 = std::abs(w) < 0.05 ? 1.0 - w2 / 6.0 * (1.0 - w2 / 20.0 * (1.0 - w2 / 42.0)) : std::sin(w) / w;
+  const Complex e2iu = std::polar(1.0, 2.0 * u);
+  const Complex emiu = std::polar(1.0, -u);
+  const Complex ii(0.0, 1.0);
+  const Complex h[3] = {
+    (u2 - w2) * e2iu + emiu * (8.0 * u2 * cos_w + 2.0 * ii * u * (3.0 * u2 + w2) * xi0),
+    2.0 * u * e2iu - emiu * (2.0 * u * cos_w - ii * (3.0 * u2 - w2) * xi0),
+    e2iu - emiu * (cos_w + 3.0 * ii * u * xi0),
+  };
+  const double fac = 1.0 / (9.0 * u2 - w2);
+  for (int j = 0; j < 3; ++j) {
+    coefs.f[j] = h[j] * fac;
+  }
+  if (is_derivative) {
+    const double xi1 = std::abs(w) < 0.05 ?
+      -1.0 / 3.0 + w2 / 30.0 * (1.0 - w2 / 28.0 * (1.0 - w2 / 54.0)) :
+      cos_w / w2 - std::sin(w) / (w2 * w);
+    const Complex r1[3] = {
+      2.0 * (u + ii * (u2 - w2)) * e2iu
+        + 2.0 * emiu * (4.0 * u * (2.0 - ii * u) * cos_w + ii * xi0 * (9.0 * u2 + w2 - ii * u * (3.0 * u2 + w2))),
+      2.0 * (1.0 + 2.0 * ii * u) * e2iu + emiu * (-2.0 * (1.0 - ii * u) * cos_w + ii * xi0 * (6.0 * u + ii * (w2 - 3.0 * u2))),
+      2.0 * ii * e2iu + ii * emiu * (cos_w - 3.0 * (1.0 - ii * u) * xi0),
+    };
+    const Complex r2[3] = {
+      -2.0 * e2iu + 2.0 * ii * u * emiu * (cos_w + (1.0 + 4.0 * ii * u) * xi0 + 3.0 * u2 * xi1),
+      -ii * emiu * (cos_w + (1.0 + 2.0 * ii * u) * xi0 - 3.0 * u2 * xi1),
+      emiu * (xi0 - 3.0 * ii * u * xi1),
+    };
+    const double fac2 = 0.5 * fac * fac;
+    for (int j = 0; j < 3; ++j) {
+      coefs.b1[j] = fac2 * (2.0 * u * r1[j] + (3.0 * u2 - w2) * r2[j] - 2.0 * (15.0 * u2 + w2) * coefs.f[j]);
+      coefs.b2[j] = fac2 * (r1[j] - 3.0 * u * r2[j] - 24.0 * u * coefs.f[j]);
+    }
+  }
+  if (is_negative) {
+    // f_j(-c0) = (-1)^j f_j(c0)^*
+    // b_ij(-c0) = (-1)^(i+j+1) b_ij(c0)^*
+    for (int j = 0; j < 3; ++j) {
+      const double sign = j % 2 == 0 ? 1.0 : -1.0;
+      coefs.f[j] = sign * std::conj(coefs.f[j]);
+      if (is_derivative) {
+        coefs.b1[j] = sign * std::conj(coefs.b1[j]);
+        coefs.b2[j] = -sign * std::conj(coefs.b2[j]);
+      }
+    }
+  }
+}
+
+inline ColorMatrixExpCoefs make_color_matrix_exp_coefs(const ColorMatrix& q, const ColorMatrix& q2,
+    const bool is_derivative = false)
+  // q is traceless hermitian, q2 = q * q
+{
+  qassert(3 == NUM_COLOR);
+  ColorMatrixExpCoefs coefs;
+  const double c1 = 0.5 * matrix_trace(q2).real();
+  const double c0 = matrix_trace(q2 * q).real() / 3.0;
+  set_color_matrix_exp_coefs(coefs, c0, c1, is_derivative);
+  return coefs;
+}
+
+inline ColorMatrix make_color_matrix_exp_from_coefs(const ColorMatrixExpCoefs& coefs,
+    const ColorMatrix& q, const ColorMatrix& q2)
+  // exp(i q)
+{
+  ColorMatrix ret = coefs.f[1] * q + coefs.f[2] * q2;
+  for (int i = 0; i < NUM_COLOR; ++i) {
+    ret(i,i) += coefs.f[0];
+  }
+  return ret;
+}
+
+inline ColorMatrix make_color_matrix_exp_cayley_hamilton(const ColorMatrix& a)
+  // exp(a) for traceless anti-hermitian a, exact up to rounding
+{
+  const ColorMatrix q = Complex(0.0, -1.0) * a;
+  const ColorMatrix q2 = q * q;
+  return make_color_matrix_exp_from_coefs(make_color_matrix_exp_coefs(q, q2), q, q2);
+}
+
+inline ColorMatrix make_color_matrix_exp_lambda(const ColorMatrixExpCoefs& coefs,
+    const ColorMatrix& q, const ColorMatrix& q2, const ColorMatrix& m)
+  // traceless hermitian Lambda with
+  // Re tr(m delta exp(i q)) = tr(Lambda delta q)
+  // for traceless hermitian delta q, coefs with derivatives
+  // for stout smearing m = U Sigma' (Morningstar & Peardon eq. (73))
+{
+  const Complex tr_m = matrix_trace(m);
+  const Complex tr_mq = matrix_trace(m * q);
+  const Complex tr_mq2 = matrix_trace(m * q2);
+  const Complex tr_b1 = coefs.b1[0] * tr_m + coefs.b1[1] * tr_mq + coefs.b1[2] * tr_mq2;
+  const Complex tr_b2 = coefs.b2[0] * tr_m + coefs.b2[1] * tr_mq + coefs.b2[2] * tr_mq2;
+  const ColorMatrix gamma = tr_b1 * q + tr_b2 * q2 + coefs.f[1] * m + coefs.f[2] * (q * m + m * q);
+  // traceless hermitian part of gamma
+  return Complex(0.0, -1.0) * make_tr_less_anti_herm_matrix(Complex(0.0, 1.0) * gamma);
+}
+
 struct WilsonMatrix : Matrix<4*NUM_COLOR>
 {
   WilsonMatrix()
@@ -5,6 +5,7 @@
 #include <qlat/utils-coordinate.h>
 
 #include <array>
+#include <cmath>
 
 #include <mpi.h> // have to add here other wise we would rely on timer.h to include <mpi.h> which is NOT glorious?
 
@@ -39,6 +40,9 @@ struct GeometryNode
   Coordinate size_node;
   Coordinate coor_node;
   // 0 <= coor_node[i] < size_node[i]
+  MPI_Comm comm;
+  // the Cartesian communicator of the node grid
+  // get_comm() at the time of init()
   //
   inline void init();
   //
@@ -57,7 +61,8 @@ inline bool operator==(const GeometryNode& geon1, const GeometryNode& geon2)
     && geon1.num_node == geon2.num_node
     && geon1.id_node == geon2.id_node
     && geon1.size_node == geon2.size_node
-    && geon1.coor_node == geon2.coor_node;
+    && geon1.coor_node == geon2.coor_node
+    && geon1.comm == geon2.comm;
 }
 
 inline bool operator!=(const GeometryNode& geon1, const GeometryNode& geon2)
@@ -88,6 +93,7 @@ inline void GeometryNode::init()
   if (initialized) {
     return;
   }
+  comm = get_comm();
 #ifdef USE_MULTI_NODE
   MPI_Comm_size(get_comm(), &num_node);
   MPI_Comm_rank(get_comm(), &id_node);
@@ -128,12 +134,26 @@ inline void init(GeometryNode& geon)
   geon.init();
 }
 
-inline const GeometryNode& get_geometry_node()
+inline const GeometryNode& get_qlat_geometry_node()
 {
   static GeometryNode geon(true);
   return geon;
 }
 
+inline const GeometryNode*& get_geometry_node_ptr()
+  // NULL means get_qlat_geometry_node()
+  // redirected together with get_comm_ptr() by CommSwitch
+{
+  static const GeometryNode* p_geon = NULL;
+  return p_geon;
+}
+
+inline const GeometryNode& get_geometry_node()
+{
+  const GeometryNode* p_geon = get_geometry_node_ptr();
+  return NULL == p_geon ? get_qlat_geometry_node() : *p_geon;
+}
+
 inline int get_num_node()
 {
   return get_geometry_node().num_node;
@@ -161,22 +181,26 @@ struct GeometryNodeNeighbor
   // dir = 0, 1 for Plus dir or Minus dir
   // 0 <= mu < 4 for different directions
   //
-  void init()
+  void init(const GeometryNode& geon)
   {
-    const Coordinate& coor_node = get_geometry_node().coor_node;
-    const Coordinate& size_node = get_geometry_node().size_node;
+    const Coordinate& coor_node = geon.coor_node;
+    const Coordinate& size_node = geon.size_node;
     for (int mu = 0; mu < DIMN; ++mu) {
       Coordinate coor;
       coor = coor_node;
       ++coor[mu];
       regularize_coordinate(coor, size_node);
-      dest[0][mu] = id_node_from_coor_node(coor);
+      dest[0][mu] = index_from_coordinate(coor, size_node);
       coor = coor_node;
       --coor[mu];
       regularize_coordinate(coor, size_node);
-      dest[1][mu] = id_node_from_coor_node(coor);
+      dest[1][mu] = index_from_coordinate(coor, size_node);
     }
   }
+  void init()
+  {
+    init(get_geometry_node());
+  }
   //
   GeometryNodeNeighbor()
   {
@@ -187,14 +211,31 @@ struct GeometryNodeNeighbor
       init();
     }
   }
+  GeometryNodeNeighbor(const GeometryNode& geon)
+  {
+    init(geon);
+  }
 };
 
-inline const GeometryNodeNeighbor& get_geometry_node_neighbor()
+inline const GeometryNodeNeighbor& get_qlat_geometry_node_neighbor()
 {
   static GeometryNodeNeighbor geonb(true);
   return geonb;
 }
 
+inline const GeometryNodeNeighbor*& get_geometry_node_neighbor_ptr()
+  // NULL means get_qlat_geometry_node_neighbor()
+{
+  static const GeometryNodeNeighbor* p_geonb = NULL;
+  return p_geonb;
+}
+
+inline const GeometryNodeNeighbor& get_geometry_node_neighbor()
+{
+  const GeometryNodeNeighbor* p_geonb = get_geometry_node_neighbor_ptr();
+  return NULL == p_geonb ? get_qlat_geometry_node_neighbor() : *p_geonb;
+}
+
 template <class M>
 inline std::vector<char> pad_flag_data(const int64_t flag, const M& data)
 {
@@ -277,7 +318,8 @@ int get_data_dir(Vector<M> recv, const Vector<M>& send, const int dir)
 }
 
 template <class M>
-int get_data_dir_mu(Vector<M> recv, const Vector<M>& send, const int dir, const int mu)
+int get_data_dir_mu(Vector<M> recv, const Vector<M>& send, const int dir, const int mu,
+    const GeometryNodeNeighbor& geonb, const MPI_Comm& comm)
   // dir = 0, 1 for Plus dir or Minus dir
   // 0 <= mu < 4 for different directions
 {
@@ -287,12 +329,11 @@ int get_data_dir_mu(Vector<M> recv, const Vector<M>& send, const int dir, const
   const long size = recv.size()*sizeof(M);
   timer.flops += size;
 #ifdef USE_MULTI_NODE
-  const GeometryNodeNeighbor& geonb = get_geometry_node_neighbor();
   const int idf = geonb.dest[dir][mu];
   const int idt = geonb.dest[1-dir][mu];
   MPI_Request req;
-  MPI_Isend((void*)send.data(), size, MPI_BYTE, idt, mpi_tag, get_comm(), &req);
-  const int ret = MPI_Recv(recv.data(), size, MPI_BYTE, idf, mpi_tag, get_comm(), MPI_STATUS_IGNORE);
+  MPI_Isend((void*)send.data(), size, MPI_BYTE, idt, mpi_tag, comm, &req);
+  const int ret = MPI_Recv(recv.data(), size, MPI_BYTE, idf, mpi_tag, comm, MPI_STATUS_IGNORE);
   MPI_Wait(&req, MPI_STATUS_IGNORE);
   return ret;
 #else
@@ -301,6 +342,19 @@ int get_data_dir_mu(Vector<M> recv, const Vector<M>& send, const int dir, const
 #endif
 }
 
+template <class M>
+int get_data_dir_mu(Vector<M> recv, const Vector<M>& send, const int dir, const int mu)
+{
+  return get_data_dir_mu(recv, send, dir, mu, get_geometry_node_neighbor(), get_comm());
+}
+
+template <class M>
+int get_data_plus_mu(Vector<M> recv, const Vector<M>& send, const int mu, const GeometryNode& geon)
+  // along the node grid of geon (which may not be get_geometry_node())
+{
+  return get_data_dir_mu(recv, send, 0, mu, GeometryNodeNeighbor(geon), geon.comm);
+}
+
 template <class M>
 int get_data_plus_mu(Vector<M> recv, const Vector<M>& send, const int mu)
 {
@@ -313,17 +367,193 @@ int get_data_minus_mu(Vector<M> recv, const Vector<M>& send, const int mu)
   return get_data_dir_mu(recv, send, 1, mu);
 }
 
-inline int glb_sum(Vector<double> recv, const Vector<double>& send)
+inline bool& glb_sum_reproducible()
+  // If true, glb_sum of doubles (and field_glb_sum_double) sum exactly with
+  // ExactDoubleSum, so the result does not depend on the node and thread
+  // layout. Each double then costs 67 longs in the allreduce.
+  // glb_sum(double&) can only make the sum over nodes exact; the local sums
+  // passed to it are still the responsibility of the caller.
+{
+  static bool b = false;
+  return b;
+}
+
+struct ExactDoubleSum
+  // Exact sum of doubles in fixed point: limbs[k] holds the bits from
+  // 2^(32k-1074) to 2^(32k-1043). The rounded result is independent of the
+  // order of additions.
+{
+  static const int num_limb = 66;
+  static const long limb_mask = 0xFFFFFFFFL;
+  long num_add;
+  // additions since the last normalize
+  long limbs[num_limb];
+  //
+  void init()
+  {
+    num_add = 0;
+    std::memset(limbs, 0, sizeof(limbs));
+  }
+  //
+  ExactDoubleSum()
+  {
+    init();
+  }
+  //
+  void normalize()
+    // after this limbs[k] is in [0, 2^32) for k < num_limb - 1
+  {
+    for (int k = 0; k < num_limb - 1; ++k) {
+      const long low = limbs[k] & limb_mask;
+      limbs[k + 1] += (limbs[k] - low) / (limb_mask + 1);
+      limbs[k] = low;
+    }
+    num_add = 0;
+  }
+  //
+  void add(const double x)
+  {
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(double));
+    const int exponent = (bits >> 52) & 0x7FF;
+    qassert(exponent != 0x7FF);
+    uint64_t mantissa = bits & 0xFFFFFFFFFFFFFUL;
+    int pos = 0;
+    // x = mantissa * 2^(pos-1074)
+    if (0 != exponent) {
+      mantissa |= 0x10000000000000UL;
+      pos = exponent - 1;
+    } else if (0 == mantissa) {
+      return;
+    }
+    const long sign = (bits >> 63) ? -1 : 1;
+    const int k = pos / 32;
+    const int s = pos % 32;
+    const uint64_t lo = (mantissa & limb_mask) << s;
+    const uint64_t hi = ((mantissa >> 32) << s) + (lo >> 32);
+    limbs[k] += sign * (long)(lo & limb_mask);
+    limbs[k + 1] += sign * (long)(hi & limb_mask);
+    limbs[k + 2] += sign * (long)(hi >> 32);
+    num_add += 1;
+    if (num_add >= (1L << 30)) {
+      normalize();
+    }
+  }
+  //
+  void add(const ExactDoubleSum& x)
+  {
+    for (int k = 0; k < num_limb; ++k) {
+      limbs[k] += x.limbs[k];
+    }
+    num_add += x.num_add + 1;
+    if (num_add >= (1L << 30)) {
+      normalize();
+    }
+  }
+  //
+  double get() const
+    // correctly rounded to double (up to double rounding for subnormals)
+  {
+    ExactDoubleSum x = *this;
+    x.normalize();
+    const bool is_negative = x.limbs[num_limb - 1] < 0;
+    if (is_negative) {
+      for (int k = 0; k < num_limb; ++k) {
+        x.limbs[k] = -x.limbs[k];
+      }
+      x.normalize();
+    }
+    int t = num_limb - 1;
+    while (t >= 0 && 0 == x.limbs[t]) {
+      t -= 1;
+    }
+    if (t < 0) {
+      return 0.0;
+    }
+    // the leading 64 bits with a sticky bit for the rest
+    const uint64_t a = x.limbs[t];
+    qassert(a <= (uint64_t)limb_mask);
+    const uint64_t b = t >= 1 ? x.limbs[t - 1] : 0;
+    const uint64_t c = t >= 2 ? x.limbs[t - 2] : 0;
+    int la = 0;
+    while ((a >> la) > 0) {
+      la += 1;
+    }
+    uint64_t m = (a << (64 - la)) | (b << (32 - la)) | (c >> la);
+    bool is_sticky = 0 != (c & ((1UL << la) - 1));
+    for (int k = 0; k < t - 2; ++k) {
+      is_sticky = is_sticky || 0 != x.limbs[k];
+    }
+    if (is_sticky) {
+      m |= 1;
+    }
+    const double ret = std::ldexp((double)m, 32 * (t - 2) + la - 1074);
+    return is_negative ? -ret : ret;
+  }
+};
+
+inline int glb_sum(Vector<ExactDoubleSum> xs, const MPI_Comm& comm)
+{
+  for (long i = 0; i < xs.size(); ++i) {
+    xs[i].normalize();
+  }
+#ifdef USE_MULTI_NODE
+  const int ret = MPI_Allreduce(MPI_IN_PLACE, (long*)xs.data(),
+      xs.data_size() / sizeof(long), MPI_LONG, MPI_SUM, comm);
+#else
+  const int ret = 0;
+#endif
+  for (long i = 0; i < xs.size(); ++i) {
+    xs[i].normalize();
+  }
+  return ret;
+}
+
+inline int glb_sum(Vector<ExactDoubleSum> xs)
+{
+  return glb_sum(xs, get_comm());
+}
+
+inline int glb_sum_exact(Vector<double> recv, const Vector<double>& send, const MPI_Comm& comm)
+{
+  qassert(recv.size() == send.size());
+  std::vector<ExactDoubleSum> xs(send.size());
+  for (long i = 0; i < send.size(); ++i) {
+    xs[i].add(send[i]);
+  }
+  const int ret = glb_sum(get_data(xs), comm);
+  for (long i = 0; i < recv.size(); ++i) {
+    recv[i] = xs[i].get();
+  }
+  return ret;
+}
+
+inline int glb_sum(Vector<double> recv, const Vector<double>& send, const MPI_Comm& comm)
 {
   qassert(recv.size() == send.size());
+  if (glb_sum_reproducible()) {
+    return glb_sum_exact(recv, send, comm);
+  }
 #ifdef USE_MULTI_NODE
-  return MPI_Allreduce((double*)send.data(), recv.data(), recv.size(), MPI_DOUBLE, MPI_SUM, get_comm());
+  return MPI_Allreduce((double*)send.data(), recv.data(), recv.size(), MPI_DOUBLE, MPI_SUM, comm);
 #else
   memmove(recv.data(), send.data(), recv.size()* sizeof(double));
   return 0;
 #endif
 }
 
+inline int glb_sum(Vector<double> recv, const Vector<double>& send)
+{
+  return glb_sum(recv, send, get_comm());
+}
+
+inline int glb_sum(Vector<Complex> recv, const Vector<Complex>& send, const MPI_Comm& comm)
+{
+  return glb_sum(
+      Vector<double>((double*)recv.data(), recv.size() * 2),
+      Vector<double>((double*)send.data(), send.size() * 2), comm);
+}
+
 inline int glb_sum(Vector<Complex> recv, const Vector<Complex>& send)
 {
   return glb_sum(
@@ -331,17 +561,22 @@ inline int glb_sum(Vector<Complex> recv, const Vector<Complex>& send)
       Vector<double>((double*)send.data(), send.size() * 2));
 }
 
-inline int glb_sum(Vector<long> recv, const Vector<long>& send)
+inline int glb_sum(Vector<long> recv, const Vector<long>& send, const MPI_Comm& comm)
 {
   qassert(recv.size() == send.size());
 #ifdef USE_MULTI_NODE
-  return MPI_Allreduce((long*)send.data(), recv.data(), recv.size(), MPI_LONG, MPI_SUM, get_comm());
+  return MPI_Allreduce((long*)send.data(), recv.data(), recv.size(), MPI_LONG, MPI_SUM, comm);
 #else
   memmove(recv.data(), send.data(), recv.size()* sizeof(long));
   return 0;
 #endif
 }
 
+inline int glb_sum(Vector<long> recv, const Vector<long>& send)
+{
+  return glb_sum(recv, send, get_comm());
+}
+
 inline int glb_sum(Vector<char> recv, const Vector<char>& send)
 {
   qassert(recv.size() == send.size());
@@ -353,6 +588,20 @@ inline int glb_sum(Vector<char> recv, const Vector<char>& send)
 #endif
 }
 
+inline int glb_sum(Vector<double> vec, const MPI_Comm& comm)
+{
+  std::vector<double> tmp(vec.size());
+  assign(tmp, vec);
+  return glb_sum(vec, tmp, comm);
+}
+
+inline int glb_sum(Vector<Complex> vec, const MPI_Comm& comm)
+{
+  std::vector<Complex> tmp(vec.size());
+  assign(tmp, vec);
+  return glb_sum(vec, tmp, comm);
+}
+
 inline int glb_sum(Vector<double> vec)
 {
   std::vector<double> tmp(vec.size());
@@ -381,6 +630,16 @@ inline int glb_sum(Vector<char> vec)
   return glb_sum(vec, tmp);
 }
 
+inline int glb_sum(double& x, const MPI_Comm& comm)
+{
+  return glb_sum(Vector<double>(x), comm);
+}
+
+inline int glb_sum(Complex& c, const MPI_Comm& comm)
+{
+  return glb_sum(Vector<Complex>(c), comm);
+}
+
 inline int glb_sum(double& x)
 {
   return glb_sum(Vector<double>(x));
@@ -408,12 +667,30 @@ inline int glb_sum_double_vec(Vector<M> x)
   return glb_sum(Vector<double>((double*)x.data(), x.data_size()/sizeof(double)));
 }
 
+template <class M>
+inline int glb_sum_double_vec(Vector<M> x, const MPI_Comm& comm)
+{
+  std::vector<double> tmp(x.data_size()/sizeof(double));
+  Vector<double> vec((double*)x.data(), tmp.size());
+  assign(tmp, vec);
+  return glb_sum(vec, get_data(tmp), comm);
+}
+
 template <class M>
 inline int glb_sum_long_vec(Vector<M> x)
 {
   return glb_sum(Vector<long>((long*)x.data(), x.data_size()/sizeof(long)));
 }
 
+template <class M>
+inline int glb_sum_long_vec(Vector<M> x, const MPI_Comm& comm)
+{
+  std::vector<long> tmp(x.data_size()/sizeof(long));
+  Vector<long> vec((long*)x.data(), tmp.size());
+  assign(tmp, vec);
+  return glb_sum(vec, get_data(tmp), comm);
+}
+
 template <class M>
 inline int glb_sum_byte_vec(Vector<M> x)
 {
@@ -438,6 +715,405 @@ inline int glb_sum_byte(M& x)
   return glb_sum(Vector<char>((char*)&x, sizeof(M)));
 }
 
+inline int glb_max(double& x, const MPI_Comm& comm)
+{
+#ifdef USE_MULTI_NODE
+  return MPI_Allreduce(MPI_IN_PLACE, &x, 1, MPI_DOUBLE, MPI_MAX, comm);
+#else
+  return 0;
+#endif
+}
+
+inline int glb_max(double& x)
+{
+  return glb_max(x, get_comm());
+}
+
+struct CommDir
+  // the nodes of geon with the same coor_node except along mu
+  // ranked by coor_node[mu]
+{
+  MPI_Comm comm;
+  //
+  CommDir(const GeometryNode& geon, const int mu)
+  {
+    Coordinate coor = geon.coor_node;
+    coor[mu] = 0;
+#ifdef USE_MULTI_NODE
+    MPI_Comm_split(geon.comm, index_from_coordinate(coor, geon.size_node), geon.coor_node[mu], &comm);
+#else
+    comm = geon.comm;
+#endif
+  }
+  //
+  ~CommDir()
+  {
+#ifdef USE_MULTI_NODE
+    MPI_Comm_free(&comm);
+#endif
+  }
+  //
+private:
+  CommDir(const CommDir&);
+  const CommDir& operator=(const CommDir&);
+};
+
+#ifdef USE_MULTI_NODE
+
+template <class M>
+void glb_product_op(void* in, void* inout, int* len, MPI_Datatype* dtype)
+  // inout = in * inout, in is from the lower ranks
+{
+  const M* pin = (const M*)in;
+  M* pinout = (M*)inout;
+  for (int k = 0; k < *len; ++k) {
+    pinout[k] = pin[k] * pinout[k];
+  }
+}
+
+template <class M>
+MPI_Op get_glb_product_op()
+{
+  static MPI_Op op = MPI_OP_NULL;
+  if (MPI_OP_NULL == op) {
+    MPI_Op_create(glb_product_op<M>, 0, &op);
+  }
+  return op;
+}
+
+template <class M>
+MPI_Datatype get_mpi_type_bytes()
+  // sizeof(M) contiguous bytes
+{
+  static MPI_Datatype dtype = MPI_DATATYPE_NULL;
+  if (MPI_DATATYPE_NULL == dtype) {
+    MPI_Type_contiguous(sizeof(M), MPI_BYTE, &dtype);
+    MPI_Type_commit(&dtype);
+  }
+  return dtype;
+}
+
+#endif
+
+template <class M>
+int glb_product_scan(Vector<M> excl, Vector<M> total, const Vector<M>& local, const MPI_Comm& comm)
+  // ordered products over the ranks of comm, element by element, O(log size)
+  // excl = local(0) * ... * local(rank - 1), undefined on rank 0
+  // total = local(0) * ... * local(size - 1)
+{
+  TIMER("glb_product_scan");
+  qassert(excl.size() == local.size());
+  qassert(total.size() == local.size());
+#ifdef USE_MULTI_NODE
+  MPI_Exscan((void*)local.data(), excl.data(), local.size(), get_mpi_type_bytes<M>(), get_glb_product_op<M>(), comm);
+  return MPI_Allreduce((void*)local.data(), total.data(), local.size(), get_mpi_type_bytes<M>(), get_glb_product_op<M>(), comm);
+#else
+  memcpy(total.data(), local.data(), local.data_size());
+  return 0;
+#endif
+}
+
+#ifdef USE_MULTI_NODE
+
+inline void glb_sum_batch_op(void* in, void* inout, int* len, MPI_Datatype* dtype)
+  // Each element is a whole GlbSumBatch buffer:
+  // n_double, n_long, doubles, longs (8 bytes each)
+{
+  int size;
+  MPI_Type_size(*dtype, &size);
+  for (int k = 0; k < *len; ++k) {
+    const long* pin = (const long*)((const char*)in + (long)k * size);
+    long* pinout = (long*)((char*)inout + (long)k * size);
+    const long n_double = pin[0];
+    const long n_long = pin[1];
+    const double* din = (const double*)(pin + 2);
+    double* dinout = (double*)(pinout + 2);
+    for (long i = 0; i < n_double; ++i) {
+      dinout[i] += din[i];
+    }
+    const long* lin = pin + 2 + n_double;
+    long* linout = pinout + 2 + n_double;
+    for (long i = 0; i < n_long; ++i) {
+      linout[i] += lin[i];
+    }
+  }
+}
+
+inline MPI_Op get_glb_sum_batch_op()
+{
+  static MPI_Op op = MPI_OP_NULL;
+  if (MPI_OP_NULL == op) {
+    MPI_Op_create(glb_sum_batch_op, 1, &op);
+  }
+  return op;
+}
+
+#endif
+
+struct GlbSumBatch;
+
+template <class M>
+struct GlbSumFuture
+  // M = double, Complex or long
+  // The result of one GlbSumBatch::add. get() waits for the batch.
+{
+  GlbSumBatch* p_batch;
+  bool is_long;
+  long offset;
+  // in units of 8 bytes, within the doubles or the longs of the batch
+  long size;
+  //
+  GlbSumFuture()
+  {
+    p_batch = NULL;
+    is_long = false;
+    offset = 0;
+    size = 0;
+  }
+  //
+  bool is_ready() const;
+  //
+  M get(const long i = 0) const;
+  //
+  std::vector<M> get_vec() const;
+};
+
+struct GlbSumBatch
+  // Collect several glb_sum and perform them with one MPI_Iallreduce.
+  //
+  //   GlbSumBatch gsb;
+  //   const GlbSumFuture<double> f1 = gsb.add(local_sum);
+  //   const GlbSumFuture<long> f2 = gsb.add(local_count);
+  //   gsb.start();
+  //   // other computation
+  //   const double sum = f1.get();
+  //
+  // Uses get_comm() at construction. Futures keep a pointer to the batch,
+  // so the batch must not be moved or destroyed before they are used.
+{
+  std::vector<double> doubles;
+  std::vector<long> longs;
+  std::vector<long> send;
+  std::vector<long> recv;
+  // n_double, n_long, doubles (bit copies), longs
+  bool is_started;
+  bool is_finished;
+  bool is_exact;
+  // glb_sum_reproducible() at start: doubles are sent as ExactDoubleSum
+#ifdef USE_MULTI_NODE
+  MPI_Comm comm;
+  MPI_Datatype dtype;
+  MPI_Request req;
+#endif
+  //
+  void init()
+  {
+    qassert(!is_started || is_finished);
+    doubles.clear();
+    longs.clear();
+    send.clear();
+    recv.clear();
+    is_started = false;
+    is_finished = false;
+    is_exact = false;
+  }
+  //
+  GlbSumBatch()
+  {
+    is_started = false;
+    is_finished = false;
+    is_exact = false;
+#ifdef USE_MULTI_NODE
+    comm = get_comm();
+#endif
+  }
+  //
+  ~GlbSumBatch()
+  {
+    if (is_started && !is_finished) {
+      wait();
+    }
+  }
+  //
+  GlbSumFuture<double> add(const Vector<double>& x)
+  {
+    qassert(!is_started);
+    GlbSumFuture<double> f;
+    f.p_batch = this;
+    f.is_long = false;
+    f.offset = doubles.size();
+    f.size = x.size();
+    doubles.insert(doubles.end(), x.data(), x.data() + x.size());
+    return f;
+  }
+  GlbSumFuture<double> add(const double x)
+  {
+    return add(Vector<double>(&x, 1));
+  }
+  //
+  GlbSumFuture<Complex> add(const Vector<Complex>& x)
+  {
+    const GlbSumFuture<double> fd = add(Vector<double>((const double*)x.data(), x.size() * 2));
+    GlbSumFuture<Complex> f;
+    f.p_batch = this;
+    f.is_long = false;
+    f.offset = fd.offset;
+    f.size = x.size();
+    return f;
+  }
+  GlbSumFuture<Complex> add(const Complex& x)
+  {
+    return add(Vector<Complex>(&x, 1));
+  }
+  //
+  GlbSumFuture<long> add(const Vector<long>& x)
+  {
+    qassert(!is_started);
+    GlbSumFuture<long> f;
+    f.p_batch = this;
+    f.is_long = true;
+    f.offset = longs.size();
+    f.size = x.size();
+    longs.insert(longs.end(), x.data(), x.data() + x.size());
+    return f;
+  }
+  GlbSumFuture<long> add(const long x)
+  {
+    return add(Vector<long>(&x, 1));
+  }
+  //
+  void start()
+  {
+    TIMER("GlbSumBatch::start");
+    qassert(!is_started);
+    is_started = true;
+    is_exact = glb_sum_reproducible();
+    const long n_double = doubles.size();
+    const long n_long = longs.size();
+    if (is_exact) {
+      // everything is summed as longs
+      const long n_limb = sizeof(ExactDoubleSum) / sizeof(long);
+      send.resize(2 + n_long + n_double * n_limb);
+      send[0] = 0;
+      send[1] = n_long + n_double * n_limb;
+      std::memcpy(&send[2], longs.data(), n_long * sizeof(long));
+      for (long i = 0; i < n_double; ++i) {
+        ExactDoubleSum x;
+        x.add(doubles[i]);
+        x.normalize();
+        std::memcpy(&send[2 + n_long + i * n_limb], &x, sizeof(ExactDoubleSum));
+      }
+    } else {
+      send.resize(2 + n_double + n_long);
+      send[0] = n_double;
+      send[1] = n_long;
+      std::memcpy(&send[2], doubles.data(), n_double * sizeof(double));
+      std::memcpy(&send[2 + n_double], longs.data(), n_long * sizeof(long));
+    }
+    recv.resize(send.size());
+#ifdef USE_MULTI_NODE
+    // one element holding the whole buffer, so that the reduction is never
+    // split in the middle of the layout
+    MPI_Type_contiguous(send.size() * sizeof(long), MPI_BYTE, &dtype);
+    MPI_Type_commit(&dtype);
+    MPI_Iallreduce(send.data(), recv.data(), 1, dtype, get_glb_sum_batch_op(), comm, &req);
+#else
+    recv = send;
+    finish();
+#endif
+  }
+  //
+  void finish()
+    // bring recv to the plain layout: n_double, n_long, doubles, longs
+  {
+    is_finished = true;
+    if (is_exact) {
+      const long n_limb = sizeof(ExactDoubleSum) / sizeof(long);
+      const long n_double = doubles.size();
+      const long n_long = longs.size();
+      std::vector<long> plain(2 + n_double + n_long);
+      plain[0] = n_double;
+      plain[1] = n_long;
+      for (long i = 0; i < n_double; ++i) {
+        ExactDoubleSum x;
+        std::memcpy((void*)&x, &recv[2 + n_long + i * n_limb], sizeof(ExactDoubleSum));
+        x.normalize();
+        const double v = x.get();
+        std::memcpy(&plain[2 + i], &v, sizeof(double));
+      }
+      std::memcpy(&plain[2 + n_double], &recv[2], n_long * sizeof(long));
+      recv.swap(plain);
+    }
+  }
+  //
+  bool test()
+    // return true if the result is available
+  {
+    if (!is_started) {
+      return false;
+    }
+#ifdef USE_MULTI_NODE
+    if (!is_finished) {
+      int flag;
+      MPI_Test(&req, &flag, MPI_STATUS_IGNORE);
+      if (flag) {
+        MPI_Type_free(&dtype);
+        finish();
+      }
+    }
+#endif
+    return is_finished;
+  }
+  //
+  void wait()
+    // start the reduction if it is not started yet
+  {
+    if (!is_started) {
+      start();
+    }
+#ifdef USE_MULTI_NODE
+    if (!is_finished) {
+      TIMER("GlbSumBatch::wait");
+      MPI_Wait(&req, MPI_STATUS_IGNORE);
+      MPI_Type_free(&dtype);
+      finish();
+    }
+#endif
+  }
+  //
+  const long* result_data(const bool is_long, const long offset)
+  {
+    wait();
+    return &recv[2 + (is_long ? doubles.size() : 0) + offset];
+  }
+};
+
+template <class M>
+bool GlbSumFuture<M>::is_ready() const
+{
+  qassert(NULL != p_batch);
+  return p_batch->test();
+}
+
+template <class M>
+M GlbSumFuture<M>::get(const long i) const
+{
+  qassert(NULL != p_batch);
+  qassert(0 <= i && i < size);
+  M x;
+  std::memcpy((void*)&x, p_batch->result_data(is_long, offset) + i * (sizeof(M) / sizeof(long)), sizeof(M));
+  return x;
+}
+
+template <class M>
+std::vector<M> GlbSumFuture<M>::get_vec() const
+{
+  qassert(NULL != p_batch);
+  std::vector<M> vec(size);
+  std::memcpy(vec.data(), p_batch->result_data(is_long, offset), size * sizeof(M));
+  return vec;
+}
+
 template <class M>
 void all_gather(Vector<M> recv, const Vector<M>& send)
 {
@@ -521,10 +1197,16 @@ inline void bcast(std::vector<std::vector<M> >& datatable, const int root = 0)
 #endif
 }
 
-inline void sync_node()
+inline void sync_node(const MPI_Comm& comm)
 {
   long v = 1;
-  glb_sum(Vector<long>(&v,1));
+  long ret;
+  glb_sum(Vector<long>(&ret,1), Vector<long>(&v,1), comm);
+}
+
+inline void sync_node()
+{
+  sync_node(get_comm());
 }
 
 inline void display_geometry_node()
@@ -613,6 +1295,95 @@ inline void begin(int* argc, char** argv[])
   begin(MPI_COMM_WORLD, plan_size_node(num_node));
 }
 
+struct NodeGroup
+  // A Cartesian sub-communicator of get_comm() with its own node geometry.
+  // Ranks with id_group == -1 are not in any group (e.g. the task farm master).
+{
+  bool initialized;
+  int num_group;
+  int id_group;
+  MPI_Comm comm;
+  GeometryNode geon;
+  GeometryNodeNeighbor geonb;
+  //
+  NodeGroup()
+  {
+    initialized = false;
+    num_group = 0;
+    id_group = -1;
+  }
+  //
+  bool is_member() const
+  {
+    return initialized && id_group >= 0;
+  }
+};
+
+struct CommSwitch
+  // Redirect get_comm(), get_geometry_node() and get_geometry_node_neighbor()
+  // to the group for the lifetime of this object.
+  // Geometry::init, refresh_expanded, fft_complex_field, glb_sum, etc. called
+  // in between act on the group only.
+{
+  MPI_Comm* p_comm;
+  const GeometryNode* p_geon;
+  const GeometryNodeNeighbor* p_geonb;
+  //
+  CommSwitch(NodeGroup& ng)
+  {
+    qassert(ng.is_member());
+    p_comm = get_comm_ptr();
+    p_geon = get_geometry_node_ptr();
+    p_geonb = get_geometry_node_neighbor_ptr();
+    get_comm_ptr() = &ng.comm;
+    get_geometry_node_ptr() = &ng.geon;
+    get_geometry_node_neighbor_ptr() = &ng.geonb;
+  }
+  //
+  ~CommSwitch()
+  {
+    get_comm_ptr() = p_comm;
+    get_geometry_node_ptr() = p_geon;
+    get_geometry_node_neighbor_ptr() = p_geonb;
+  }
+};
+
+inline void init_node_group(NodeGroup& ng, const Coordinate& size_node_group, const int num_node_reserved = 0)
+  // Split get_comm() into groups of product(size_node_group) nodes.
+  // The first num_node_reserved nodes are left out of all groups, as are the
+  // remaining nodes which cannot form a complete group.
+  // Collective over get_comm().
+{
+  TIMER_VERBOSE("init_node_group");
+  const int num_node_group = product(size_node_group);
+  qassert(num_node_group > 0);
+  const int num_node = get_num_node();
+  const int id_node = get_id_node();
+  ng.num_group = (num_node - num_node_reserved) / num_node_group;
+  qassert(ng.num_group > 0);
+  ng.id_group = -1;
+  if (id_node >= num_node_reserved && id_node < num_node_reserved + ng.num_group * num_node_group) {
+    ng.id_group = (id_node - num_node_reserved) / num_node_group;
+  }
+#ifdef USE_MULTI_NODE
+  MPI_Comm comm_split;
+  MPI_Comm_split(get_comm(), ng.id_group >= 0 ? ng.id_group : MPI_UNDEFINED, id_node, &comm_split);
+  if (ng.id_group >= 0) {
+    const Coordinate periods(1, 1, 1, 1);
+    MPI_Cart_create(comm_split, DIMN, (int*)size_node_group.data(), (int*)periods.data(), 0, &ng.comm);
+    MPI_Comm_free(&comm_split);
+  }
+#endif
+  ng.initialized = true;
+  if (ng.is_member()) {
+    CommSwitch cs(ng);
+    ng.geon = GeometryNode(true);
+    ng.geonb = GeometryNodeNeighbor(true);
+  }
+  displayln_info(ssprintf("%s: num_group = %d ; size_node_group = %s ; num_node_reserved = %d",
+        fname, ng.num_group, show(size_node_group).c_str(), num_node_reserved));
+}
+
 inline void end()
 {
   if(is_MPI_initialized()) MPI_Finalize();
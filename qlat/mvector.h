@@ -139,7 +139,7 @@ struct WilsonVector: Mvector<4*NUM_COLOR>
     *this = m;
   }
   //
-  const WilsonVector& operator=(const Mvector<NUM_COLOR>& m)
+  const WilsonVector& operator=(const Mvector<4*NUM_COLOR>& m)
   {
     *this = (const WilsonVector&)m;
     return *this;
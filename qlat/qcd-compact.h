@@ -0,0 +1,293 @@
+#pragma once
+
+#include <qlat/matrix.h>
+#include <qlat/qcd.h>
+#include <qlat/qcd-utils.h>
+#include <qlat/qcd-smear.h>
+
+QLAT_START_NAMESPACE
+
+// Compact storage of SU(3) links, reconstructed to ColorMatrix (double)
+// inside the kernels:
+//
+//   ColorMatrix12  first two rows, 12 doubles (1.5x less memory traffic)
+//   ColorMatrix8   8 doubles (Clark et al, arXiv:0911.3191) (2.25x)
+//   ColorMatrixSF  18 floats, arithmetic in double (2x)
+//
+// set_color_matrix_compact(c, m) stores and make_color_matrix(c) reconstructs.
+// ColorMatrix12 and ColorMatrix8 are only valid for SU(3) links.
+
+struct ColorMatrix12
+{
+  double p[12];
+};
+
+struct ColorMatrix8
+{
+  double p[8];
+};
+
+struct ColorMatrixSF
+{
+  float p[18];
+};
+
+inline void set_color_matrix_compact(ColorMatrix& c, const ColorMatrix& m)
+{
+  c = m;
+}
+
+inline ColorMatrix make_color_matrix(const ColorMatrix& c)
+{
+  return c;
+}
+
+inline void set_color_matrix_compact(ColorMatrix12& c, const ColorMatrix& m)
+{
+  qassert(3 == NUM_COLOR);
+  const double* d = m.d();
+  for (int i = 0; i < 12; ++i) {
+    c.p[i] = d[i];
+  }
+}
+
+inline ColorMatrix make_color_matrix(const ColorMatrix12& c)
+  // the third row is the complex conjugate of the cross product of the first two
+{
+  ColorMatrix m;
+  double* d = m.d();
+  for (int i = 0; i < 12; ++i) {
+    d[i] = c.p[i];
+  }
+  for (int j = 0; j < 3; ++j) {
+    const int j1 = (j + 1) % 3;
+    const int j2 = (j + 2) % 3;
+    m(2,j) = std::conj(m(0,j1) * m(1,j2) - m(0,j2) * m(1,j1));
+  }
+  return m;
+}
+
+inline void set_color_matrix_compact(ColorMatrix8& c, const ColorMatrix& m)
+  // with v(i,j) = m(i,(j+1)%3) (so that the unit matrix is not singular)
+  // store v(0,1), v(0,2), arg v(0,0), arg v(2,0), v(1,0)
+{
+  qassert(3 == NUM_COLOR);
+  c.p[0] = m(0,2).real();
+  c.p[1] = m(0,2).imag();
+  c.p[2] = m(0,0).real();
+  c.p[3] = m(0,0).imag();
+  c.p[4] = std::arg(m(0,1));
+  c.p[5] = std::arg(m(2,1));
+  c.p[6] = m(1,1).real();
+  c.p[7] = m(1,1).imag();
+}
+
+inline ColorMatrix make_color_matrix(const ColorMatrix8& c)
+  // the moduli of v(0,0) and v(2,0) from the normalization of the first row
+  // and column, the rest from the cofactors of SU(3) and the orthogonality of
+  // the rows ; loses precision when |m(0,1)| is close to 1
+{
+  const Complex a1(c.p[0], c.p[1]);
+  const Complex a2(c.p[2], c.p[3]);
+  const Complex b0(c.p[6], c.p[7]);
+  const double n = std::norm(a1) + std::norm(a2);
+  const Complex a0 = std::polar(std::sqrt(std::max(0.0, 1.0 - n)), c.p[4]);
+  const Complex c0 = std::polar(std::sqrt(std::max(0.0, n - std::norm(b0))), c.p[5]);
+  const double n_inv = 1.0 / n;
+  const Complex a0b0 = std::conj(a0) * b0;
+  const Complex a0c0 = std::conj(a0) * c0;
+  ColorMatrix m;
+  m(0,1) = a0;
+  m(0,2) = a1;
+  m(0,0) = a2;
+  m(1,1) = b0;
+  m(2,1) = c0;
+  m(1,2) = -(std::conj(c0) * std::conj(a2) + a1 * a0b0) * n_inv;
+  m(1,0) = (std::conj(a1) * std::conj(c0) - a2 * a0b0) * n_inv;
+  m(2,2) = (std::conj(b0) * std::conj(a2) - a1 * a0c0) * n_inv;
+  m(2,0) = -(a2 * a0c0 + std::conj(a1) * std::conj(b0)) * n_inv;
+  return m;
+}
+
+inline void set_color_matrix_compact(ColorMatrixSF& c, const ColorMatrix& m)
+{
+  const double* d = m.d();
+  for (int i = 0; i < 18; ++i) {
+    c.p[i] = d[i];
+  }
+}
+
+inline ColorMatrix make_color_matrix(const ColorMatrixSF& c)
+{
+  ColorMatrix m;
+  double* d = m.d();
+  for (int i = 0; i < 18; ++i) {
+    d[i] = c.p[i];
+  }
+  return m;
+}
+
+template <class C>
+struct GaugeFieldCompact : FieldM<C,4>
+{
+  virtual const std::string& cname()
+  {
+    static const std::string s = "GaugeFieldCompact";
+    return s;
+  }
+};
+
+template <class C>
+inline void set_gauge_field_compact(GaugeFieldCompact<C>& cgf, const GaugeField& gf)
+{
+  TIMER("set_gauge_field_compact");
+  const Geometry geo = geo_resize(gf.geo);
+  cgf.init(geo);
+  qassert(is_matching_geo_mult(cgf.geo, geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const Vector<ColorMatrix> v = gf.get_elems_const(xl);
+    Vector<C> vc = cgf.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      set_color_matrix_compact(vc[mu], v[mu]);
+    }
+  }
+}
+
+template <class C>
+inline void set_gauge_field(GaugeField& gf, const GaugeFieldCompact<C>& cgf)
+{
+  TIMER("set_gauge_field");
+  const Geometry geo = geo_resize(cgf.geo);
+  gf.init(geo);
+  qassert(is_matching_geo_mult(gf.geo, geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> v = gf.get_elems(xl);
+    const Vector<C> vc = cgf.get_elems_const(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      v[mu] = make_color_matrix(vc[mu]);
+    }
+  }
+}
+
+template <class C>
+inline ColorMatrix gf_get_link(const FieldM<C,4>& gf, const Coordinate& xl, const int mu)
+  // the accessor of the kernels, C can be ColorMatrix
+{
+  return make_color_matrix(gf.get_elem(xl, mu));
+}
+
+template <class C>
+inline double gf_local_sum_plaq_no_comm(const GaugeFieldCompact<C>& gf)
+  // see gf_local_sum_plaq_no_comm(const GaugeField&)
+{
+  TIMER("gf_local_sum_plaq_no_comm(compact)");
+  const Geometry& geo = gf.geo;
+  std::vector<double> sums(omp_get_max_threads(), 0.0);
+#pragma omp parallel
+  {
+    double sum_avg_plaq = 0.0;
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      Coordinate xl = geo.coordinate_from_index(index);
+      std::array<ColorMatrix,DIMN> v;
+      for (int m = 0; m < DIMN; ++m) {
+        v[m] = gf_get_link(gf, xl, m);
+      }
+      double avg_plaq = 0.0;
+      for (int m1 = 1; m1 < DIMN; ++m1) {
+        for (int m2 = 0; m2 < m1; ++m2) {
+          const ColorMatrix cm = v[m1] * gf_get_link(gf, coordinate_shifts(xl, m1), m2) *
+            matrix_adjoint(v[m2] * gf_get_link(gf, coordinate_shifts(xl, m2), m1));
+          avg_plaq += matrix_trace(cm).real() / NUM_COLOR;
+        }
+      }
+      avg_plaq /= DIMN * (DIMN-1) / 2;
+      sum_avg_plaq += avg_plaq;
+    }
+    sums[omp_get_thread_num()] = sum_avg_plaq;
+  }
+  double sum = 0.0;
+  for (size_t i = 0; i < sums.size(); ++i) {
+    sum += sums[i];
+  }
+  return sum;
+}
+
+template <class C>
+inline double gf_avg_plaq(const GaugeFieldCompact<C>& gf)
+{
+  TIMER("gf_avg_plaq(compact)");
+  GaugeFieldCompact<C> gf1;
+  gf1.init(geo_resize(gf.geo, Coordinate(0,0,0,0), Coordinate(1,1,1,1)));
+  gf1 = gf;
+  refresh_expanded(gf1);
+  double sum = gf_local_sum_plaq_no_comm(gf1);
+  glb_sum(sum, gf.geo.geon.comm);
+  return sum / gf.geo.total_volume();
+}
+
+template <class C>
+inline ColorMatrix gf_staple_no_comm(const GaugeFieldCompact<C>& gf, const Coordinate& xl, const int mu)
+  // see gf_staple_no_comm_v1
+{
+  ColorMatrix ret;
+  set_zero(ret);
+  const Coordinate xl_mu = coordinate_shifts(xl,mu);
+  for (int m = 0; m < DIMN; ++m) {
+    if (mu != m) {
+      ret += gf_get_link(gf, xl, m) *
+        gf_get_link(gf, coordinate_shifts(xl,m), mu) *
+        matrix_adjoint(gf_get_link(gf, xl_mu, m));
+      const Coordinate xl_m = coordinate_shifts(xl,-m-1);
+      ret += matrix_adjoint(gf_get_link(gf, xl_m, m)) *
+        gf_get_link(gf, xl_m, mu) *
+        gf_get_link(gf, coordinate_shifts(xl_mu,-m-1), m);
+    }
+  }
+  return ret;
+}
+
+template <class C>
+inline void gf_ape_smear_no_comm(GaugeFieldCompact<C>& gf, const GaugeFieldCompact<C>& gf0, const double alpha,
+    const bool is_polar_start = false)
+  // see gf_ape_smear_no_comm(GaugeField&, ...)
+{
+  TIMER_VERBOSE("gf_ape_smear_no_comm(compact)");
+  qassert(&gf != &gf0);
+  const Geometry& geo = gf0.geo;
+  gf.init(geo_resize(geo));
+  qassert(is_matching_geo_mult(geo, gf.geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<C> v = gf.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      set_color_matrix_compact(v[mu], color_matrix_su_projection_smear(
+            (1.0 - alpha) * gf_get_link(gf0, xl, mu) + (alpha / 6.0) * gf_staple_no_comm(gf0, xl, mu), is_polar_start));
+    }
+  }
+}
+
+template <class C>
+inline void gf_ape_smear(GaugeFieldCompact<C>& gf, const GaugeFieldCompact<C>& gf0, const double alpha, const long steps = 1,
+    const bool is_polar_start = false)
+  // gf can be gf0
+{
+  TIMER_VERBOSE("gf_ape_smear(compact)");
+  GaugeFieldCompact<C> gf1;
+  gf1.init(geo_resize(gf0.geo, 1));
+  gf1 = gf0;
+  for (long i = 0; i < steps; ++i) {
+    if (i > 0) {
+      gf1 = gf;
+    }
+    refresh_expanded(gf1);
+    gf_ape_smear_no_comm(gf, gf1, alpha, is_polar_start);
+  }
+}
+
+QLAT_END_NAMESPACE
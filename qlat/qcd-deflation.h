@@ -0,0 +1,219 @@
+#pragma once
+
+#include <qlat/qcd.h>
+#include <qlat/fermion-action.h>
+#include <qlat/qcd-dirac.h>
+#include <qlat/qcd-inverter.h>
+#include <qlat/qcd-dwf.h>
+#include <qlat/compressed-eigen-io.h>
+
+QLAT_START_NAMESPACE
+
+// Deflation with the compressed eigen system
+//
+// The low modes v_i of M^dag M (M the even/odd preconditioned domain wall
+// operator of qcd-dwf.h, on the odd sites) are kept in the format of
+// compressed-eigen-io.h: on each block b, v_i = sum_j c_bij u_bj with the
+// bases u_bj of CompressedEigenSystemBases and the coefs c_bij of
+// CompressedEigenSystemCoefs. The low mode part of the inverse
+//
+//   x = sum_i v_i (v_i^dag y) / lambda_i
+//
+// is computed block by block without forming any v_i:
+//
+//   w_i = sum_b sum_j conj(c_bij) (u_bj^dag y_b)  (one glb_sum)
+//   x_b = sum_j u_bj (sum_i c_bij w_i / lambda_i)
+//
+// On each block these are two matrix-vector products with the bases and two
+// with the coefs, in single precision as the data are stored, so the cost is
+// O(n_basis (block size + n_vec)) per block instead of O(n_vec block size),
+// and the memory is the one of cesb and cesc only.
+
+inline void deflate_compressed_eigen_system(FermionField5d& out, const FermionField5d& in,
+    const CompressedEigenSystemBases& cesb, const CompressedEigenSystemCoefs& cesc,
+    const std::vector<double>& eigen_values)
+  // out_o = sum_i v_i (v_i^dag in_o) / eigen_values[i] (out can not be in)
+  // only the odd sites of in are used and the even sites of out are set to zero
+  // in must have the machine layout of cesb (e.g. from load_compressed_eigen_vectors)
+  // in can not be expanded, the site indices of the blocks are the ones of geo_resize(in.geo)
+{
+  TIMER_VERBOSE_FLOPS("deflate_compressed_eigen_system");
+  qassert(in.geo.is_only_local());
+  const Geometry geo = geo_resize(in.geo);
+  const int ls = geo.multiplicity;
+  const Coordinate& block_site = cesb.block_site;
+  qassert(ls == cesb.ls and ls == cesc.ls);
+  qassert(block_site == cesc.block_site);
+  qassert(is_matching_geo(geo, cesb.geo_full));
+  const long n_basis = cesb.n_basis;
+  const long n_vec = cesc.n_vec;
+  qassert(n_basis == cesc.n_basis);
+  qassert(n_vec <= (long)eigen_values.size());
+  const long c_size_vec = cesb.c_size_vec;
+  const long site_size = ls * HalfVector::c_size;
+  const Geometry& geo_b = cesb.geo;
+  timer.flops += geo_b.local_volume() * 16 * n_basis * (c_size_vec + n_vec);
+  typedef Eigen::Map<const Eigen::MatrixXcf> ConstMapF;
+  std::vector<Complex> ws(n_vec, 0.0);
+#pragma omp parallel
+  {
+    std::vector<Complex> ws_t(n_vec, 0.0);
+    Eigen::VectorXcf y(c_size_vec), p(n_basis), w(n_vec);
+#pragma omp for
+    for (long bindex = 0; bindex < geo_b.local_volume(); ++bindex) {
+      const Coordinate bxl = geo_b.coordinate_from_index(bindex);
+      const std::vector<long> sindices = get_block_odd_site_indices(geo, block_site, bxl);
+      for (long bidx = 0; bidx < (long)sindices.size(); ++bidx) {
+        const Complex* pi = (const Complex*)in.get_elems_const(sindices[bidx]).data();
+        for (long m = 0; m < site_size; ++m) {
+          y(bidx * site_size + m) = ComplexF(pi[m]);
+        }
+      }
+      const ConstMapF u(cesb.get_elems_const(bindex).data(), c_size_vec, n_basis);
+      const ConstMapF c(cesc.get_elems_const(bindex).data(), n_basis, n_vec);
+      p.noalias() = u.adjoint() * y;
+      w.noalias() = c.adjoint() * p;
+      for (long i = 0; i < n_vec; ++i) {
+        ws_t[i] += Complex(w(i));
+      }
+    }
+#pragma omp critical
+    for (long i = 0; i < n_vec; ++i) {
+      ws[i] += ws_t[i];
+    }
+  }
+  glb_sum(get_data(ws), in.geo.geon.comm);
+  Eigen::VectorXcf wl(n_vec);
+  for (long i = 0; i < n_vec; ++i) {
+    wl(i) = ComplexF(ws[i] / eigen_values[i]);
+  }
+  out.init(geo);
+  qassert(is_matching_geo_mult(out.geo, geo));
+  set_zero(out);
+#pragma omp parallel
+  {
+    Eigen::VectorXcf p(n_basis), x(c_size_vec);
+#pragma omp for
+    for (long bindex = 0; bindex < geo_b.local_volume(); ++bindex) {
+      const Coordinate bxl = geo_b.coordinate_from_index(bindex);
+      const std::vector<long> sindices = get_block_odd_site_indices(geo, block_site, bxl);
+      const ConstMapF u(cesb.get_elems_const(bindex).data(), c_size_vec, n_basis);
+      const ConstMapF c(cesc.get_elems_const(bindex).data(), n_basis, n_vec);
+      p.noalias() = c * wl;
+      x.noalias() = u * p;
+      for (long bidx = 0; bidx < (long)sindices.size(); ++bidx) {
+        Complex* po = (Complex*)out.get_elems(sindices[bidx]).data();
+        for (long m = 0; m < site_size; ++m) {
+          po[m] = Complex(x(bidx * site_size + m));
+        }
+      }
+    }
+  }
+}
+
+struct InverterDomainWallDeflation
+  // the Inverter of inverse(sol5d, src5d, inv) with the even/odd preconditioned CG
+  // started from the low mode part of the solution from a compressed eigen system
+  // cesb, cesc and eigen_values are not copied and have to outlive the inverter
+{
+  Geometry geo; // of FermionField5d (multiplicity ls)
+  DomainWallMatrix dwm;
+  ConstHandle<CompressedEigenSystemBases> cesb;
+  ConstHandle<CompressedEigenSystemCoefs> cesc;
+  ConstHandle<std::vector<double> > eigen_values;
+  double stop_rsd;
+  long max_num_iter;
+  //
+  void init()
+  {
+    geo.init();
+    dwm.init();
+    cesb.init();
+    cesc.init();
+    eigen_values.init();
+    stop_rsd = 1.0e-8;
+    max_num_iter = 10000;
+  }
+  void init(const GaugeField& gf, const FermionAction& fa)
+  {
+    dwm.init(gf, fa);
+    geo = dwm.geo;
+  }
+  void init(const CompressedEigenSystemBases& cesb_, const CompressedEigenSystemCoefs& cesc_,
+      const std::vector<double>& eigen_values_)
+  {
+    cesb.init(cesb_);
+    cesc.init(cesc_);
+    eigen_values.init(eigen_values_);
+  }
+  //
+  InverterDomainWallDeflation()
+  {
+    init();
+  }
+  InverterDomainWallDeflation(const GaugeField& gf, const FermionAction& fa)
+  {
+    init();
+    init(gf, fa);
+  }
+  InverterDomainWallDeflation(const GaugeField& gf, const FermionAction& fa,
+      const CompressedEigenSystemBases& cesb_, const CompressedEigenSystemCoefs& cesc_,
+      const std::vector<double>& eigen_values_)
+  {
+    init();
+    init(gf, fa);
+    init(cesb_, cesc_, eigen_values_);
+  }
+};
+
+inline long inverse(FermionField5d& sol, const FermionField5d& src, const InverterDomainWallDeflation& inv)
+  // sol do not need to be initialized
+  // src is multiplied by D_- first if inv.dwm.fa.is_multiplying_dminus
+  // without eigen system (inv.cesb.null()) the CG starts from zero
+  // return the number of iterations, see also get_last_inverter_stats()
+{
+  TIMER_VERBOSE("inverse(ff5d,ff5d,inv-dwf-deflation)");
+  const DomainWallMatrix& dwm = inv.dwm;
+  const Geometry geo = geo_resize(inv.geo);
+  FermionField5d b, b_o, x;
+  b.init(geo);
+  if (dwm.fa.is_multiplying_dminus) {
+    multiply_dminus(b, src, dwm);
+  } else {
+    b = src;
+  }
+  set_dwf_schur_src(b_o, b, dwm);
+  if (inv.cesb.null()) {
+    x.init(geo);
+    set_zero(x);
+  } else {
+    // x_o = (M^dag M)^-1 M^dag b_o restricted to the low modes
+    FermionField5d tmp;
+    multiply_m_schur_dag(tmp, b_o, dwm);
+    deflate_compressed_eigen_system(x, tmp, inv.cesb(), inv.cesc(), inv.eigen_values());
+  }
+  InverterStats& stats = get_last_inverter_stats();
+  stats.init();
+  stats.num_iter = cgne_dwf_schur(x, b_o, dwm, inv.stop_rsd, inv.max_num_iter, stats.rsd);
+  set_dwf_schur_sol_even(x, b, dwm);
+  // true residual
+  FermionField5d tmp;
+  multiply_m(tmp, x, dwm);
+  const std::vector<long>& indices = dwm.dsi.get(-1);
+  stats.true_rsd = std::sqrt(fermion_field_axpy_norm2(tmp, -1.0, b, indices) / fermion_field_norm2(b, indices));
+  displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E ; true rsd = %.4E",
+        fname, stats.num_iter, stats.rsd, stats.true_rsd));
+  sol.init(geo);
+  sol = x;
+  return stats.num_iter;
+}
+
+inline long inverse(FermionField4d& sol, const FermionField4d& src, const InverterDomainWallDeflation& inv)
+  // through the 5d fields of inverse_dwf
+  // sol do not need to be initialized
+{
+  inverse_dwf(sol, src, inv);
+  return get_last_inverter_stats().num_iter;
+}
+
+QLAT_END_NAMESPACE
@@ -0,0 +1,780 @@
+#pragma once
+
+#include <qlat/matrix.h>
+#include <qlat/qcd.h>
+#include <qlat/qcd-utils.h>
+#include <qlat/qcd-compact.h>
+#include <qlat/qcd-topology.h>
+#include <qlat/fermion-action.h>
+
+QLAT_START_NAMESPACE
+
+// Wilson-clover Dirac operator on FermionField4d (conventions of
+// Luscher, Sint, Sommer, Weisz, hep-lat/9605038)
+//
+//   D psi(x) = (4 + m) psi(x)
+//     - 1/2 sum_mu [ (1 - gamma_mu) U_mu(x) psi(x+mu)
+//                  + (1 + gamma_mu) U_mu(x-mu)^dag psi(x-mu) ]
+//     - c_sw/2 sum_{mu<nu} gamma_mu gamma_nu F_mu_nu(x) psi(x)
+//
+// F_mu_nu = (Q_mu_nu - Q_mu_nu^dag) / 8 from the clover leaves of qcd-topology.h,
+// gamma_mu from SpinMatrixConstants, m and c_sw from FermionActionCloverWilson.
+// The boundary conditions are periodic (flip the sign of the boundary links of
+// the gauge field for anti-periodic ones).
+//
+// In the chiral basis gamma_mu = [[0, B_mu], [B_mu^dag, 0]], so with u, l the
+// upper and lower components of psi
+//
+//   (1 -+ gamma_mu) psi = (h, -+ B_mu^dag h)    with h = u -+ B_mu l
+//
+// only the half spinors h are multiplied by the links and exchanged with the
+// neighboring nodes. gamma_mu gamma_nu is block diagonal, the site local part
+// is stored as two packed hermitian 6x6 matrices (CloverTerm).
+
+struct HalfWilsonVector
+  // (s, c) -> p[s * NUM_COLOR + c] with s = 0, 1
+{
+  Complex p[2 * NUM_COLOR];
+};
+
+// single precision storage for the mixed precision solvers
+// the kernels load them into the double precision types above
+
+struct WilsonVectorF
+{
+  ComplexF p[4 * NUM_COLOR];
+};
+
+struct HalfWilsonVectorF
+{
+  ComplexF p[2 * NUM_COLOR];
+};
+
+struct CloverTerm
+  // block b (spin 2b, 2b+1) at p[36*b] : the 6 real diagonal elements, then the
+  // 15 elements above the diagonal row by row as (re, im)
+{
+  double p[72];
+};
+
+struct CloverTermF
+{
+  float p[72];
+};
+
+struct CloverTermField : FieldM<CloverTerm,1>
+{
+  virtual const std::string& cname()
+  {
+    static const std::string s = "CloverTermField";
+    return s;
+  }
+};
+
+struct CloverTermFieldF : FieldM<CloverTermF,1>
+{
+  virtual const std::string& cname()
+  {
+    static const std::string s = "CloverTermFieldF";
+    return s;
+  }
+};
+
+struct FermionField4dF : FieldM<WilsonVectorF,1>
+{
+  virtual const std::string& cname()
+  {
+    static const std::string s = "FermionField4dF";
+    return s;
+  }
+};
+
+struct DiracSpinProjections
+  // the upper right blocks B_mu of the gamma matrices
+{
+  std::array<std::array<Complex,4>,DIMN> bs;
+  // bs[mu][s1*2+s2] = gamma_mu(s1, 2+s2)
+  //
+  DiracSpinProjections()
+  {
+    init();
+  }
+  //
+  void init()
+  {
+    for (int mu = 0; mu < DIMN; ++mu) {
+      const SpinMatrix& gamma = SpinMatrixConstants::get_gamma(mu);
+      for (int s1 = 0; s1 < 2; ++s1) {
+        for (int s2 = 0; s2 < 2; ++s2) {
+          qassert(0.0 == norm(gamma(s1, s2)) && 0.0 == norm(gamma(2+s1, 2+s2)));
+          qassert(gamma(2+s2, s1) == std::conj(gamma(s1, 2+s2)));
+          bs[mu][s1*2+s2] = gamma(s1, 2+s2);
+        }
+      }
+    }
+  }
+  //
+  static const DiracSpinProjections& get_instance()
+  {
+    static DiracSpinProjections dsps;
+    return dsps;
+  }
+};
+
+template <class V, class HV>
+inline void spin_project(HV& h, const V& v, const int mu, const int sign)
+  // h = u + sign * B_mu l, i.e. the half spinor of (1 + sign * gamma_mu) v
+{
+  const std::array<Complex,4>& b = DiracSpinProjections::get_instance().bs[mu];
+  for (int c = 0; c < NUM_COLOR; ++c) {
+    const Complex l0 = v.p[2 * NUM_COLOR + c];
+    const Complex l1 = v.p[3 * NUM_COLOR + c];
+    h.p[c] = Complex(v.p[c]) + (double)sign * (b[0] * l0 + b[1] * l1);
+    h.p[NUM_COLOR + c] = Complex(v.p[NUM_COLOR + c]) + (double)sign * (b[2] * l0 + b[3] * l1);
+  }
+}
+
+template <class HV>
+inline void spin_reconstruct_add(WilsonVector& v, const HV& h, const int mu, const int sign, const double coef)
+  // v += coef * (h, sign * B_mu^dag h), i.e. coef * (1 + sign * gamma_mu) of the projected spinor
+{
+  const std::array<Complex,4>& b = DiracSpinProjections::get_instance().bs[mu];
+  const double coef_l = coef * sign;
+  Complex* u = v.p;
+  Complex* l = v.p + 2 * NUM_COLOR;
+  for (int c = 0; c < NUM_COLOR; ++c) {
+    const Complex h0 = h.p[c];
+    const Complex h1 = h.p[NUM_COLOR + c];
+    u[c] += coef * h0;
+    u[NUM_COLOR + c] += coef * h1;
+    l[c] += coef_l * (std::conj(b[0]) * h0 + std::conj(b[2]) * h1);
+    l[NUM_COLOR + c] += coef_l * (std::conj(b[1]) * h0 + std::conj(b[3]) * h1);
+  }
+}
+
+template <class HV1, class HV2>
+inline void color_multiply(HV1& h, const ColorMatrix& m, const HV2& h0)
+  // h = m h0 (h can not be h0)
+{
+  for (int s = 0; s < 2; ++s) {
+    for (int c1 = 0; c1 < NUM_COLOR; ++c1) {
+      Complex sum = 0.0;
+      for (int c2 = 0; c2 < NUM_COLOR; ++c2) {
+        sum += m.p[c1 * NUM_COLOR + c2] * Complex(h0.p[s * NUM_COLOR + c2]);
+      }
+      h.p[s * NUM_COLOR + c1] = sum;
+    }
+  }
+}
+
+template <class HV1, class HV2>
+inline void color_multiply_adjoint(HV1& h, const ColorMatrix& m, const HV2& h0)
+  // h = m^dag h0 (h can not be h0)
+{
+  for (int s = 0; s < 2; ++s) {
+    for (int c1 = 0; c1 < NUM_COLOR; ++c1) {
+      Complex sum = 0.0;
+      for (int c2 = 0; c2 < NUM_COLOR; ++c2) {
+        sum += std::conj(m.p[c2 * NUM_COLOR + c1]) * Complex(h0.p[s * NUM_COLOR + c2]);
+      }
+      h.p[s * NUM_COLOR + c1] = sum;
+    }
+  }
+}
+
+template <class V1, class V2>
+inline void wilson_vector_assign(V1& v, const V2& v0, const double coef = 1.0)
+  // v = coef * v0 with the conversion of the precision
+{
+  for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+    v.p[k] = coef * Complex(v0.p[k]);
+  }
+}
+
+template <class CT, class V>
+inline void clover_term_apply(WilsonVector& v, const CT& ct, const V& v0)
+  // v = ct v0
+{
+  const int n = 2 * NUM_COLOR;
+  for (int b = 0; b < 2; ++b) {
+    Complex x[2 * NUM_COLOR];
+    for (int i = 0; i < n; ++i) {
+      x[i] = v0.p[n * b + i];
+    }
+    const int d = 36 * b;
+    const int o = d + n;
+    Complex* y = &v.p[n * b];
+    for (int i = 0; i < n; ++i) {
+      y[i] = (double)ct.p[d + i] * x[i];
+    }
+    int k = 0;
+    for (int i = 0; i < n; ++i) {
+      for (int j = i + 1; j < n; ++j) {
+        const Complex a(ct.p[o + 2*k], ct.p[o + 2*k+1]);
+        y[i] += a * x[j];
+        y[j] += std::conj(a) * x[i];
+        k += 1;
+      }
+    }
+  }
+}
+
+inline void set_clover_term(CloverTerm& ct, const Vector<ColorMatrix> clf, const FermionActionCloverWilson& fa)
+  // clf is F_01, F_02, F_03, F_12, F_13, F_23 at one site (see gf_clover_leaf_field)
+{
+  qassert(3 == NUM_COLOR);
+  const std::array<SpinMatrix,4>& gammas = SpinMatrixConstants::get_gammas();
+  const int n = 2 * NUM_COLOR;
+  Complex m[2][n][n];
+  for (int b = 0; b < 2; ++b) {
+    for (int i = 0; i < n; ++i) {
+      for (int j = 0; j < n; ++j) {
+        m[b][i][j] = i == j ? 4.0 + fa.mass : 0.0;
+      }
+    }
+  }
+  int k = 0;
+  for (int mu = 0; mu < DIMN; ++mu) {
+    for (int nu = mu + 1; nu < DIMN; ++nu) {
+      const ColorMatrix f = 0.5 * (clf[k] - matrix_adjoint(clf[k]));
+      const SpinMatrix g = gammas[mu] * gammas[nu];
+      for (int b = 0; b < 2; ++b) {
+        for (int s1 = 0; s1 < 2; ++s1) {
+          for (int s2 = 0; s2 < 2; ++s2) {
+            const Complex gc = -0.5 * fa.clover_coef * g(2*b+s1, 2*b+s2);
+            for (int c1 = 0; c1 < NUM_COLOR; ++c1) {
+              for (int c2 = 0; c2 < NUM_COLOR; ++c2) {
+                m[b][s1*NUM_COLOR+c1][s2*NUM_COLOR+c2] += gc * f(c1, c2);
+              }
+            }
+          }
+        }
+      }
+      k += 1;
+    }
+  }
+  for (int b = 0; b < 2; ++b) {
+    double* d = &ct.p[36 * b];
+    double* o = d + n;
+    int k = 0;
+    for (int i = 0; i < n; ++i) {
+      d[i] = m[b][i][i].real();
+      for (int j = i + 1; j < n; ++j) {
+        o[2*k] = m[b][i][j].real();
+        o[2*k+1] = m[b][i][j].imag();
+        k += 1;
+      }
+    }
+  }
+}
+
+inline void set_clover_term_inverse(CloverTerm& cti, const CloverTerm& ct)
+  // the blocks are inverted separately
+{
+  const int n = 2 * NUM_COLOR;
+  for (int b = 0; b < 2; ++b) {
+    const double* d = &ct.p[36 * b];
+    const double* o = d + n;
+    Eigen::Matrix<Complex,2*NUM_COLOR,2*NUM_COLOR> m;
+    int k = 0;
+    for (int i = 0; i < n; ++i) {
+      m(i, i) = d[i];
+      for (int j = i + 1; j < n; ++j) {
+        m(i, j) = Complex(o[2*k], o[2*k+1]);
+        m(j, i) = std::conj(m(i, j));
+        k += 1;
+      }
+    }
+    const Eigen::Matrix<Complex,2*NUM_COLOR,2*NUM_COLOR> mi = m.inverse();
+    double* di = &cti.p[36 * b];
+    double* oi = di + n;
+    k = 0;
+    for (int i = 0; i < n; ++i) {
+      di[i] = mi(i, i).real();
+      for (int j = i + 1; j < n; ++j) {
+        oi[2*k] = mi(i, j).real();
+        oi[2*k+1] = mi(i, j).imag();
+        k += 1;
+      }
+    }
+  }
+}
+
+inline void set_clover_term_field(CloverTermField& ctf, const GaugeField& gf, const FermionActionCloverWilson& fa)
+{
+  TIMER_VERBOSE("set_clover_term_field");
+  CloverLeafField clf;
+  gf_clover_leaf_field(clf, gf);
+  const Geometry geo = geo_reform(gf.geo);
+  ctf.init(geo);
+  qassert(is_matching_geo_mult(ctf.geo, geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    set_clover_term(ctf.get_elem(xl), clf.get_elems_const(xl), fa);
+  }
+}
+
+inline void set_clover_term_field_inverse(CloverTermField& ctfi, const CloverTermField& ctf)
+{
+  TIMER_VERBOSE("set_clover_term_field_inverse");
+  const Geometry geo = geo_resize(ctf.geo);
+  ctfi.init(geo);
+  qassert(is_matching_geo_mult(ctfi.geo, geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    set_clover_term_inverse(ctfi.get_elem(xl), ctf.get_elem(xl));
+  }
+}
+
+inline int eo_parity(const Coordinate& xg)
+  // 0 for the even sites and 1 for the odd sites
+{
+  return mod(xg[0] + xg[1] + xg[2] + xg[3], 2);
+}
+
+struct DiracSiteIndices
+  // the local indices of the sites of each parity and region, computed once
+  // with the geometry of an operator (CloverWilsonMatrix, DomainWallMatrix)
+  // parity 0 : the even sites ; 1 : the odd sites ; -1 : all
+  // region 0 : the interior sites (is_interior(xl, geo, 1)) ; 1 : the other sites ; -1 : all
+{
+  Coordinate node_site;
+  Coordinate xg_origin; // global coordinate of the local site at Coordinate()
+  bool is_even_site; // all the dimensions of total_site are even
+  std::array<std::array<std::vector<long>,3>,3> indices; // [parity + 1][region + 1]
+  //
+  void init()
+  {
+    node_site = Coordinate();
+    xg_origin = Coordinate();
+    is_even_site = false;
+    for (int p = 0; p < 3; ++p) {
+      for (int r = 0; r < 3; ++r) {
+        clear(indices[p][r]);
+      }
+    }
+  }
+  void init(const Geometry& geo)
+  {
+    TIMER_VERBOSE("DiracSiteIndices::init");
+    init();
+    node_site = geo.node_site;
+    xg_origin = geo.coordinate_g_from_l(Coordinate());
+    const Coordinate total_site = geo.total_site();
+    is_even_site = true;
+    for (int mu = 0; mu < DIMN; ++mu) {
+      is_even_site = is_even_site and 0 == total_site[mu] % 2;
+    }
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      const int parity = eo_parity(geo.coordinate_g_from_l(xl));
+      const int region = is_interior(xl, geo, 1) ? 0 : 1;
+      indices[0][0].push_back(index);
+      indices[0][region + 1].push_back(index);
+      indices[parity + 1][0].push_back(index);
+      indices[parity + 1][region + 1].push_back(index);
+    }
+  }
+  //
+  DiracSiteIndices()
+  {
+    init();
+  }
+  DiracSiteIndices(const Geometry& geo)
+  {
+    init();
+    init(geo);
+  }
+  //
+  const std::vector<long>& get(const int parity, const int region = -1) const
+  {
+    qassert(-1 <= parity and parity <= 1);
+    qassert(-1 <= region and region <= 1);
+    qassert(parity < 0 or is_even_site);
+    return indices[parity + 1][region + 1];
+  }
+};
+
+inline bool is_matching_dirac_site_indices(const DiracSiteIndices& dsi, const Geometry& geo)
+  // the fields of geo can be used with the indices of dsi (multiplicity and expansion do not matter)
+{
+  return dsi.node_site == geo.node_site and dsi.xg_origin == geo.coordinate_g_from_l(Coordinate());
+}
+
+struct CloverWilsonMatrix
+  // everything needed to apply the Wilson-clover operator
+{
+  typedef WilsonVector WilsonVectorType;
+  typedef HalfWilsonVector HalfWilsonVectorType;
+  //
+  Geometry geo; // of the fermion fields
+  FermionActionCloverWilson fa;
+  GaugeField gf;
+  CloverTermField ctf;
+  CloverTermField ctf_inv; // for the even/odd preconditioning
+  DiracSiteIndices dsi;
+  //
+  void init()
+  {
+    geo.init();
+    fa.init();
+    gf.init();
+    ctf.init();
+    ctf_inv.init();
+    dsi.init();
+  }
+  void init(const GaugeField& gf_, const FermionActionCloverWilson& fa_)
+  {
+    TIMER_VERBOSE("CloverWilsonMatrix::init");
+    init();
+    geo = geo_reform(gf_.geo);
+    fa = fa_;
+    gf.init(geo_resize(gf_.geo));
+    gf = gf_;
+    set_clover_term_field(ctf, gf, fa);
+    set_clover_term_field_inverse(ctf_inv, ctf);
+    dsi.init(geo);
+  }
+  //
+  CloverWilsonMatrix()
+  {
+    init();
+  }
+  CloverWilsonMatrix(const GaugeField& gf_, const FermionActionCloverWilson& fa_)
+  {
+    init();
+    init(gf_, fa_);
+  }
+};
+
+inline void set_clover_term_field_float(CloverTermFieldF& ctff, const CloverTermField& ctf)
+{
+  TIMER("set_clover_term_field_float");
+  const Geometry geo = geo_resize(ctf.geo);
+  ctff.init(geo);
+  qassert(is_matching_geo_mult(ctff.geo, geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const CloverTerm& ct = ctf.get_elem(xl);
+    CloverTermF& ctf_f = ctff.get_elem(xl);
+    for (int i = 0; i < 72; ++i) {
+      ctf_f.p[i] = ct.p[i];
+    }
+  }
+}
+
+struct CloverWilsonMatrixF
+  // single precision copy of a CloverWilsonMatrix, the links are stored as
+  // ColorMatrixSF (qcd-compact.h) and all the arithmetics is done in double
+{
+  typedef WilsonVectorF WilsonVectorType;
+  typedef HalfWilsonVectorF HalfWilsonVectorType;
+  //
+  Geometry geo;
+  GaugeFieldCompact<ColorMatrixSF> gf;
+  CloverTermFieldF ctf;
+  CloverTermFieldF ctf_inv;
+  DiracSiteIndices dsi;
+  //
+  void init()
+  {
+    geo.init();
+    gf.init();
+    ctf.init();
+    ctf_inv.init();
+    dsi.init();
+  }
+  void init(const CloverWilsonMatrix& cwm)
+  {
+    TIMER_VERBOSE("CloverWilsonMatrixF::init");
+    init();
+    geo = cwm.geo;
+    set_gauge_field_compact(gf, cwm.gf);
+    set_clover_term_field_float(ctf, cwm.ctf);
+    set_clover_term_field_float(ctf_inv, cwm.ctf_inv);
+    dsi = cwm.dsi;
+  }
+  //
+  CloverWilsonMatrixF()
+  {
+    init();
+  }
+  CloverWilsonMatrixF(const CloverWilsonMatrix& cwm)
+  {
+    init();
+    init(cwm);
+  }
+};
+
+inline void set_marks_field_wilson_hop(CommMarks& marks, const Geometry& geo, const std::string& tag)
+  // tag is "" or the parity of the sites to be sent, e.g. "1"
+  // geo.multiplicity is 2*DIMN*nrhs, see set_wilson_hop_half_spinors_no_comm
+  // element 2*mu is needed at x+mu and element 2*mu+1 at x-mu for all the local x
+{
+  TIMER_VERBOSE("set_marks_field_wilson_hop");
+  qassert(0 == geo.multiplicity % (2 * DIMN));
+  const int nrhs = geo.multiplicity / (2 * DIMN);
+  int parity = -1;
+  if (tag != "") {
+    qassert(1 == sscanf(tag.c_str(), "%d", &parity));
+  }
+  marks.init();
+  marks.init(geo);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    if (parity >= 0 and parity == eo_parity(geo.coordinate_g_from_l(xl))) {
+      continue;
+    }
+    for (int mu = 0; mu < DIMN; ++mu) {
+      const Coordinate xf = coordinate_shifts(xl, mu);
+      if (geo.is_on_node(xf) and !geo.is_local(xf)) {
+        for (int n = 0; n < nrhs; ++n) {
+          marks.get_elem(xf, 2 * mu * nrhs + n) = 1;
+        }
+      }
+      const Coordinate xb = coordinate_shifts(xl, -mu-1);
+      if (geo.is_on_node(xb) and !geo.is_local(xb)) {
+        for (int n = 0; n < nrhs; ++n) {
+          marks.get_elem(xb, (2 * mu + 1) * nrhs + n) = 1;
+        }
+      }
+    }
+  }
+}
+
+template <class HV, class V, class C>
+inline void set_wilson_hop_half_spinors_no_comm(Field<HV>& hf, const Field<V>& ff,
+    const FieldM<C,4>& gf, const std::vector<long>& indices)
+  // ff has nrhs = ff.geo.multiplicity spinors per site and hf 2*DIMN*nrhs half spinors
+  // hf(y, 2*mu*nrhs+n) = (1 - gamma_mu) ff(y, n)
+  // hf(y, (2*mu+1)*nrhs+n) = U_mu(y)^dag (1 + gamma_mu) ff(y, n)
+  // on the local sites of indices, each link is loaded once for the nrhs spinors
+{
+  TIMER("set_wilson_hop_half_spinors_no_comm");
+  const Geometry& geo = ff.geo;
+  const int nrhs = geo.multiplicity;
+  qassert(hf.geo.multiplicity == 2 * DIMN * nrhs);
+#pragma omp parallel for
+  for (long i = 0; i < (long)indices.size(); ++i) {
+    const Coordinate xl = geo.coordinate_from_index(indices[i]);
+    const Vector<V> v = ff.get_elems_const(xl);
+    Vector<HV> hv = hf.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      const ColorMatrix u = gf_get_link(gf, xl, mu);
+      for (int n = 0; n < nrhs; ++n) {
+        spin_project(hv[2 * mu * nrhs + n], v[n], mu, -1);
+        HalfWilsonVector h;
+        spin_project(h, v[n], mu, 1);
+        color_multiply_adjoint(hv[(2 * mu + 1) * nrhs + n], u, h);
+      }
+    }
+  }
+}
+
+template <class HV, class C>
+inline void wilson_hop_site_no_comm(Vector<WilsonVector> v, const Coordinate& xl,
+    const Field<HV>& hf, const FieldM<C,4>& gf)
+  // v[n] += H ff(n) at xl, with H the hopping term of D and n < v.size()
+  // hf need to be refreshed at the neighbors of xl
+{
+  const int nrhs = v.size();
+  for (int mu = 0; mu < DIMN; ++mu) {
+    const ColorMatrix u = gf_get_link(gf, xl, mu);
+    const Vector<HV> hf_f = hf.get_elems_const(coordinate_shifts(xl, mu));
+    const Vector<HV> hf_b = hf.get_elems_const(coordinate_shifts(xl, -mu-1));
+    for (int n = 0; n < nrhs; ++n) {
+      HalfWilsonVector h;
+      color_multiply(h, u, hf_f[2 * mu * nrhs + n]);
+      spin_reconstruct_add(v[n], h, mu, -1, -0.5);
+      spin_reconstruct_add(v[n], hf_b[(2 * mu + 1) * nrhs + n], mu, 1, -0.5);
+    }
+  }
+}
+
+template <class V, class HV, class C, class CT>
+inline void multiply_wilson_hop_clover_impl(Field<V>& out, const Field<V>& in, const FieldM<C,4>& gf,
+    const FieldM<CT,1>* ctf, const DiracSiteIndices& dsi, const int parity, Field<HV>& hf)
+  // see multiply_wilson_hop_clover, ctf can be NULL for the hopping term only
+{
+  TIMER_FLOPS("multiply_wilson_hop_clover");
+  const Geometry& geo = in.geo;
+  const int nrhs = geo.multiplicity;
+  qassert(is_matching_dirac_site_indices(dsi, geo));
+  const std::vector<long>& indices_interior = dsi.get(parity, 0);
+  const std::vector<long>& indices_boundary = dsi.get(parity, 1);
+  const long num_sites = indices_interior.size() + indices_boundary.size();
+  timer.flops += (1320 + (NULL == ctf ? 0 : 504)) * num_sites * nrhs;
+  out.init(geo_resize(geo));
+  qassert(is_matching_geo_mult(out.geo, geo));
+  hf.init(geo_reform(geo, 2 * DIMN * nrhs, 1));
+  qassert(is_matching_geo(hf.geo, geo));
+  const int parity_src = parity >= 0 ? 1 - parity : -1;
+  set_wilson_hop_half_spinors_no_comm(hf, in, gf, dsi.get(parity_src));
+  RefreshExpandedRequest<HV> req;
+  refresh_expanded_begin(req, hf, get_comm_plan(set_marks_field_wilson_hop,
+        parity_src >= 0 ? ssprintf("%d", parity_src) : "", hf.geo));
+  for (int k = 0; k < 2; ++k) {
+    const std::vector<long>& indices = k == 0 ? indices_interior : indices_boundary;
+    if (k == 1) {
+      refresh_expanded_end(req);
+    }
+#pragma omp parallel
+    {
+      std::vector<WilsonVector> acc(nrhs);
+#pragma omp for
+      for (long i = 0; i < (long)indices.size(); ++i) {
+        const Coordinate xl = geo.coordinate_from_index(indices[i]);
+        const Vector<V> vi = in.get_elems_const(xl);
+        for (int n = 0; n < nrhs; ++n) {
+          if (NULL == ctf) {
+            set_zero(acc[n]);
+          } else {
+            clover_term_apply(acc[n], ctf->get_elem(xl), vi[n]);
+          }
+        }
+        wilson_hop_site_no_comm(get_data(acc), xl, hf, gf);
+        Vector<V> vo = out.get_elems(xl);
+        for (int n = 0; n < nrhs; ++n) {
+          wilson_vector_assign(vo[n], acc[n]);
+        }
+      }
+    }
+  }
+}
+
+template <class V, class HV, class C, class CT>
+inline void multiply_wilson_hop_clover(Field<V>& out, const Field<V>& in, const FieldM<C,4>& gf,
+    const FieldM<CT,1>& ctf, const DiracSiteIndices& dsi, const int parity, Field<HV>& hf)
+  // out = (ctf + H) in on the sites of the parity (all the sites if parity is -1)
+  // in can have several spinors per site (multiplicity), they share the links and ctf
+  // hf is the buffer of the half spinors (initialized if needed)
+  // the half spinors are exchanged while the interior sites are computed
+  // out can be in, the other parity of out is not changed
+{
+  multiply_wilson_hop_clover_impl(out, in, gf, &ctf, dsi, parity, hf);
+}
+
+template <class V, class HV, class C>
+inline void multiply_wilson_hop(Field<V>& out, const Field<V>& in, const FieldM<C,4>& gf,
+    const DiracSiteIndices& dsi, const int parity, Field<HV>& hf)
+  // out = H in on the sites of the parity (all the sites if parity is -1)
+  // only the other parity of in is used if parity is not -1
+  // out can be in, the other parity of out is not changed
+{
+  multiply_wilson_hop_clover_impl(out, in, gf, (const FieldM<CloverTerm,1>*)NULL, dsi, parity, hf);
+}
+
+template <class C>
+inline void multiply_clover_wilson(Field<WilsonVector>& out, const Field<WilsonVector>& in, const FieldM<C,4>& gf,
+    const CloverTermField& ctf, const DiracSiteIndices& dsi)
+  // out = D in (out can not be in)
+{
+  Field<HalfWilsonVector> hf;
+  multiply_wilson_hop_clover(out, in, gf, ctf, dsi, -1, hf);
+}
+
+template <class V, class CT>
+inline void multiply_clover_term(Field<V>& out, const Field<V>& in, const FieldM<CT,1>& ctf,
+    const DiracSiteIndices& dsi, const int parity, const double coef = 1.0)
+  // out = coef * ctf in on the sites of the parity (all the sites if parity is -1)
+  // out can be in, the other parity of out is not changed
+{
+  TIMER_FLOPS("multiply_clover_term");
+  const Geometry& geo = in.geo;
+  qassert(is_matching_dirac_site_indices(dsi, geo));
+  const std::vector<long>& indices = dsi.get(parity);
+  timer.flops += 504 * indices.size() * geo.multiplicity;
+  out.init(geo_resize(geo));
+  qassert(is_matching_geo_mult(out.geo, geo));
+#pragma omp parallel for
+  for (long i = 0; i < (long)indices.size(); ++i) {
+    const Coordinate xl = geo.coordinate_from_index(indices[i]);
+    const CT& ct = ctf.get_elem(xl);
+    const Vector<V> vi = in.get_elems_const(xl);
+    Vector<V> vo = out.get_elems(xl);
+    for (int n = 0; n < geo.multiplicity; ++n) {
+      WilsonVector v;
+      clover_term_apply(v, ct, vi[n]);
+      wilson_vector_assign(vo[n], v, coef);
+    }
+  }
+}
+
+template <class V>
+inline void multiply_gamma5_site(Vector<V> vs)
+{
+  for (int n = 0; n < vs.size(); ++n) {
+    V& v = vs[n];
+    for (int k = 2 * NUM_COLOR; k < 4 * NUM_COLOR; ++k) {
+      v.p[k] = -v.p[k];
+    }
+  }
+}
+
+template <class V>
+inline void multiply_gamma5(Field<V>& ff)
+  // on all the local sites
+{
+  TIMER("multiply_gamma5");
+  const Geometry& geo = ff.geo;
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    multiply_gamma5_site(ff.get_elems(geo.coordinate_from_index(index)));
+  }
+}
+
+template <class V>
+inline void multiply_gamma5(Field<V>& ff, const DiracSiteIndices& dsi, const int parity)
+  // on the sites of the parity (all the sites if parity is -1)
+{
+  TIMER("multiply_gamma5");
+  const Geometry& geo = ff.geo;
+  qassert(is_matching_dirac_site_indices(dsi, geo));
+  const std::vector<long>& indices = dsi.get(parity);
+#pragma omp parallel for
+  for (long i = 0; i < (long)indices.size(); ++i) {
+    multiply_gamma5_site(ff.get_elems(geo.coordinate_from_index(indices[i])));
+  }
+}
+
+inline void multiply_m(Field<WilsonVector>& out, const Field<WilsonVector>& in, const CloverWilsonMatrix& cwm)
+  // out = D in (out can not be in)
+{
+  multiply_clover_wilson(out, in, cwm.gf, cwm.ctf, cwm.dsi);
+}
+
+inline void multiply_m_dag(Field<WilsonVector>& out, const Field<WilsonVector>& in, const CloverWilsonMatrix& cwm)
+  // out = D^dag in = gamma5 D gamma5 in (out can not be in)
+{
+  Field<WilsonVector> in5;
+  in5.init(geo_resize(in.geo));
+  in5 = in;
+  multiply_gamma5(in5);
+  multiply_m(out, in5, cwm);
+  multiply_gamma5(out);
+}
+
+template <class M>
+inline void set_g_rand_fermion_field(Field<M>& ff, const RngState& rs, const double sigma = 1.0)
+  // Gaussian random real and imaginary parts of all the components
+{
+  TIMER("set_g_rand_fermion_field");
+  const Geometry& geo = ff.geo;
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const Coordinate xg = geo.coordinate_g_from_l(xl);
+    RngState rsi(rs, geo.g_index_from_g_coordinate(xg));
+    Vector<M> v = ff.get_elems(xl);
+    double* p = (double*)v.data();
+    for (long i = 0; i < v.data_size() / (long)sizeof(double); ++i) {
+      p[i] = g_rand_gen(rsi, 0.0, sigma);
+    }
+  }
+}
+
+QLAT_END_NAMESPACE
@@ -0,0 +1,603 @@
+#pragma once
+
+#include <qlat/qcd.h>
+#include <qlat/fermion-action.h>
+#include <qlat/qcd-dirac.h>
+#include <qlat/qcd-inverter.h>
+
+QLAT_START_NAMESPACE
+
+// Mobius domain wall operator on FermionField5d (Brower, Neff, Orginos,
+// arXiv:1206.5214) with the parameters of FermionAction
+//
+//   D psi_s = D_+ psi_s - D_- (P_- psi_{s+1} + P_+ psi_{s-1})
+//
+//   D_+ = 1 + b D_W(-m5) ; D_- = 1 - c D_W(-m5) ; b + c = mobius_scale ; b - c = 1
+//
+// with psi_{ls} = -mass psi_0, psi_{-1} = -mass psi_{ls-1} and P_+ the upper
+// (right handed) components. D_W(-m5) = 4 - m5 + H with H the hopping term of
+// qcd-dirac.h. The s index is the multiplicity of FermionField5d, so a site
+// is stored as [s][spin][color] with spin-color innermost, and with
+// phi = b psi + c P psi
+//
+//   D psi = psi - P psi + (4 - m5) phi + H phi
+//
+// so each application of D or D^dag needs one hopping term, which loads the
+// links once for all the ls slices. D_- of the source (multiply_dminus) is
+// a separate pass with its own hopping term, once per solve.
+//
+// Even/odd preconditioning: D = A + H B with the site local
+//
+//   A = 1 + (4 - m5) b - (1 - (4 - m5) c) P ; B = b + c P
+//
+// (ls x ls matrices for each chirality, see make_dwf_s_matrix) and the Schur
+// complement on the odd sites is
+//
+//   M = A - H B A^-1 H B ; M^dag = gamma5 (A^T - B^T H (B A^-1)^T H) gamma5
+//
+// as A and B commute with gamma5. The odd sites are the ones of eo_parity in
+// qcd-dirac.h.
+
+inline std::vector<double> make_dwf_s_matrix(const FermionAction& fa, const double coef_1, const double coef_p)
+  // coef_1 + coef_p P as the ls x ls matrices of the upper then the lower components
+  // mat[s * ls + t] is the coefficient of in_t in out_s, see dwf_s_hop_site for P
+{
+  const int ls = fa.ls;
+  std::vector<double> mat(2 * ls * ls, 0.0);
+  double* mat_u = &mat[0];
+  double* mat_l = &mat[ls * ls];
+  for (int s = 0; s < ls; ++s) {
+    mat_u[s * ls + s] += coef_1;
+    mat_l[s * ls + s] += coef_1;
+    if (s > 0) {
+      mat_u[s * ls + s - 1] += coef_p;
+    } else {
+      mat_u[s * ls + ls - 1] += -fa.mass * coef_p;
+    }
+    if (s < ls - 1) {
+      mat_l[s * ls + s + 1] += coef_p;
+    } else {
+      mat_l[s * ls + 0] += -fa.mass * coef_p;
+    }
+  }
+  return mat;
+}
+
+inline std::vector<double> dwf_s_matrix_inverse(const std::vector<double>& mat, const int ls)
+{
+  typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> SMatrix;
+  qassert((long)mat.size() == 2 * ls * ls);
+  std::vector<double> ret(2 * ls * ls);
+  for (int chi = 0; chi < 2; ++chi) {
+    Eigen::Map<const SMatrix> m(&mat[chi * ls * ls], ls, ls);
+    Eigen::Map<SMatrix> mi(&ret[chi * ls * ls], ls, ls);
+    mi = m.inverse();
+  }
+  return ret;
+}
+
+inline std::vector<double> dwf_s_matrix_product(const std::vector<double>& mat1, const std::vector<double>& mat2, const int ls)
+{
+  typedef Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> SMatrix;
+  qassert((long)mat1.size() == 2 * ls * ls);
+  qassert((long)mat2.size() == 2 * ls * ls);
+  std::vector<double> ret(2 * ls * ls);
+  for (int chi = 0; chi < 2; ++chi) {
+    Eigen::Map<const SMatrix> m1(&mat1[chi * ls * ls], ls, ls);
+    Eigen::Map<const SMatrix> m2(&mat2[chi * ls * ls], ls, ls);
+    Eigen::Map<SMatrix> m(&ret[chi * ls * ls], ls, ls);
+    m = m1 * m2;
+  }
+  return ret;
+}
+
+struct DomainWallMatrix
+  // everything needed to apply the Mobius domain wall operator
+{
+  Geometry geo; // of FermionField5d (multiplicity ls)
+  FermionAction fa;
+  GaugeField gf;
+  // the site local matrices of the even/odd preconditioning, see make_dwf_s_matrix
+  std::vector<double> mat_a, mat_a_inv, mat_b, mat_b_a_inv;
+  DiracSiteIndices dsi;
+  //
+  void init()
+  {
+    geo.init();
+    fa.init();
+    gf.init();
+    dsi.init();
+    clear(mat_a);
+    clear(mat_a_inv);
+    clear(mat_b);
+    clear(mat_b_a_inv);
+  }
+  void init(const GaugeField& gf_, const FermionAction& fa_)
+  {
+    TIMER_VERBOSE("DomainWallMatrix::init");
+    init();
+    fa = fa_;
+    geo = geo_reform(gf_.geo, fa.ls);
+    gf.init(geo_reform(gf_.geo));
+    gf = gf_;
+    mat_a = make_dwf_s_matrix(fa, 1.0 + (4.0 - fa.m5) * b(), -(1.0 - (4.0 - fa.m5) * c()));
+    mat_b = make_dwf_s_matrix(fa, b(), c());
+    mat_a_inv = dwf_s_matrix_inverse(mat_a, fa.ls);
+    mat_b_a_inv = dwf_s_matrix_product(mat_b, mat_a_inv, fa.ls);
+    dsi.init(geo);
+  }
+  //
+  DomainWallMatrix()
+  {
+    init();
+  }
+  DomainWallMatrix(const GaugeField& gf_, const FermionAction& fa_)
+  {
+    init();
+    init(gf_, fa_);
+  }
+  //
+  double b() const
+  {
+    return 0.5 * (fa.mobius_scale + 1.0);
+  }
+  double c() const
+  {
+    return 0.5 * (fa.mobius_scale - 1.0);
+  }
+};
+
+inline void dwf_s_hop_site(Vector<WilsonVector> out, const Vector<WilsonVector> in, const double mass, const bool is_dag)
+  // out_s = P_- in_{s+1} + P_+ in_{s-1} (P^dag: out_s = P_- in_{s-1} + P_+ in_{s+1})
+  // with in_{ls} = -mass in_0 and in_{-1} = -mass in_{ls-1}
+{
+  const int ls = in.size();
+  const int h = 2 * NUM_COLOR;
+  for (int s = 0; s < ls; ++s) {
+    int s_u = is_dag ? s + 1 : s - 1;
+    int s_l = is_dag ? s - 1 : s + 1;
+    double coef_u = 1.0;
+    double coef_l = 1.0;
+    if (s_u < 0 or s_u >= ls) {
+      s_u = mod(s_u, ls);
+      coef_u = -mass;
+    }
+    if (s_l < 0 or s_l >= ls) {
+      s_l = mod(s_l, ls);
+      coef_l = -mass;
+    }
+    for (int k = 0; k < h; ++k) {
+      out[s].p[k] = coef_u * in[s_u].p[k];
+    }
+    for (int k = h; k < 2 * h; ++k) {
+      out[s].p[k] = coef_l * in[s_l].p[k];
+    }
+  }
+}
+
+inline void multiply_m(FermionField5d& out, const FermionField5d& in, const DomainWallMatrix& dwm)
+  // out = D in (out can not be in)
+{
+  TIMER_FLOPS("multiply_m(dwf)");
+  const Geometry& geo = in.geo;
+  const int ls = geo.multiplicity;
+  qassert(ls == dwm.fa.ls);
+  const double b = dwm.b();
+  const double c = dwm.c();
+  const double mass = dwm.fa.mass;
+  const double m5 = dwm.fa.m5;
+  timer.flops += (1320 + 4 * 8 * 4 * NUM_COLOR) * geo.local_volume() * ls;
+  FermionField5d phi;
+  phi.init(geo_resize(geo));
+#pragma omp parallel
+  {
+    std::vector<WilsonVector> pin(ls);
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      const Vector<WilsonVector> vi = in.get_elems_const(xl);
+      Vector<WilsonVector> vphi = phi.get_elems(xl);
+      dwf_s_hop_site(get_data(pin), vi, mass, false);
+      for (int s = 0; s < ls; ++s) {
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          vphi[s].p[k] = b * vi[s].p[k] + c * pin[s].p[k];
+        }
+      }
+    }
+  }
+  Field<HalfWilsonVector> hf;
+  multiply_wilson_hop(out, phi, dwm.gf, dwm.dsi, -1, hf);
+#pragma omp parallel
+  {
+    std::vector<WilsonVector> pin(ls);
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      const Vector<WilsonVector> vi = in.get_elems_const(xl);
+      const Vector<WilsonVector> vphi = phi.get_elems_const(xl);
+      Vector<WilsonVector> vo = out.get_elems(xl);
+      dwf_s_hop_site(get_data(pin), vi, mass, false);
+      for (int s = 0; s < ls; ++s) {
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          vo[s].p[k] += vi[s].p[k] - pin[s].p[k] + (4.0 - m5) * vphi[s].p[k];
+        }
+      }
+    }
+  }
+}
+
+inline void multiply_m_dag(FermionField5d& out, const FermionField5d& in, const DomainWallMatrix& dwm)
+  // out = D^dag in = in - P^dag in + b zeta + c P^dag zeta with zeta = gamma5 D_W gamma5 in
+  // (out can not be in)
+{
+  TIMER_FLOPS("multiply_m_dag(dwf)");
+  const Geometry& geo = in.geo;
+  const int ls = geo.multiplicity;
+  qassert(ls == dwm.fa.ls);
+  const double b = dwm.b();
+  const double c = dwm.c();
+  const double mass = dwm.fa.mass;
+  const double m5 = dwm.fa.m5;
+  timer.flops += (1320 + 6 * 8 * 4 * NUM_COLOR) * geo.local_volume() * ls;
+  FermionField5d in5;
+  in5.init(geo_resize(geo));
+  in5 = in;
+  multiply_gamma5(in5);
+  Field<HalfWilsonVector> hf;
+  multiply_wilson_hop(out, in5, dwm.gf, dwm.dsi, -1, hf);
+#pragma omp parallel
+  {
+    std::vector<WilsonVector> zeta(ls), pin(ls), pzeta(ls);
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      const Vector<WilsonVector> vi = in.get_elems_const(xl);
+      const Vector<WilsonVector> vi5 = in5.get_elems_const(xl);
+      Vector<WilsonVector> vo = out.get_elems(xl);
+      for (int s = 0; s < ls; ++s) {
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          const Complex z = vo[s].p[k] + (4.0 - m5) * vi5[s].p[k];
+          zeta[s].p[k] = k < 2 * NUM_COLOR ? z : -z;
+        }
+      }
+      dwf_s_hop_site(get_data(pin), vi, mass, true);
+      dwf_s_hop_site(get_data(pzeta), get_data(zeta), mass, true);
+      for (int s = 0; s < ls; ++s) {
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          vo[s].p[k] = vi[s].p[k] - pin[s].p[k] + b * zeta[s].p[k] + c * pzeta[s].p[k];
+        }
+      }
+    }
+  }
+}
+
+inline void multiply_dminus(FermionField5d& out, const FermionField5d& in, const DomainWallMatrix& dwm)
+  // out = D_- in = in - c D_W(-m5) in (out can not be in)
+{
+  TIMER_FLOPS("multiply_dminus");
+  const Geometry& geo = in.geo;
+  const int ls = geo.multiplicity;
+  const double c = dwm.c();
+  const double m5 = dwm.fa.m5;
+  timer.flops += (1320 + 4 * 4 * NUM_COLOR) * geo.local_volume() * ls;
+  Field<HalfWilsonVector> hf;
+  multiply_wilson_hop(out, in, dwm.gf, dwm.dsi, -1, hf);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const Vector<WilsonVector> vi = in.get_elems_const(xl);
+    Vector<WilsonVector> vo = out.get_elems(xl);
+    for (int s = 0; s < ls; ++s) {
+      for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+        vo[s].p[k] = (1.0 - c * (4.0 - m5)) * vi[s].p[k] - c * vo[s].p[k];
+      }
+    }
+  }
+}
+
+inline void dwf_s_matrix_site(Vector<WilsonVector> out, const Vector<WilsonVector> in,
+    const std::vector<double>& mat, const bool is_dag)
+  // out_s = sum_t mat(s, t) in_t (mat(t, s) if is_dag) for the upper and the lower components
+  // (out can not be in)
+{
+  const int ls = in.size();
+  const int h = 2 * NUM_COLOR;
+  for (int chi = 0; chi < 2; ++chi) {
+    const double* m = &mat[chi * ls * ls];
+    for (int s = 0; s < ls; ++s) {
+      Complex* po = &out[s].p[chi * h];
+      for (int k = 0; k < h; ++k) {
+        po[k] = 0.0;
+      }
+      for (int t = 0; t < ls; ++t) {
+        const double c = is_dag ? m[t * ls + s] : m[s * ls + t];
+        if (c == 0.0) {
+          continue;
+        }
+        const Complex* pi = &in[t].p[chi * h];
+        for (int k = 0; k < h; ++k) {
+          po[k] += c * pi[k];
+        }
+      }
+    }
+  }
+}
+
+inline void multiply_dwf_s_matrix(FermionField5d& out, const FermionField5d& in,
+    const std::vector<double>& mat, const DiracSiteIndices& dsi, const int parity, const bool is_dag = false)
+  // out = mat in (mat^T in if is_dag) on the sites of the parity (all the sites if parity is -1)
+  // out can be in, the other parity of out is not changed
+{
+  TIMER_FLOPS("multiply_dwf_s_matrix");
+  const Geometry& geo = in.geo;
+  const int ls = geo.multiplicity;
+  qassert(is_matching_dirac_site_indices(dsi, geo));
+  const std::vector<long>& indices = dsi.get(parity);
+  timer.flops += 4 * ls * ls * 4 * NUM_COLOR * indices.size();
+  out.init(geo_resize(geo));
+  qassert(is_matching_geo_mult(out.geo, geo));
+#pragma omp parallel
+  {
+    std::vector<WilsonVector> buf(ls);
+#pragma omp for
+    for (long i = 0; i < (long)indices.size(); ++i) {
+      const Coordinate xl = geo.coordinate_from_index(indices[i]);
+      dwf_s_matrix_site(get_data(buf), in.get_elems_const(xl), mat, is_dag);
+      assign(out.get_elems(xl), get_data(buf));
+    }
+  }
+}
+
+inline void multiply_m_schur_impl(FermionField5d& out, const FermionField5d& in,
+    const DomainWallMatrix& dwm, const bool is_dag)
+  // see multiply_m_schur and multiply_m_schur_dag
+{
+  TIMER("multiply_m_schur(dwf)");
+  const Geometry& geo = in.geo;
+  const int ls = geo.multiplicity;
+  qassert(ls == dwm.fa.ls);
+  const std::vector<long>& indices = dwm.dsi.get(1);
+  FermionField5d tmp;
+  tmp.init(geo_resize(geo));
+  Field<HalfWilsonVector> hf;
+  if (is_dag) {
+    fermion_field_copy(tmp, in, indices);
+    multiply_gamma5(tmp, dwm.dsi, 1);
+  } else {
+    multiply_dwf_s_matrix(tmp, in, dwm.mat_b, dwm.dsi, 1);
+  }
+  multiply_wilson_hop(tmp, tmp, dwm.gf, dwm.dsi, 0, hf);
+  multiply_dwf_s_matrix(tmp, tmp, dwm.mat_b_a_inv, dwm.dsi, 0, is_dag);
+  multiply_wilson_hop(tmp, tmp, dwm.gf, dwm.dsi, 1, hf);
+  out.init(geo_resize(geo));
+  qassert(is_matching_geo_mult(out.geo, geo));
+#pragma omp parallel
+  {
+    std::vector<WilsonVector> buf(ls), buf5(ls);
+#pragma omp for
+    for (long i = 0; i < (long)indices.size(); ++i) {
+      const Coordinate xl = geo.coordinate_from_index(indices[i]);
+      Vector<WilsonVector> vo = out.get_elems(xl);
+      const Vector<WilsonVector> vt = tmp.get_elems_const(xl);
+      dwf_s_matrix_site(vo, in.get_elems_const(xl), dwm.mat_a, is_dag);
+      if (is_dag) {
+        for (int s = 0; s < ls; ++s) {
+          for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+            buf5[s].p[k] = k < 2 * NUM_COLOR ? vt[s].p[k] : -vt[s].p[k];
+          }
+        }
+        dwf_s_matrix_site(get_data(buf), get_data(buf5), dwm.mat_b, true);
+      } else {
+        assign(get_data(buf), vt);
+      }
+      for (int s = 0; s < ls; ++s) {
+        vo[s] -= buf[s];
+      }
+    }
+  }
+}
+
+inline void multiply_m_schur(FermionField5d& out, const FermionField5d& in, const DomainWallMatrix& dwm)
+  // out_o = M in_o = (A - H B A^-1 H B) in_o (out can not be in)
+  // only the odd sites of in are used and only the odd sites of out are set
+{
+  multiply_m_schur_impl(out, in, dwm, false);
+}
+
+inline void multiply_m_schur_dag(FermionField5d& out, const FermionField5d& in, const DomainWallMatrix& dwm)
+  // out_o = M^dag in_o (out can not be in)
+{
+  multiply_m_schur_impl(out, in, dwm, true);
+}
+
+inline void multiply_mdag_m_schur(FermionField5d& out, const FermionField5d& in, const DomainWallMatrix& dwm)
+  // out_o = M^dag M in_o (out can not be in)
+{
+  FermionField5d tmp;
+  multiply_m_schur(tmp, in, dwm);
+  multiply_m_schur_dag(out, tmp, dwm);
+}
+
+inline void set_dwf_schur_src(FermionField5d& b_o, const FermionField5d& b, const DomainWallMatrix& dwm)
+  // b_o = b_o - H B A^-1 b_e on the odd sites, the even sites of b_o are set to zero (b_o can not be b)
+{
+  TIMER("set_dwf_schur_src");
+  const Geometry geo = geo_resize(b.geo);
+  Field<HalfWilsonVector> hf;
+  FermionField5d tmp;
+  tmp.init(geo);
+  multiply_dwf_s_matrix(tmp, b, dwm.mat_b_a_inv, dwm.dsi, 0);
+  multiply_wilson_hop(tmp, tmp, dwm.gf, dwm.dsi, 1, hf);
+  b_o.init(geo);
+  qassert(is_matching_geo_mult(b_o.geo, geo));
+  set_zero(b_o);
+  fermion_field_copy(b_o, b, dwm.dsi.get(1));
+  fermion_field_axpy(b_o, -1.0, tmp, dwm.dsi.get(1));
+}
+
+inline void set_dwf_schur_sol_even(FermionField5d& x, const FermionField5d& b, const DomainWallMatrix& dwm)
+  // x_e = A^-1 (b_e - H B x_o) from the solution x_o of M x_o = b_o - H B A^-1 b_e
+{
+  TIMER("set_dwf_schur_sol_even");
+  const Geometry& geo = b.geo;
+  Field<HalfWilsonVector> hf;
+  FermionField5d tmp;
+  tmp.init(geo_resize(geo));
+  multiply_dwf_s_matrix(tmp, x, dwm.mat_b, dwm.dsi, 1);
+  multiply_wilson_hop(tmp, tmp, dwm.gf, dwm.dsi, 0, hf);
+  fermion_field_xpay(tmp, -1.0, b, dwm.dsi.get(0));
+  multiply_dwf_s_matrix(x, tmp, dwm.mat_a_inv, dwm.dsi, 0);
+}
+
+inline long cgne_dwf_schur(FermionField5d& x, const FermionField5d& b, const DomainWallMatrix& dwm,
+    const double stop_rsd, const long max_num_iter, double& rsd)
+  // solve M x_o = b_o with CG on M^dag M x_o = M^dag b_o
+  // x_o is the initial guess, only the odd sites of x and b are used
+  // return the number of iterations, rsd is |M^dag (b - M x)| / |M^dag b|
+{
+  TIMER_VERBOSE_FLOPS("cgne_dwf_schur");
+  const Geometry geo = geo_resize(b.geo);
+  const int ls = geo.multiplicity;
+  const std::vector<long>& indices = dwm.dsi.get(1);
+  FermionField5d r, p, q, s;
+  multiply_m_schur_dag(r, b, dwm);
+  const double norm2_src = fermion_field_norm2(r, indices);
+  multiply_m_schur(q, x, dwm);
+  multiply_m_schur_dag(s, q, dwm);
+  double rr = fermion_field_axpy_norm2(r, -1.0, s, indices);
+  p.init(geo);
+  fermion_field_copy(p, r, indices);
+  const double stop2 = sqr(stop_rsd) * norm2_src;
+  long iter = 0;
+  while (rr > stop2 and iter < max_num_iter) {
+    iter += 1;
+    multiply_m_schur(q, p, dwm);
+    const double alpha = rr / fermion_field_norm2(q, indices);
+    fermion_field_axpy(x, alpha, p, indices);
+    multiply_m_schur_dag(s, q, dwm);
+    const double rr_new = fermion_field_axpy_norm2(r, -alpha, s, indices);
+    fermion_field_xpay(p, rr_new / rr, r, indices);
+    rr = rr_new;
+    if (iter % 100 == 0) {
+      displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E", fname, iter, std::sqrt(rr / norm2_src)));
+    }
+  }
+  timer.flops += iter * 4 * 1320 * indices.size() * ls;
+  rsd = std::sqrt(rr / norm2_src);
+  displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E", fname, iter, rsd));
+  return iter;
+}
+
+struct InverterDomainWall
+  // the Inverter of inverse(sol5d, src5d, inv) and inverse_dwf(sol, src, inv) in qcd.h
+{
+  Geometry geo; // of FermionField5d (multiplicity ls)
+  DomainWallMatrix dwm;
+  double stop_rsd;
+  long max_num_iter;
+  //
+  void init()
+  {
+    geo.init();
+    dwm.init();
+    stop_rsd = 1.0e-8;
+    max_num_iter = 10000;
+  }
+  void init(const GaugeField& gf, const FermionAction& fa)
+  {
+    dwm.init(gf, fa);
+    geo = dwm.geo;
+  }
+  //
+  InverterDomainWall()
+  {
+    init();
+  }
+  InverterDomainWall(const GaugeField& gf, const FermionAction& fa)
+  {
+    init();
+    init(gf, fa);
+  }
+};
+
+inline long cgne_dwf(FermionField5d& x, const FermionField5d& b, const DomainWallMatrix& dwm,
+    const double stop_rsd, const long max_num_iter, double& rsd)
+  // solve D x = b with CG on D^dag D x = D^dag b, x is the initial guess
+  // return the number of iterations, rsd is |D^dag (b - D x)| / |D^dag b|
+{
+  TIMER_VERBOSE_FLOPS("cgne_dwf");
+  const Geometry geo = geo_resize(b.geo);
+  const int ls = geo.multiplicity;
+  const std::vector<long>& indices = dwm.dsi.get(-1);
+  FermionField5d r, p, q, s;
+  r.init(geo);
+  p.init(geo);
+  q.init(geo);
+  s.init(geo);
+  multiply_m_dag(r, b, dwm);
+  const double norm2_src = fermion_field_norm2(r, indices);
+  multiply_m(q, x, dwm);
+  multiply_m_dag(s, q, dwm);
+  double rr = fermion_field_axpy_norm2(r, -1.0, s, indices);
+  p = r;
+  const double stop2 = sqr(stop_rsd) * norm2_src;
+  long iter = 0;
+  while (rr > stop2 and iter < max_num_iter) {
+    iter += 1;
+    multiply_m(q, p, dwm);
+    const double alpha = rr / fermion_field_norm2(q, indices);
+    fermion_field_axpy(x, alpha, p, indices);
+    multiply_m_dag(s, q, dwm);
+    const double rr_new = fermion_field_axpy_norm2(r, -alpha, s, indices);
+    fermion_field_xpay(p, rr_new / rr, r, indices);
+    rr = rr_new;
+    if (iter % 100 == 0) {
+      displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E", fname, iter, std::sqrt(rr / norm2_src)));
+    }
+  }
+  timer.flops += iter * 2 * 1800 * geo.local_volume() * ls;
+  rsd = std::sqrt(rr / norm2_src);
+  displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E", fname, iter, rsd));
+  return iter;
+}
+
+inline long inverse(FermionField5d& sol, const FermionField5d& src, const InverterDomainWall& inv)
+  // sol is the initial guess (set to zero if not initialized)
+  // src is multiplied by D_- first if inv.dwm.fa.is_multiplying_dminus
+  // return the number of iterations, see also get_last_inverter_stats()
+{
+  TIMER_VERBOSE("inverse(ff5d,ff5d,inv-dwf)");
+  const DomainWallMatrix& dwm = inv.dwm;
+  const Geometry geo = geo_resize(inv.geo);
+  FermionField5d b;
+  b.init(geo);
+  if (dwm.fa.is_multiplying_dminus) {
+    multiply_dminus(b, src, dwm);
+  } else {
+    b = src;
+  }
+  if (!is_initialized(sol)) {
+    sol.init(geo);
+    set_zero(sol);
+  }
+  InverterStats& stats = get_last_inverter_stats();
+  stats.init();
+  stats.num_iter = cgne_dwf(sol, b, dwm, inv.stop_rsd, inv.max_num_iter, stats.rsd);
+  FermionField5d tmp;
+  multiply_m(tmp, sol, dwm);
+  const std::vector<long>& indices = dwm.dsi.get(-1);
+  stats.true_rsd = std::sqrt(fermion_field_axpy_norm2(tmp, -1.0, b, indices) / fermion_field_norm2(b, indices));
+  displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E ; true rsd = %.4E",
+        fname, stats.num_iter, stats.rsd, stats.true_rsd));
+  return stats.num_iter;
+}
+
+inline long inverse(FermionField4d& sol, const FermionField4d& src, const InverterDomainWall& inv)
+  // through the 5d fields of inverse_dwf
+  // sol do not need to be initialized
+{
+  inverse_dwf(sol, src, inv);
+  return get_last_inverter_stats().num_iter;
+}
+
+QLAT_END_NAMESPACE
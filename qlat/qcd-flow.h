@@ -0,0 +1,264 @@
+#pragma once
+
+#include <qlat/matrix.h>
+#include <qlat/qcd.h>
+#include <qlat/qcd-utils.h>
+#include <qlat/qcd-topology.h>
+
+QLAT_START_NAMESPACE
+
+// Gradient flow (Luscher, arXiv:1006.4518) with the third order Runge-Kutta
+// integrator:
+//
+//   W1 = exp(1/4 Z0) V
+//   W2 = exp(8/9 Z1 - 17/36 Z0) W1
+//   V' = exp(3/4 Z2 - 8/9 Z1 + 17/36 Z0) W2
+//
+// with Zi = epsilon * Z(Wi). The adaptive step size compares V' with the
+// embedded second order result exp(2 Z1 - 5/4 Z0) W1.
+
+struct GradientFlowParams
+{
+  double c1;
+  // coefficient of the 1x2 rectangles in the action, c0 = 1 - 8 c1
+  // 0 for Wilson flow, -1/12 for (tree level) Symanzik flow, -0.331 for Iwasaki
+  double epsilon;
+  // step size (initial step size if is_adaptive)
+  bool is_adaptive;
+  double tolerance;
+  // maximal Frobenius norm of the difference of a link between the third and
+  // second order results
+  double epsilon_max;
+  //
+  void init()
+  {
+    c1 = 0.0;
+    epsilon = 0.01;
+    is_adaptive = false;
+    tolerance = 1.0e-5;
+    epsilon_max = 0.1;
+  }
+  //
+  GradientFlowParams()
+  {
+    init();
+  }
+};
+
+struct GradientFlowWorkspace
+  // buffers reused by all the steps of a flow
+{
+  GaugeField gf1;
+  // expanded copy of the current field
+  GaugeField z;
+  // epsilon * Z of the current substep
+  GaugeField x;
+  // exponent of the current substep
+  GaugeField z0;
+  GaugeField w1;
+  // adaptive: the embedded second order result
+  GaugeField v0;
+  // adaptive: the field before the step (to retry a rejected step)
+};
+
+inline void gf_flow_force_no_comm(GaugeField& z, const GaugeField& gf1, const double epsilon, const double c1)
+  // z = - epsilon * TA(U_mu(x) C_mu(x)^dag)
+  // C_mu(x) = c0 * staples + c1 * rectangular staples
+  // gf1 needs expansion 1 (2 if c1 != 0) in both directions
+{
+  TIMER("gf_flow_force_no_comm");
+  const Geometry geo = geo_resize(gf1.geo);
+  z.init(geo);
+  qassert(is_matching_geo_mult(geo, z.geo));
+  const double c0 = 1.0 - 8.0 * c1;
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> v = z.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      ColorMatrix staple = c0 * gf_staple_no_comm(gf1, xl, mu);
+      if (0.0 != c1) {
+        staple += c1 * gf_rectangular_staple_no_comm(gf1, xl, mu);
+      }
+      v[mu] = -epsilon * make_tr_less_anti_herm_matrix(gf1.get_elem(xl, mu) * matrix_adjoint(staple));
+    }
+  }
+}
+
+inline void gf_flow_force(GradientFlowWorkspace& ws, const GaugeField& gf, const double epsilon, const double c1)
+  // ws.z = epsilon * Z(gf)
+{
+  const int thick = 0.0 == c1 ? 1 : 2;
+  const Geometry geo1 = geo_resize(gf.geo, thick);
+  if (!is_initialized(ws.gf1) || ws.gf1.geo != geo1) {
+    ws.gf1.init(geo1);
+  }
+  ws.gf1 = gf;
+  refresh_expanded(ws.gf1);
+  gf_flow_force_no_comm(ws.z, ws.gf1, epsilon, c1);
+}
+
+inline void gf_flow_update(GaugeField& gf, GaugeField& x, const GaugeField& z, const double cz, const double cx)
+  // x = cz * z + cx * x ; gf = exp(x) * gf
+{
+  TIMER("gf_flow_update");
+  const Geometry& geo = gf.geo;
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> vgf = gf.get_elems(xl);
+    Vector<ColorMatrix> vx = x.get_elems(xl);
+    const Vector<ColorMatrix> vz = z.get_elems_const(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      vx[mu] = cz * vz[mu] + cx * vx[mu];
+      vgf[mu] = make_color_matrix_exp_cayley_hamilton(vx[mu]) * vgf[mu];
+    }
+  }
+}
+
+inline double gf_max_link_distance(const GaugeField& gf1, const GaugeField& gf2)
+  // maximal Frobenius norm of the difference of a link
+{
+  TIMER("gf_max_link_distance");
+  const Geometry& geo = gf1.geo;
+  std::vector<double> maxs(omp_get_max_threads(), 0.0);
+#pragma omp parallel
+  {
+    double& m = maxs[omp_get_thread_num()];
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      const Vector<ColorMatrix> v1 = gf1.get_elems_const(xl);
+      const Vector<ColorMatrix> v2 = gf2.get_elems_const(xl);
+      for (int mu = 0; mu < DIMN; ++mu) {
+        m = std::max(m, norm(v1[mu] - v2[mu]));
+      }
+    }
+  }
+  double ret = *std::max_element(maxs.begin(), maxs.end());
+  glb_max(ret, geo.geon.comm);
+  return std::sqrt(ret);
+}
+
+inline double gf_flow_step(GaugeField& gf, GradientFlowWorkspace& ws, const double epsilon, const double c1,
+    const bool is_error_estimate = false)
+  // one RK3 step of size epsilon
+  // return the distance to the embedded second order result if is_error_estimate
+{
+  TIMER("gf_flow_step");
+  const Geometry geo = geo_resize(gf.geo);
+  ws.x.init(geo);
+  gf_flow_force(ws, gf, epsilon, c1);
+  if (is_error_estimate) {
+    ws.z0 = ws.z;
+  }
+  gf_flow_update(gf, ws.x, ws.z, 1.0 / 4.0, 0.0);
+  if (is_error_estimate) {
+    ws.w1 = gf;
+  }
+  gf_flow_force(ws, gf, epsilon, c1);
+  if (is_error_estimate) {
+    // ws.z0 = 2 Z1 - 5/4 Z0 ; ws.w1 = exp(ws.z0) W1
+    gf_flow_update(ws.w1, ws.z0, ws.z, 2.0, -5.0 / 4.0);
+  }
+  // 8/9 Z1 - 17/36 Z0 = 8/9 Z1 - 17/9 X
+  gf_flow_update(gf, ws.x, ws.z, 8.0 / 9.0, -17.0 / 9.0);
+  gf_flow_force(ws, gf, epsilon, c1);
+  // 3/4 Z2 - 8/9 Z1 + 17/36 Z0 = 3/4 Z2 - X
+  gf_flow_update(gf, ws.x, ws.z, 3.0 / 4.0, -1.0);
+  if (is_error_estimate) {
+    return gf_max_link_distance(gf, ws.w1);
+  }
+  return 0.0;
+}
+
+template <class F>
+inline void gf_flow(GaugeField& gf, const std::vector<double>& ts, F& hook, const GradientFlowParams& gfp)
+  // flow from t = 0 to the last of ts (sorted) and call hook(t, gf) at each t
+  // in ts; steps are shortened to end exactly at these times
+{
+  TIMER_VERBOSE("gf_flow");
+  GradientFlowWorkspace ws;
+  double t = 0.0;
+  double epsilon = gfp.epsilon;
+  long num_step = 0;
+  long num_reject = 0;
+  for (size_t i = 0; i < ts.size(); ++i) {
+    qassert(ts[i] >= t);
+    while (ts[i] - t > 1.0e-12) {
+      const double eps = std::min(epsilon, ts[i] - t);
+      if (!gfp.is_adaptive) {
+        gf_flow_step(gf, ws, eps, gfp.c1);
+        t += eps;
+        num_step += 1;
+        continue;
+      }
+      ws.v0 = gf;
+      const double dist = gf_flow_step(gf, ws, eps, gfp.c1, true);
+      const double fac = 0.0 == dist ? 2.0 : 0.95 * std::pow(gfp.tolerance / dist, 1.0 / 3.0);
+      if (dist <= gfp.tolerance) {
+        t += eps;
+        num_step += 1;
+      } else {
+        gf = ws.v0;
+        num_reject += 1;
+      }
+      epsilon = std::min(gfp.epsilon_max, eps * std::max(0.2, std::min(2.0, fac)));
+    }
+    t = ts[i];
+    hook(t, gf);
+  }
+  displayln_info(ssprintf("%s: t = %.6f ; num_step = %ld ; num_reject = %ld", fname, t, num_step, num_reject));
+}
+
+inline void gf_flow(GaugeField& gf, const double t, const GradientFlowParams& gfp)
+  // flow to time t without measurements
+{
+  struct NoHook
+  {
+    void operator()(const double t, const GaugeField& gf)
+    {
+    }
+  } hook;
+  gf_flow(gf, std::vector<double>(1, t), hook, gfp);
+}
+
+struct GradientFlowObservables
+  // hook for gf_flow recording gf_observables at each flow time
+{
+  std::vector<std::string> names;
+  // empty means all registered observables
+  std::vector<double> ts;
+  std::vector<GaugeObservables> gos;
+  //
+  void operator()(const double t, const GaugeField& gf)
+  {
+    TIMER_VERBOSE("GradientFlowObservables");
+    ts.push_back(t);
+    gos.push_back(gf_observables(gf, names));
+    const GaugeObservables& go = gos.back();
+    std::string s = ssprintf("t = %10.6f", t);
+    for (size_t i = 0; i < go.names.size(); ++i) {
+      s += " ; " + go.names[i] + " = " + show(go.values[i]);
+    }
+    displayln_info(s);
+  }
+};
+
+inline double find_flow_scale(const GradientFlowObservables& gfo, const double target = 0.3)
+  // t0 with t0^2 <E(t0)> = target from linear interpolation of t^2 clf_energy
+  // return -1 if not reached
+{
+  for (size_t i = 1; i < gfo.ts.size(); ++i) {
+    const double t_a = gfo.ts[i-1];
+    const double t_b = gfo.ts[i];
+    const double y_a = t_a * t_a * gfo.gos[i-1].get("clf_energy");
+    const double y_b = t_b * t_b * gfo.gos[i].get("clf_energy");
+    if (y_a < target && y_b >= target) {
+      return t_a + (t_b - t_a) * (target - y_a) / (y_b - y_a);
+    }
+  }
+  return -1.0;
+}
+
+QLAT_END_NAMESPACE
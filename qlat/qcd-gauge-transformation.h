@@ -2,6 +2,7 @@
 
 #include <qlat/qcd.h>
 #include <qlat/qcd-utils.h>
+#include <qlat/qcd-smear.h>
 
 QLAT_START_NAMESPACE
 
@@ -89,41 +90,14 @@ inline void make_temporal_gauge_transformation(GaugeTransform& gt, const GaugeFi
   // after tranform: ``gf.get_elem(xl, dir) = unit'' is true from ``xg[dir] = tgref''
   // until as far as possible
   // ``gt.get_elem(xl) = unit'' if ``xg[dir] = tgref''
+  // gt(x) is the line along dir from xg[dir] = tgref to x, see gf_dir_line_scan
 {
   TIMER("make_temporal_gauge_transformation");
   const Geometry geo = geo_reform(gf.geo, 0);
   gt.init(geo);
   assert(is_matching_geo(gt.geo, gf.geo));
-  Coordinate expension_left, expension_right;
-  set_zero(expension_left);
-  set_zero(expension_right);
-  expension_left[dir] = 1;
-  const Geometry geo1 = geo_resize(geo, expension_left, expension_right);
-  GaugeField gf1;
-  gf1.init(geo1);
-  gf1 = gf;
-  refresh_expanded(gf1);
-  GaugeTransform gt1;
-  gt1.init(geo1);
-  set_unit(gt1);
-  const Coordinate total_site = geo.total_site();
-  for (int tgrel = 1; tgrel < total_site[dir]; ++tgrel) {
-    refresh_expanded(gt1);
-    const int tg = mod(tgref + tgrel, total_site[dir]);
-#pragma omp parallel for
-    for (long index = 0; index < geo.local_volume(); ++index) {
-      Coordinate xl = geo.coordinate_from_index(index);
-      Coordinate xg = geo.coordinate_g_from_l(xl);
-      if (tg == xg[dir]) {
-        ColorMatrix& t1 = gt1.get_elem(xl);
-        xl[dir] -= 1;
-        const ColorMatrix& v = gf1.get_elem(xl, dir);
-        const ColorMatrix& t0 = gt1.get_elem(xl);
-        t1 = t0 * v;
-      }
-    }
-  }
-  gt = gt1;
+  FieldM<ColorMatrix,1> lt;
+  gf_dir_line_scan(gt, lt, gf, dir, tgref);
 }
 
 inline void make_tree_gauge_transformation(GaugeTransform& gt, const GaugeField& gf,
@@ -148,6 +122,279 @@ inline void make_tree_gauge_transformation(GaugeTransform& gt, const GaugeField&
   }
 }
 
+// Landau (Coulomb) gauge fixing maximizes
+//
+//   F = sum_x sum_nu Re tr U_nu(x)
+//
+// over the gauge transformations, with nu spatial and every time slice on
+// its own for Coulomb gauge. The gradient is
+//
+//   Delta(x) = TA(sum_nu U_nu(x - nu) - U_nu(x))
+//
+// and the gauge is fixed when theta = |Delta|^2 / (NUM_COLOR * volume) is
+// below the tolerance. The main method is the Fourier accelerated steepest
+// descent (Davies et al, PRD 37, 1581 (1988)),
+//
+//   g(x) = exp(alpha F^-1 (p2_max / p2) F Delta(x))
+//
+// with overrelaxed Los Alamos sweeps (Mandula & Ogilvie) as the fallback.
+
+struct GaugeFixParams
+{
+  bool is_coulomb;
+  // Coulomb gauge, each time slice converges on its own
+  double alpha;
+  // step size of the Fourier accelerated steepest descent
+  double tolerance;
+  // for theta (of each time slice for Coulomb gauge)
+  long max_iter;
+  // steepest descent iterations before falling back to overrelaxation
+  double omega;
+  // overrelaxation parameter, 1 < omega < 2
+  long max_iter_or;
+  //
+  void init()
+  {
+    is_coulomb = false;
+    alpha = 0.08;
+    tolerance = 1.0e-12;
+    max_iter = 1000;
+    omega = 1.7;
+    max_iter_or = 5000;
+  }
+  //
+  GaugeFixParams()
+  {
+    init();
+  }
+};
+
+inline std::vector<double> gf_gauge_fix_gradient_no_comm(GaugeTransform& delta, const GaugeField& gf1, const bool is_coulomb)
+  // delta(x) = TA(sum_nu U_nu(x - nu) - U_nu(x))
+  // return theta of each time slice (after the global sum)
+  // gf1 need expansion_left 1
+{
+  TIMER("gf_gauge_fix_gradient_no_comm");
+  const Geometry geo = geo_reform(gf1.geo);
+  delta.init(geo);
+  qassert(is_matching_geo(delta.geo, geo));
+  const int n_nu = is_coulomb ? DIMN - 1 : DIMN;
+  const int size_t_node = geo.node_site[DIMN-1];
+  std::vector<double> thetas(geo.total_site()[DIMN-1], 0.0);
+  std::vector<double> local_thetas(size_t_node, 0.0);
+#pragma omp parallel
+  {
+    std::vector<double> sums(size_t_node, 0.0);
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      Coordinate xl = geo.coordinate_from_index(index);
+      ColorMatrix m;
+      set_zero(m);
+      for (int nu = 0; nu < n_nu; ++nu) {
+        m -= gf1.get_elem(xl, nu);
+        xl[nu] -= 1;
+        m += gf1.get_elem(xl, nu);
+        xl[nu] += 1;
+      }
+      ColorMatrix& d = delta.get_elem(xl);
+      d = make_tr_less_anti_herm_matrix(m);
+      sums[xl[DIMN-1]] += norm(d);
+    }
+#pragma omp critical
+    for (int t = 0; t < size_t_node; ++t) {
+      local_thetas[t] += sums[t];
+    }
+  }
+  const double coef = 1.0 / (NUM_COLOR * (is_coulomb ? geo.total_volume() / thetas.size() : geo.total_volume()));
+  const int t_start = geo.geon.coor_node[DIMN-1] * size_t_node;
+  for (int t = 0; t < size_t_node; ++t) {
+    thetas[t_start + t] = coef * local_thetas[t];
+  }
+  glb_sum_double_vec(get_data(thetas), geo.geon.comm);
+  return thetas;
+}
+
+inline void gf_gauge_fix_fourier_accelerate(GaugeTransform& delta, const bool is_coulomb)
+  // delta <- F^-1 (p2_max / p2) F delta, the zero mode is removed
+  // the spatial directions only for Coulomb gauge
+{
+  TIMER("gf_gauge_fix_fourier_accelerate");
+  const Geometry& geo = delta.geo;
+  const Coordinate total_site = geo.total_site();
+  const int n_mu = is_coulomb ? DIMN - 1 : DIMN;
+  Coordinate dirs;
+  for (int mu = 0; mu < n_mu; ++mu) {
+    set_zero(dirs);
+    dirs[mu] = 1;
+    fft_complex_field_dirs(delta, dirs);
+  }
+  const double p2_max = 4.0 * n_mu;
+  double vol = 1.0;
+  for (int mu = 0; mu < n_mu; ++mu) {
+    vol *= total_site[mu];
+  }
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const Coordinate kg = geo.coordinate_g_from_l(xl);
+    double p2 = 0.0;
+    for (int mu = 0; mu < n_mu; ++mu) {
+      p2 += 4.0 * sqr(std::sin(PI * kg[mu] / total_site[mu]));
+    }
+    ColorMatrix& d = delta.get_elem(xl);
+    if (p2 < 1.0e-12) {
+      set_zero(d);
+    } else {
+      d *= p2_max / (p2 * vol);
+    }
+  }
+  for (int mu = 0; mu < n_mu; ++mu) {
+    set_zero(dirs);
+    dirs[mu] = -1;
+    fft_complex_field_dirs(delta, dirs);
+  }
+}
+
+inline void gf_gauge_fix_steepest_descent_no_comm(GaugeTransform& g, const GaugeTransform& delta, const double alpha,
+    const std::vector<int>& is_done)
+  // g(x) = exp(alpha TA(delta(x))), unit in the time slices that are done
+{
+  TIMER("gf_gauge_fix_steepest_descent_no_comm");
+  const Geometry& geo = delta.geo;
+  g.init(geo);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const Coordinate xg = geo.coordinate_g_from_l(xl);
+    ColorMatrix& gx = g.get_elem(xl);
+    if (is_done[xg[DIMN-1]]) {
+      set_unit(gx);
+    } else {
+      gx = make_color_matrix_exp_cayley_hamilton(alpha * make_tr_less_anti_herm_matrix(delta.get_elem(xl)));
+    }
+  }
+}
+
+inline ColorMatrix color_matrix_sub_overrelax(const ColorMatrix& y, const int ind, const double omega)
+  // y is the SU(2) subgroup matrix from color_matrix_sub_inverse(x, ind)
+  // return y^omega approximated by the normalized 1 + omega (y - 1)
+{
+  const int su2_index[][2] = {
+    {0,1},
+    {0,2},
+    {1,2}
+  };
+  const int i1 = su2_index[ind][0];
+  const int i2 = su2_index[ind][1];
+  ColorMatrix z;
+  set_unit(z);
+  z += omega * (y - z);
+  const double s = 1.0 / std::sqrt(std::norm(z(i1,i1)) + std::norm(z(i1,i2)));
+  z(i1,i1) *= s;
+  z(i1,i2) *= s;
+  z(i2,i1) *= s;
+  z(i2,i2) *= s;
+  return z;
+}
+
+inline void gf_gauge_fix_overrelax_no_comm(GaugeTransform& g, const GaugeField& gf1, const int parity,
+    const double omega, const bool is_coulomb, const std::vector<int>& is_done)
+  // g(x) maximizes Re tr(g(x) w(x)), w(x) = sum_nu U_nu(x) + U_nu(x - nu)^dag, with
+  // one overrelaxed hit of each SU(2) subgroup on the sites of parity, unit elsewhere
+  // gf1 need expansion_left 1
+{
+  TIMER("gf_gauge_fix_overrelax_no_comm");
+  const Geometry geo = geo_reform(gf1.geo);
+  g.init(geo);
+  const int n_nu = is_coulomb ? DIMN - 1 : DIMN;
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    Coordinate xl = geo.coordinate_from_index(index);
+    const Coordinate xg = geo.coordinate_g_from_l(xl);
+    ColorMatrix& gx = g.get_elem(xl);
+    set_unit(gx);
+    if (is_done[xg[DIMN-1]] || parity != mod(sum(xg), 2)) {
+      continue;
+    }
+    ColorMatrix w;
+    set_zero(w);
+    for (int nu = 0; nu < n_nu; ++nu) {
+      w += gf1.get_elem(xl, nu);
+      xl[nu] -= 1;
+      w += matrix_adjoint(gf1.get_elem(xl, nu));
+      xl[nu] += 1;
+    }
+    for (int ind = 0; ind < 3; ++ind) {
+      gx = color_matrix_sub_overrelax(color_matrix_sub_inverse(gx * w, ind), ind, omega) * gx;
+    }
+    unitarize(gx);
+  }
+}
+
+inline bool gf_gauge_fix(GaugeField& gf, GaugeTransform& gt, const GaugeFixParams& gfp = GaugeFixParams())
+  // fix gf in place, gt <- g gt accumulates the transformations applied
+  // (gt is set to unit if not initialized)
+  // return whether theta (of every time slice for Coulomb gauge) < tolerance
+{
+  TIMER_VERBOSE("gf_gauge_fix");
+  const Geometry geo = geo_reform(gf.geo);
+  if (!is_initialized(gt)) {
+    gt.init(geo);
+    set_unit(gt);
+  }
+  qassert(is_matching_geo(gt.geo, geo));
+  const Coordinate expansion_left(1, 1, 1, 1);
+  const Coordinate expansion_right(0, 0, 0, 0);
+  GaugeField gf1;
+  gf1.init(geo_resize(geo, expansion_left, expansion_right));
+  GaugeTransform delta, g;
+  const int t_size = geo.total_site()[DIMN-1];
+  std::vector<int> is_done(t_size, 0);
+  long iter = 0;
+  double theta = 0.0;
+  for (; iter < gfp.max_iter + gfp.max_iter_or; ++iter) {
+    gf1 = gf;
+    refresh_expanded(gf1);
+    const std::vector<double> thetas = gf_gauge_fix_gradient_no_comm(delta, gf1, gfp.is_coulomb);
+    long num_done = 0;
+    theta = 0.0;
+    for (int t = 0; t < t_size; ++t) {
+      if (gfp.is_coulomb) {
+        is_done[t] = thetas[t] < gfp.tolerance;
+        num_done += is_done[t];
+        theta = std::max(theta, thetas[t]);
+      } else {
+        theta += thetas[t];
+      }
+    }
+    if (0 == iter % 100) {
+      displayln_info(ssprintf("%s: iter = %5ld ; theta = %.4E ; slices done = %ld", fname, iter, theta, num_done));
+    }
+    if (theta < gfp.tolerance) {
+      break;
+    }
+    if (iter < gfp.max_iter) {
+      gf_gauge_fix_fourier_accelerate(delta, gfp.is_coulomb);
+      gf_gauge_fix_steepest_descent_no_comm(g, delta, gfp.alpha, is_done);
+      gf_apply_gauge_transformation(gf, gf, g);
+      gt_apply_gauge_transformation(gt, g);
+    } else {
+      for (int parity = 0; parity < 2; ++parity) {
+        if (1 == parity) {
+          gf1 = gf;
+          refresh_expanded(gf1);
+        }
+        gf_gauge_fix_overrelax_no_comm(g, gf1, parity, gfp.omega, gfp.is_coulomb, is_done);
+        gf_apply_gauge_transformation(gf, gf, g);
+        gt_apply_gauge_transformation(gt, g);
+      }
+    }
+  }
+  displayln_info(ssprintf("%s: iter = %5ld ; theta = %.4E ; %s", fname, iter, theta,
+        theta < gfp.tolerance ? "converged" : "not converged"));
+  return theta < gfp.tolerance;
+}
+
 struct FourInterval: std::pair<Coordinate, Coordinate>
 {
 	virtual const std::string& cname()
@@ -189,6 +436,8 @@ inline void make_local_deflation_plan(std::vector<U1GaugeTransform>& u1gts,
 	global_partition.resize(Np);
 
 	for(int i = 0; i < Np; i++){
+		GlbSumBatch gsb; // all sums of this partition in one reduction
+		std::vector<GlbSumFuture<long> > num_flips(4);
 		Printf("partition #%04d:\n", i);
 		Coordinate partition_coor = qlat::coordinate_from_index(i, tw_par);
 		for(int mu = 0; mu < 4; mu++){
@@ -214,8 +463,7 @@ inline void make_local_deflation_plan(std::vector<U1GaugeTransform>& u1gts,
 					// if(i == 31 and mu == 3) printf("(%02d,%02d,%02d,%02d)[%04d]: NO. \n", global_coor[0], global_coor[1], global_coor[2], global_coor[3], count);
 				}
 			}
-			glb_sum(num_flip);
-			Printf("flipped %08d times\n", num_flip);
+			num_flips[mu] = gsb.add(num_flip);
 		}
 		double sum_real = 0.;
 		double sum_imag = 0.;
@@ -224,10 +472,13 @@ inline void make_local_deflation_plan(std::vector<U1GaugeTransform>& u1gts,
 				sum_real += u1gts[i].field[index].real();
 				sum_imag += u1gts[i].field[index].imag();
 		}
-		glb_sum(sum_real);
-		glb_sum(sum_imag);
-		Printf("sum_real = %.8E\n", sum_real);
-		Printf("sum_imag = %.8E\n", sum_imag);
+		const GlbSumFuture<Complex> sum = gsb.add(Complex(sum_real, sum_imag));
+		gsb.start();
+		for(int mu = 0; mu < 4; mu++){
+			Printf("direction = %03d, flipped %08ld times\n", mu, num_flips[mu].get());
+		}
+		Printf("sum_real = %.8E\n", sum.get().real());
+		Printf("sum_imag = %.8E\n", sum.get().imag());
 	}
 
 }
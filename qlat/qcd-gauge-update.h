@@ -0,0 +1,304 @@
+#pragma once
+
+#include <qlat/matrix.h>
+#include <qlat/qcd.h>
+#include <qlat/qcd-utils.h>
+#include <qlat/qcd-smear.h>
+#include <qlat/field-rng.h>
+#include <qlat/field-comm.h>
+
+QLAT_START_NAMESPACE
+
+// Quenched update of GaugeField with the Cabibbo-Marinari pseudo-heatbath
+// (Kennedy-Pendleton SU(2) heatbath, Creutz at small coupling) and
+// overrelaxation, for the action
+//
+//   S = beta sum_x [ c0 sum_P (1 - Re tr P / 3) + c1 sum_R (1 - Re tr R / 3) ]
+//
+// with c0 = 1 - 8 c1 and c1 = gauge.c1 (0 for Wilson, -0.331 for Iwasaki).
+//
+// The links of one direction mu are updated in parallel on one class of
+// sites at a time. The links updated together must not appear in each
+// other's staples:
+//
+//   c1 == 0   2 classes, mod(sum(x), 2)
+//   c1 != 0   8 classes, mod(x[mu], 2) + 2 mod(sum_{nu != mu} x[nu], 4)
+//
+// After each class only the links just updated are exchanged, so a sweep
+// moves as many bytes as one refresh_expanded of the field. The randomness
+// comes from the RngField, one state per site, so the result does not depend
+// on the node layout.
+
+inline int gf_update_num_classes(const double c1)
+{
+  return 0.0 == c1 ? 2 : 8;
+}
+
+inline int gf_update_class(const Coordinate& xg, const int mu, const int num_classes)
+{
+  if (2 == num_classes) {
+    return mod(sum(xg), 2);
+  } else {
+    qassert(8 == num_classes);
+    return mod(xg[mu], 2) + 2 * mod(sum(xg) - xg[mu], 4);
+  }
+}
+
+inline void set_marks_field_gf_update_class(CommMarks& marks, const Geometry& geo, const std::string& tag)
+  // tag is "mu class num_classes"
+  // mark the link mu of the expanded sites in the class
+{
+  TIMER_VERBOSE("set_marks_field_gf_update_class");
+  int mu, cls, num_classes;
+  qassert(3 == sscanf(tag.c_str(), "%d %d %d", &mu, &cls, &num_classes));
+  qassert(0 <= mu && mu < geo.multiplicity);
+  marks.init();
+  marks.init(geo);
+#pragma omp parallel for
+  for (long offset = 0; offset < geo.local_volume_expanded() * geo.multiplicity; offset += geo.multiplicity) {
+    const Coordinate xl = geo.coordinate_from_offset(offset);
+    if (geo.is_local(xl)) {
+      continue;
+    }
+    const Coordinate xg = geo.coordinate_g_from_l(xl);
+    if (cls == gf_update_class(xg, mu, num_classes)) {
+      marks.get_elem(offset + mu) = 1;
+    }
+  }
+}
+
+inline ColorMatrix make_color_matrix_sub_su2(const int ind, const double a0, const double a1, const double a2, const double a3)
+  // a0 + i a . sigma in the su2 subgroup ind (same layout as color_matrix_sub_inverse)
+  // a should be normalized
+{
+  const int su2_index[][2] = {
+    {0,1},
+    {0,2},
+    {1,2}
+  };
+  const int i1 = su2_index[ind][0];
+  const int i2 = su2_index[ind][1];
+  ColorMatrix y;
+  set_unit(y);
+  y(i1,i1) = Complex( a0, a3);
+  y(i2,i2) = Complex( a0,-a3);
+  y(i1,i2) = Complex( a2, a1);
+  y(i2,i1) = Complex(-a2, a1);
+  return y;
+}
+
+inline double su2_heatbath_a0(RngState& rs, const double alpha)
+  // a0 distributed as sqrt(1 - a0^2) exp(alpha a0) in [-1, 1]
+{
+  if (alpha > 1.0) {
+    // Kennedy-Pendleton
+    while (true) {
+      const double r1 = 1.0 - u_rand_gen(rs);
+      const double r2 = u_rand_gen(rs);
+      const double r3 = 1.0 - u_rand_gen(rs);
+      const double r4 = u_rand_gen(rs);
+      const double c = std::cos(2.0 * PI * r2);
+      const double lambda2 = -(std::log(r1) + c * c * std::log(r3)) / (2.0 * alpha);
+      if (r4 * r4 <= 1.0 - lambda2) {
+        return 1.0 - 2.0 * lambda2;
+      }
+    }
+  } else {
+    // Creutz
+    const double e = alpha > 1.0e-8 ? std::exp(-2.0 * alpha) : 1.0;
+    while (true) {
+      const double r = u_rand_gen(rs);
+      const double a0 = alpha > 1.0e-8 ? 1.0 + std::log(e + (1.0 - e) * r) / alpha : 2.0 * r - 1.0;
+      if (sqr(u_rand_gen(rs)) <= 1.0 - a0 * a0) {
+        return a0;
+      }
+    }
+  }
+}
+
+inline ColorMatrix color_matrix_sub_heatbath(RngState& rs, const ColorMatrix& w, const int ind, const double beta)
+  // return r in the su2 subgroup ind distributed as exp(beta / 3 Re tr(r w))
+{
+  const ColorMatrix y = color_matrix_sub_inverse(w, ind);
+  // Re tr(r w) = |p| a0 with r = a y, |p| as in color_matrix_sub_inverse
+  const ColorMatrix yw = y * w;
+  const int su2_index[][2] = {
+    {0,1},
+    {0,2},
+    {1,2}
+  };
+  const double p = yw(su2_index[ind][0],su2_index[ind][0]).real() + yw(su2_index[ind][1],su2_index[ind][1]).real();
+  const double a0 = su2_heatbath_a0(rs, beta / 3.0 * p);
+  const double ar = std::sqrt(std::max(0.0, 1.0 - a0 * a0));
+  const double cos_theta = u_rand_gen(rs, 1.0, -1.0);
+  const double sin_theta = std::sqrt(std::max(0.0, 1.0 - cos_theta * cos_theta));
+  const double phi = u_rand_gen(rs, 2.0 * PI, 0.0);
+  const ColorMatrix a = make_color_matrix_sub_su2(ind, a0,
+      ar * sin_theta * std::cos(phi), ar * sin_theta * std::sin(phi), ar * cos_theta);
+  return a * y;
+}
+
+inline ColorMatrix gf_update_staple_no_comm(const GaugeField& gf1, const Coordinate& xl, const int mu, const double c1)
+  // c0 * staples + c1 * rectangular staples
+  // gf1 needs expansion 1 (2 if c1 != 0) in both directions
+{
+  ColorMatrix staple = (1.0 - 8.0 * c1) * gf_staple_no_comm(gf1, xl, mu);
+  if (0.0 != c1) {
+    staple += c1 * gf_rectangular_staple_no_comm(gf1, xl, mu);
+  }
+  return staple;
+}
+
+inline void gf_heatbath_no_comm(GaugeField& gf1, RngField& rf, const int mu, const int cls,
+    const double beta, const double c1)
+  // heatbath of the links mu of the local sites in the class, one hit per su2 subgroup
+{
+  TIMER("gf_heatbath_no_comm");
+  const Geometry& geo = rf.geo;
+  const int num_classes = gf_update_num_classes(c1);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const Coordinate xg = geo.coordinate_g_from_l(xl);
+    if (cls != gf_update_class(xg, mu, num_classes)) {
+      continue;
+    }
+    RngState& rs = rf.get_elem(xl);
+    ColorMatrix& u = gf1.get_elem(xl, mu);
+    ColorMatrix w = u * matrix_adjoint(gf_update_staple_no_comm(gf1, xl, mu, c1));
+    for (int ind = 0; ind < 3; ++ind) {
+      const ColorMatrix r = color_matrix_sub_heatbath(rs, w, ind, beta);
+      u = r * u;
+      w = r * w;
+    }
+    unitarize(u);
+  }
+}
+
+inline void gf_overrelax_no_comm(GaugeField& gf1, const int mu, const int cls, const double c1)
+  // microcanonical reflection of the links mu of the local sites in the class
+  // in each su2 subgroup, the action is unchanged
+{
+  TIMER("gf_overrelax_no_comm");
+  const Geometry geo = geo_reform(gf1.geo);
+  const int num_classes = gf_update_num_classes(c1);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const Coordinate xg = geo.coordinate_g_from_l(xl);
+    if (cls != gf_update_class(xg, mu, num_classes)) {
+      continue;
+    }
+    ColorMatrix& u = gf1.get_elem(xl, mu);
+    ColorMatrix w = u * matrix_adjoint(gf_update_staple_no_comm(gf1, xl, mu, c1));
+    for (int ind = 0; ind < 3; ++ind) {
+      const ColorMatrix y = color_matrix_sub_inverse(w, ind);
+      const ColorMatrix r = y * y;
+      u = r * u;
+      w = r * w;
+    }
+    unitarize(u);
+  }
+}
+
+inline void gf_update_check_geo(const Geometry& geo, const double c1)
+{
+  const Coordinate total_site = geo.total_site();
+  for (int mu = 0; mu < DIMN; ++mu) {
+    qassert(0 == total_site[mu] % (0.0 == c1 ? 2 : 4));
+  }
+}
+
+inline void gf_heatbath(GaugeField& gf, RngField& rf, const double beta, const Gauge& gauge)
+  // one heatbath sweep
+  // rf should have the geometry of gf (without expansion)
+{
+  TIMER_VERBOSE("gf_heatbath");
+  const double c1 = gauge.c1;
+  gf_update_check_geo(gf.geo, c1);
+  const int num_classes = gf_update_num_classes(c1);
+  GaugeField gf1;
+  gf1.init(geo_resize(gf.geo, 0.0 == c1 ? 1 : 2));
+  gf1 = gf;
+  refresh_expanded(gf1);
+  for (int mu = 0; mu < DIMN; ++mu) {
+    for (int cls = 0; cls < num_classes; ++cls) {
+      gf_heatbath_no_comm(gf1, rf, mu, cls, beta, c1);
+      refresh_expanded(gf1, set_marks_field_gf_update_class, ssprintf("%d %d %d", mu, cls, num_classes));
+    }
+  }
+  gf = gf1;
+}
+
+inline void gf_overrelax(GaugeField& gf, const Gauge& gauge)
+  // one overrelaxation sweep
+{
+  TIMER_VERBOSE("gf_overrelax");
+  const double c1 = gauge.c1;
+  gf_update_check_geo(gf.geo, c1);
+  const int num_classes = gf_update_num_classes(c1);
+  GaugeField gf1;
+  gf1.init(geo_resize(gf.geo, 0.0 == c1 ? 1 : 2));
+  gf1 = gf;
+  refresh_expanded(gf1);
+  for (int mu = 0; mu < DIMN; ++mu) {
+    for (int cls = 0; cls < num_classes; ++cls) {
+      gf_overrelax_no_comm(gf1, mu, cls, c1);
+      refresh_expanded(gf1, set_marks_field_gf_update_class, ssprintf("%d %d %d", mu, cls, num_classes));
+    }
+  }
+  gf = gf1;
+}
+
+inline void gf_quenched_update(GaugeField& gf, RngField& rf, const double beta, const Gauge& gauge, const int n_or = 4)
+  // one heatbath sweep followed by n_or overrelaxation sweeps
+{
+  TIMER_VERBOSE("gf_quenched_update");
+  gf_heatbath(gf, rf, beta, gauge);
+  for (int i = 0; i < n_or; ++i) {
+    gf_overrelax(gf, gauge);
+  }
+}
+
+inline double gf_avg_gauge_action_density(const GaugeField& gf, const Gauge& gauge)
+  // S / beta / total_volume
+  //   = c0 * 6 * (1 - avg plaq) + c1 * 12 * (1 - avg rectangle)
+{
+  TIMER("gf_avg_gauge_action_density");
+  const double c1 = gauge.c1;
+  GaugeField gf1;
+  gf1.init(geo_resize(gf.geo, 0.0 == c1 ? 1 : 2));
+  gf1 = gf;
+  refresh_expanded(gf1);
+  const Geometry& geo = gf.geo;
+  std::vector<double> sums(2 * omp_get_max_threads(), 0.0);
+#pragma omp parallel
+  {
+    double sum_plaq = 0.0;
+    double sum_rect = 0.0;
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      for (int mu = 0; mu < DIMN; ++mu) {
+        const ColorMatrix& u = gf1.get_elem(xl, mu);
+        // each plaquette has 4 links and each rectangle has 6
+        sum_plaq += matrix_trace(u * matrix_adjoint(gf_staple_no_comm(gf1, xl, mu))).real() / NUM_COLOR / 4.0;
+        if (0.0 != c1) {
+          sum_rect += matrix_trace(u * matrix_adjoint(gf_rectangular_staple_no_comm(gf1, xl, mu))).real() / NUM_COLOR / 6.0;
+        }
+      }
+    }
+    sums[2 * omp_get_thread_num()] = sum_plaq;
+    sums[2 * omp_get_thread_num() + 1] = sum_rect;
+  }
+  std::vector<double> sum(2, 0.0);
+  for (size_t i = 0; i < sums.size(); ++i) {
+    sum[i % 2] += sums[i];
+  }
+  glb_sum(get_data(sum), geo.geon.comm);
+  const double avg_plaq = sum[0] / geo.total_volume() / 6.0;
+  const double avg_rect = sum[1] / geo.total_volume() / 12.0;
+  return (1.0 - 8.0 * c1) * 6.0 * (1.0 - avg_plaq) + (0.0 == c1 ? 0.0 : c1 * 12.0 * (1.0 - avg_rect));
+}
+
+QLAT_END_NAMESPACE
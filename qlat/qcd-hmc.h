@@ -0,0 +1,339 @@
+#pragma once
+
+#include <qlat/matrix.h>
+#include <qlat/qcd.h>
+#include <qlat/qcd-utils.h>
+#include <qlat/qcd-gauge-update.h>
+#include <qlat/field-expand.h>
+
+QLAT_START_NAMESPACE
+
+// Hybrid Monte Carlo for GaugeField.
+//
+//   H = - sum_{x,mu} tr(P_mu(x)^2) + S(U)
+//
+//   dU/dt = P U
+//   dP/dt = F = - d S / d U
+//
+// with P traceless anti-hermitian. The action is a list of HmcTerm, each with
+// its action, its force and the level of the timescale its force is
+// integrated on (0 is the outermost). Each step of level i runs n_steps[i+1]
+// steps of level i+1 ; the innermost level updates the links.
+//
+// The evolving field is kept expanded, the forces start the halo exchange,
+// work on the interior sites while the messages are in flight, then finish
+// the sites next to the boundary.
+
+struct GaugeMomentum : FieldM<ColorMatrix,4>
+{
+  virtual const std::string& cname()
+  {
+    static const std::string s = "GaugeMomentum";
+    return s;
+  }
+};
+
+struct HmcParams;
+
+typedef double (*HmcAction)(const GaugeField& gf, const HmcParams& hp);
+// gf can be expanded
+
+typedef void (*HmcForce)(GaugeMomentum& gm, GaugeField& gf1, const double dt, const HmcParams& hp);
+// gm += dt * F(gf1)
+// gf1 is expanded by hmc_thick(hp), its expanded part is not refreshed yet
+
+struct HmcTerm
+{
+  HmcAction action;
+  HmcForce force;
+  int level;
+};
+
+struct HmcParams
+{
+  double beta;
+  Gauge gauge;
+  double traj_length;
+  std::vector<int> n_steps;
+  // number of steps of each level, outermost first
+  bool is_omelyan;
+  // second order minimum norm (Omelyan) integrator, leapfrog otherwise
+  double omelyan_lambda;
+  std::vector<HmcTerm> terms;
+  //
+  void init();
+  //
+  HmcParams()
+  {
+    init();
+  }
+};
+
+inline int hmc_thick(const HmcParams& hp)
+{
+  return 0.0 == hp.gauge.c1 ? 1 : 2;
+}
+
+inline void set_rand_gauge_momentum(GaugeMomentum& gm, const RngState& rs)
+  // distributed as exp(sum tr(P^2))
+{
+  TIMER("set_rand_gauge_momentum");
+  set_g_rand_anti_hermitian_matrix_field(gm, rs, 1.0 / std::sqrt(2.0));
+}
+
+inline double gm_hamilton_node(const GaugeMomentum& gm)
+  // - sum tr(P^2) over the local sites
+{
+  TIMER("gm_hamilton_node");
+  const Geometry& geo = gm.geo;
+  std::vector<double> sums(omp_get_max_threads(), 0.0);
+#pragma omp parallel
+  {
+    double sum = 0.0;
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      const Vector<ColorMatrix> v = gm.get_elems_const(xl);
+      for (int mu = 0; mu < DIMN; ++mu) {
+        sum -= matrix_trace(v[mu] * v[mu]).real();
+      }
+    }
+    sums[omp_get_thread_num()] = sum;
+  }
+  double sum = 0.0;
+  for (size_t i = 0; i < sums.size(); ++i) {
+    sum += sums[i];
+  }
+  return sum;
+}
+
+inline double gm_hamilton(const GaugeMomentum& gm)
+{
+  double sum = gm_hamilton_node(gm);
+  glb_sum(sum, gm.geo.geon.comm);
+  return sum;
+}
+
+inline void gf_gauge_force_no_comm(GaugeMomentum& gm, const GaugeField& gf1, const double dt,
+    const double beta, const double c0, const double c1, const bool is_interior_sites)
+  // gm += dt * (- beta / 6) TA(U_mu(x) C_mu(x)^dag), C = c0 * staples + c1 * rectangular staples
+  // only the sites with is_interior(xl, geo, thick) == is_interior_sites
+{
+  TIMER("gf_gauge_force_no_comm");
+  const Geometry& geo = gm.geo;
+  const int thick = 0.0 == c1 ? 1 : 2;
+  const double coef = -dt * beta / 6.0;
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    if (is_interior(xl, geo, thick) != is_interior_sites) {
+      continue;
+    }
+    Vector<ColorMatrix> v = gm.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      ColorMatrix staple;
+      set_zero(staple);
+      if (0.0 != c0) {
+        staple += c0 * gf_staple_no_comm(gf1, xl, mu);
+      }
+      if (0.0 != c1) {
+        staple += c1 * gf_rectangular_staple_no_comm(gf1, xl, mu);
+      }
+      v[mu] += coef * make_tr_less_anti_herm_matrix(gf1.get_elem(xl, mu) * matrix_adjoint(staple));
+    }
+  }
+}
+
+inline void gf_gauge_force_overlap(GaugeMomentum& gm, GaugeField& gf1, const double dt,
+    const double beta, const double c0, const double c1)
+  // refresh the expanded part of gf1 while the interior sites are computed
+{
+  TIMER("gf_gauge_force_overlap");
+  RefreshExpandedRequest<ColorMatrix> req;
+  refresh_expanded_begin(req, gf1, get_comm_plan(set_marks_field_all, "", gf1.geo));
+  gf_gauge_force_no_comm(gm, gf1, dt, beta, c0, c1, true);
+  refresh_expanded_end(req);
+  gf_gauge_force_no_comm(gm, gf1, dt, beta, c0, c1, false);
+}
+
+inline double hmc_gauge_action(const GaugeField& gf, const HmcParams& hp)
+  // S = beta * sum_x [ c0 sum_P (1 - Re tr P / 3) + c1 sum_R (1 - Re tr R / 3) ]
+{
+  return hp.beta * gf.geo.total_volume() * gf_avg_gauge_action_density(gf, hp.gauge);
+}
+
+inline void hmc_gauge_force(GaugeMomentum& gm, GaugeField& gf1, const double dt, const HmcParams& hp)
+{
+  gf_gauge_force_overlap(gm, gf1, dt, hp.beta, 1.0 - 8.0 * hp.gauge.c1, hp.gauge.c1);
+}
+
+inline double hmc_gauge_plaq_action(const GaugeField& gf, const HmcParams& hp)
+  // the plaquette part of hmc_gauge_action, to put the two parts on different levels
+{
+  Gauge wilson;
+  return hp.beta * (1.0 - 8.0 * hp.gauge.c1) * gf.geo.total_volume() * gf_avg_gauge_action_density(gf, wilson);
+}
+
+inline void hmc_gauge_plaq_force(GaugeMomentum& gm, GaugeField& gf1, const double dt, const HmcParams& hp)
+{
+  gf_gauge_force_overlap(gm, gf1, dt, hp.beta, 1.0 - 8.0 * hp.gauge.c1, 0.0);
+}
+
+inline double hmc_gauge_rect_action(const GaugeField& gf, const HmcParams& hp)
+  // the rectangle part of hmc_gauge_action
+{
+  return hmc_gauge_action(gf, hp) - hmc_gauge_plaq_action(gf, hp);
+}
+
+inline void hmc_gauge_rect_force(GaugeMomentum& gm, GaugeField& gf1, const double dt, const HmcParams& hp)
+{
+  gf_gauge_force_overlap(gm, gf1, dt, hp.beta, 0.0, hp.gauge.c1);
+}
+
+inline void HmcParams::init()
+{
+  beta = 6.0;
+  gauge = Gauge();
+  traj_length = 1.0;
+  n_steps = std::vector<int>(1, 10);
+  is_omelyan = true;
+  omelyan_lambda = 0.1931833275037836;
+  HmcTerm term;
+  term.action = hmc_gauge_action;
+  term.force = hmc_gauge_force;
+  term.level = 0;
+  terms = std::vector<HmcTerm>(1, term);
+}
+
+inline void hmc_kick(GaugeMomentum& gm, GaugeField& gf1, const int level, const double dt, const HmcParams& hp)
+{
+  for (int i = 0; i < (int)hp.terms.size(); ++i) {
+    if (level == hp.terms[i].level) {
+      hp.terms[i].force(gm, gf1, dt, hp);
+    }
+  }
+}
+
+inline void hmc_drift(GaugeField& gf1, const GaugeMomentum& gm, const double dt)
+  // U = exp(dt P) U on the local sites
+{
+  TIMER("hmc_drift");
+  const Geometry& geo = gm.geo;
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> v = gf1.get_elems(xl);
+    const Vector<ColorMatrix> vp = gm.get_elems_const(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      v[mu] = make_color_matrix_exp_cayley_hamilton(dt * vp[mu]) * v[mu];
+    }
+  }
+}
+
+inline void hmc_integrate(GaugeField& gf1, GaugeMomentum& gm, const int level, const double tau, const HmcParams& hp)
+  // evolve for time tau with the forces of level and the levels inside
+  // the adjacent kicks of consecutive steps are merged
+{
+  if (level == (int)hp.n_steps.size()) {
+    hmc_drift(gf1, gm, tau);
+    return;
+  }
+  const int n = hp.n_steps[level];
+  qassert(n > 0);
+  const double dt = tau / n;
+  if (hp.is_omelyan) {
+    const double lambda = hp.omelyan_lambda;
+    hmc_kick(gm, gf1, level, lambda * dt, hp);
+    for (int i = 0; i < n; ++i) {
+      hmc_integrate(gf1, gm, level + 1, dt / 2.0, hp);
+      hmc_kick(gm, gf1, level, (1.0 - 2.0 * lambda) * dt, hp);
+      hmc_integrate(gf1, gm, level + 1, dt / 2.0, hp);
+      hmc_kick(gm, gf1, level, (i == n - 1 ? 1.0 : 2.0) * lambda * dt, hp);
+    }
+  } else {
+    hmc_kick(gm, gf1, level, dt / 2.0, hp);
+    for (int i = 0; i < n; ++i) {
+      hmc_integrate(gf1, gm, level + 1, dt, hp);
+      hmc_kick(gm, gf1, level, (i == n - 1 ? 0.5 : 1.0) * dt, hp);
+    }
+  }
+}
+
+inline double hmc_action(const GaugeField& gf, const HmcParams& hp)
+{
+  double sum = 0.0;
+  for (int i = 0; i < (int)hp.terms.size(); ++i) {
+    sum += hp.terms[i].action(gf, hp);
+  }
+  return sum;
+}
+
+inline void hmc_evolve(GaugeField& gf, GaugeMomentum& gm, const HmcParams& hp)
+  // molecular dynamics for hp.traj_length
+{
+  TIMER_VERBOSE("hmc_evolve");
+  for (int i = 0; i < (int)hp.terms.size(); ++i) {
+    qassert(0 <= hp.terms[i].level && hp.terms[i].level < (int)hp.n_steps.size());
+  }
+  GaugeField gf1;
+  gf1.init(geo_resize(gf.geo, hmc_thick(hp)));
+  gf1 = gf;
+  hmc_integrate(gf1, gm, 0, hp.traj_length, hp);
+  gf = gf1;
+}
+
+struct HmcInfo
+{
+  long traj;
+  double delta_h;
+  bool is_accepted;
+  double plaq;
+  //
+  void init()
+  {
+    traj = 0;
+    delta_h = 0.0;
+    is_accepted = false;
+    plaq = 0.0;
+  }
+  //
+  HmcInfo()
+  {
+    init();
+  }
+};
+
+inline HmcInfo hmc_trajectory(GaugeField& gf, const HmcParams& hp, const RngState& rs, const long traj,
+    const bool is_metropolis = true)
+  // rs should be the same on all the nodes
+  // the momenta and the accept/reject only depend on (rs, traj)
+{
+  TIMER_VERBOSE("hmc_trajectory");
+  const RngState rst(rs, traj);
+  HmcInfo info;
+  info.traj = traj;
+  GaugeMomentum gm;
+  gm.init(geo_resize(gf.geo));
+  set_rand_gauge_momentum(gm, RngState(rst, "momentum"));
+  const double h0 = gm_hamilton(gm) + hmc_action(gf, hp);
+  GaugeField gf0;
+  gf0.init(geo_resize(gf.geo));
+  gf0 = gf;
+  hmc_evolve(gf, gm, hp);
+  const double h1 = gm_hamilton(gm) + hmc_action(gf, hp);
+  info.delta_h = h1 - h0;
+  RngState rsm(rst, "metropolis");
+  const double r = u_rand_gen(rsm);
+  info.is_accepted = !is_metropolis || r < std::exp(-info.delta_h);
+  if (info.is_accepted) {
+    unitarize(gf);
+  } else {
+    gf = gf0;
+  }
+  info.plaq = gf_avg_plaq(gf);
+  displayln_info(ssprintf("%s: traj = %ld ; delta_h = %.6E ; accept = %d ; plaq = %.10f", fname,
+        traj, info.delta_h, info.is_accepted, info.plaq));
+  return info;
+}
+
+QLAT_END_NAMESPACE
@@ -0,0 +1,967 @@
+#pragma once
+
+#include <qlat/qcd.h>
+#include <qlat/qcd-dirac.h>
+
+QLAT_START_NAMESPACE
+
+// Krylov solvers for the Wilson-clover operator of qcd-dirac.h with even/odd
+// preconditioning. With D = A + H, A the site local part and H the hopping
+// term (which only connects the even and the odd sites), the Schur complement
+//
+//   M = A_ee - H_eo A_oo^-1 H_oe
+//
+// is solved on the even sites with b_e - H_eo A_oo^-1 b_o as the source, then
+//
+//   x_o = A_oo^-1 (b_o - H_oe x_e)
+//
+// M is gamma5-hermitian as D. The parity is the one of the sum of the global
+// coordinates (Geometry::eo splits by the parity of x[0] only), so the vectors
+// are FermionField4d with only the sites of one parity referenced.
+//
+// The solvers are templates of the operator (CloverWilsonMatrix or its single
+// precision copy CloverWilsonMatrixF). The mixed precision solvers iterate in
+// single precision and correct the residual in double precision, either by
+// defect correction (restarted single precision solves) or by the reliable
+// updates of a single CG.
+//
+// The fields used by the linear algebra below can not be expanded.
+
+template <class V>
+inline Complex fermion_field_dot(const Field<V>& ff1, const Field<V>& ff2, const std::vector<long>& indices)
+  // sum of conj(ff1) ff2 over the local sites of indices and all the nodes
+{
+  TIMER_FLOPS("fermion_field_dot");
+  const int nrhs = ff1.geo.multiplicity;
+  timer.flops += 8 * 4 * NUM_COLOR * indices.size() * nrhs;
+  qassert(ff1.geo.local_volume_expanded() == ff1.geo.local_volume());
+  qassert(is_matching_geo_mult(ff1.geo, ff2.geo));
+  std::vector<Complex> sums(omp_get_max_threads(), 0.0);
+#pragma omp parallel
+  {
+    Complex sum = 0.0;
+#pragma omp for
+    for (long i = 0; i < (long)indices.size(); ++i) {
+      const Vector<V> v1 = ff1.get_elems_const(indices[i]);
+      const Vector<V> v2 = ff2.get_elems_const(indices[i]);
+      for (int n = 0; n < nrhs; ++n) {
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          sum += std::conj(Complex(v1[n].p[k])) * Complex(v2[n].p[k]);
+        }
+      }
+    }
+    sums[omp_get_thread_num()] = sum;
+  }
+  Complex sum = 0.0;
+  for (size_t i = 0; i < sums.size(); ++i) {
+    sum += sums[i];
+  }
+  glb_sum(Vector<Complex>(sum), ff1.geo.geon.comm);
+  return sum;
+}
+
+template <class V>
+inline double fermion_field_norm2(const Field<V>& ff, const std::vector<long>& indices)
+{
+  TIMER_FLOPS("fermion_field_norm2");
+  const int nrhs = ff.geo.multiplicity;
+  timer.flops += 4 * 4 * NUM_COLOR * indices.size() * nrhs;
+  qassert(ff.geo.local_volume_expanded() == ff.geo.local_volume());
+  std::vector<double> sums(omp_get_max_threads(), 0.0);
+#pragma omp parallel
+  {
+    double sum = 0.0;
+#pragma omp for
+    for (long i = 0; i < (long)indices.size(); ++i) {
+      const Vector<V> v = ff.get_elems_const(indices[i]);
+      for (int n = 0; n < nrhs; ++n) {
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          sum += std::norm(Complex(v[n].p[k]));
+        }
+      }
+    }
+    sums[omp_get_thread_num()] = sum;
+  }
+  double sum = 0.0;
+  for (size_t i = 0; i < sums.size(); ++i) {
+    sum += sums[i];
+  }
+  glb_sum(sum, ff.geo.geon.comm);
+  return sum;
+}
+
+template <class V>
+inline void fermion_field_dot_norm2(Complex& dot, double& norm2, const Field<V>& ff1, const Field<V>& ff2,
+    const std::vector<long>& indices)
+  // dot = <ff1, ff2> and norm2 = <ff1, ff1> in one pass and one global sum
+{
+  TIMER_FLOPS("fermion_field_dot_norm2");
+  const int nrhs = ff1.geo.multiplicity;
+  timer.flops += 12 * 4 * NUM_COLOR * indices.size() * nrhs;
+  qassert(ff1.geo.local_volume_expanded() == ff1.geo.local_volume());
+  qassert(is_matching_geo_mult(ff1.geo, ff2.geo));
+  std::vector<Complex> sums(2 * omp_get_max_threads(), 0.0);
+#pragma omp parallel
+  {
+    Complex sum_dot = 0.0;
+    double sum_norm = 0.0;
+#pragma omp for
+    for (long i = 0; i < (long)indices.size(); ++i) {
+      const Vector<V> v1 = ff1.get_elems_const(indices[i]);
+      const Vector<V> v2 = ff2.get_elems_const(indices[i]);
+      for (int n = 0; n < nrhs; ++n) {
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          const Complex x1 = v1[n].p[k];
+          sum_dot += std::conj(x1) * Complex(v2[n].p[k]);
+          sum_norm += std::norm(x1);
+        }
+      }
+    }
+    sums[2 * omp_get_thread_num()] = sum_dot;
+    sums[2 * omp_get_thread_num() + 1] = sum_norm;
+  }
+  std::array<Complex,2> sum;
+  sum[0] = 0.0;
+  sum[1] = 0.0;
+  for (size_t i = 0; i < sums.size(); ++i) {
+    sum[i % 2] += sums[i];
+  }
+  glb_sum(Vector<Complex>(sum.data(), sum.size()), ff1.geo.geon.comm);
+  dot = sum[0];
+  norm2 = sum[1].real();
+}
+
+template <class V>
+inline double fermion_field_axpy_norm2(Field<V>& y, const Complex& a, const Field<V>& x,
+    const std::vector<long>& indices)
+  // y = y + a x and return |y|^2, in one pass
+{
+  TIMER_FLOPS("fermion_field_axpy_norm2");
+  const int nrhs = y.geo.multiplicity;
+  timer.flops += 12 * 4 * NUM_COLOR * indices.size() * nrhs;
+  qassert(y.geo.local_volume_expanded() == y.geo.local_volume());
+  qassert(is_matching_geo_mult(y.geo, x.geo));
+  std::vector<double> sums(omp_get_max_threads(), 0.0);
+#pragma omp parallel
+  {
+    double sum = 0.0;
+#pragma omp for
+    for (long i = 0; i < (long)indices.size(); ++i) {
+      Vector<V> vy = y.get_elems(indices[i]);
+      const Vector<V> vx = x.get_elems_const(indices[i]);
+      for (int n = 0; n < nrhs; ++n) {
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          vy[n].p[k] = Complex(vy[n].p[k]) + a * Complex(vx[n].p[k]);
+          sum += std::norm(Complex(vy[n].p[k]));
+        }
+      }
+    }
+    sums[omp_get_thread_num()] = sum;
+  }
+  double sum = 0.0;
+  for (size_t i = 0; i < sums.size(); ++i) {
+    sum += sums[i];
+  }
+  glb_sum(sum, y.geo.geon.comm);
+  return sum;
+}
+
+template <class V1, class V2>
+inline void fermion_field_axpy(Field<V1>& y, const Complex& a, const Field<V2>& x, const std::vector<long>& indices)
+  // y = y + a x (y and x can be of different precisions)
+{
+  TIMER_FLOPS("fermion_field_axpy");
+  const int nrhs = y.geo.multiplicity;
+  timer.flops += 8 * 4 * NUM_COLOR * indices.size() * nrhs;
+  qassert(y.geo.local_volume_expanded() == y.geo.local_volume());
+  qassert(is_matching_geo_mult(y.geo, x.geo));
+#pragma omp parallel for
+  for (long i = 0; i < (long)indices.size(); ++i) {
+    Vector<V1> vy = y.get_elems(indices[i]);
+    const Vector<V2> vx = x.get_elems_const(indices[i]);
+    for (int n = 0; n < nrhs; ++n) {
+      for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+        vy[n].p[k] = Complex(vy[n].p[k]) + a * Complex(vx[n].p[k]);
+      }
+    }
+  }
+}
+
+template <class V>
+inline void fermion_field_xpay(Field<V>& y, const Complex& a, const Field<V>& x, const std::vector<long>& indices)
+  // y = x + a y
+{
+  TIMER_FLOPS("fermion_field_xpay");
+  const int nrhs = y.geo.multiplicity;
+  timer.flops += 8 * 4 * NUM_COLOR * indices.size() * nrhs;
+  qassert(y.geo.local_volume_expanded() == y.geo.local_volume());
+  qassert(is_matching_geo_mult(y.geo, x.geo));
+#pragma omp parallel for
+  for (long i = 0; i < (long)indices.size(); ++i) {
+    Vector<V> vy = y.get_elems(indices[i]);
+    const Vector<V> vx = x.get_elems_const(indices[i]);
+    for (int n = 0; n < nrhs; ++n) {
+      for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+        vy[n].p[k] = Complex(vx[n].p[k]) + a * Complex(vy[n].p[k]);
+      }
+    }
+  }
+}
+
+template <class V>
+inline void fermion_field_bicgstab_p(Field<V>& p, const Complex& beta, const Complex& omega,
+    const Field<V>& r, const Field<V>& v, const std::vector<long>& indices)
+  // p = r + beta (p - omega v)
+{
+  TIMER_FLOPS("fermion_field_bicgstab_p");
+  const int nrhs = p.geo.multiplicity;
+  timer.flops += 16 * 4 * NUM_COLOR * indices.size() * nrhs;
+  qassert(p.geo.local_volume_expanded() == p.geo.local_volume());
+#pragma omp parallel for
+  for (long i = 0; i < (long)indices.size(); ++i) {
+    Vector<V> vp = p.get_elems(indices[i]);
+    const Vector<V> vr = r.get_elems_const(indices[i]);
+    const Vector<V> vv = v.get_elems_const(indices[i]);
+    for (int n = 0; n < nrhs; ++n) {
+      for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+        vp[n].p[k] = Complex(vr[n].p[k]) + beta * (Complex(vp[n].p[k]) - omega * Complex(vv[n].p[k]));
+      }
+    }
+  }
+}
+
+template <class V1, class V2>
+inline void fermion_field_copy(Field<V1>& y, const Field<V2>& x, const std::vector<long>& indices)
+  // y and x can be of different precisions
+{
+  TIMER("fermion_field_copy");
+  qassert(y.geo.multiplicity == x.geo.multiplicity);
+#pragma omp parallel for
+  for (long i = 0; i < (long)indices.size(); ++i) {
+    Vector<V1> vy = y.get_elems(indices[i]);
+    const Vector<V2> vx = x.get_elems_const(indices[i]);
+    for (int n = 0; n < y.geo.multiplicity; ++n) {
+      wilson_vector_assign(vy[n], vx[n]);
+    }
+  }
+}
+
+template <class CWM>
+inline void multiply_m_schur(Field<typename CWM::WilsonVectorType>& out, Field<typename CWM::WilsonVectorType>& in,
+    const CWM& cwm, Field<typename CWM::HalfWilsonVectorType>& hf)
+  // out_e = M in_e (out can not be in)
+  // the odd sites of in are used as a buffer, hf is the half spinor buffer
+  // CWM is CloverWilsonMatrix or CloverWilsonMatrixF
+{
+  TIMER("multiply_m_schur");
+  multiply_wilson_hop(in, in, cwm.gf, cwm.dsi, 1, hf);
+  multiply_clover_term(in, in, cwm.ctf_inv, cwm.dsi, 1, -1.0);
+  multiply_wilson_hop_clover(out, in, cwm.gf, cwm.ctf, cwm.dsi, 0, hf);
+}
+
+template <class CWM>
+inline void multiply_m_schur_dag(Field<typename CWM::WilsonVectorType>& out, Field<typename CWM::WilsonVectorType>& in,
+    const CWM& cwm, Field<typename CWM::HalfWilsonVectorType>& hf)
+  // out_e = M^dag in_e = gamma5 M gamma5 in_e (out can not be in)
+  // the odd sites of in are used as a buffer, hf is the half spinor buffer
+{
+  TIMER("multiply_m_schur_dag");
+  multiply_gamma5(in, cwm.dsi, 0);
+  multiply_m_schur(out, in, cwm, hf);
+  multiply_gamma5(in, cwm.dsi, 0);
+  multiply_gamma5(out, cwm.dsi, 0);
+}
+
+struct InverterStats
+  // of the last solve
+{
+  long num_iter;
+  double rsd; // relative residual of the even/odd preconditioned system
+  double true_rsd; // |src - D sol| / |src|
+  //
+  void init()
+  {
+    num_iter = 0;
+    rsd = 0.0;
+    true_rsd = 0.0;
+  }
+  //
+  InverterStats()
+  {
+    init();
+  }
+};
+
+template <class CWM>
+inline long cgne_schur(FieldM<typename CWM::WilsonVectorType,1>& x, const FieldM<typename CWM::WilsonVectorType,1>& b,
+    const CWM& cwm, const double stop_rsd, const long max_num_iter, double& rsd)
+  // solve M x_e = b_e with CG on M^dag M x_e = M^dag b_e
+  // x_e is the initial guess, the odd sites of b are not used and the ones of x are overwritten
+  // return the number of iterations, rsd is |M^dag (b - M x)| / |M^dag b|
+{
+  TIMER_VERBOSE_FLOPS("cgne_schur");
+  const Geometry geo = geo_resize(b.geo);
+  const std::vector<long>& indices = cwm.dsi.get(0);
+  FieldM<typename CWM::HalfWilsonVectorType,2*DIMN> hf;
+  FieldM<typename CWM::WilsonVectorType,1> r, p, q, s;
+  r.init(geo);
+  p.init(geo);
+  q.init(geo);
+  s.init(geo);
+  fermion_field_copy(p, b, indices);
+  multiply_m_schur_dag(r, p, cwm, hf);
+  const double norm2_src = fermion_field_norm2(r, indices);
+  multiply_m_schur(q, x, cwm, hf);
+  multiply_m_schur_dag(s, q, cwm, hf);
+  double rr = fermion_field_axpy_norm2(r, -1.0, s, indices);
+  fermion_field_copy(p, r, indices);
+  const double stop2 = sqr(stop_rsd) * norm2_src;
+  long iter = 0;
+  while (rr > stop2 and iter < max_num_iter) {
+    iter += 1;
+    multiply_m_schur(q, p, cwm, hf);
+    const double alpha = rr / fermion_field_norm2(q, indices);
+    fermion_field_axpy(x, alpha, p, indices);
+    multiply_m_schur_dag(s, q, cwm, hf);
+    const double rr_new = fermion_field_axpy_norm2(r, -alpha, s, indices);
+    fermion_field_xpay(p, rr_new / rr, r, indices);
+    rr = rr_new;
+    if (iter % 100 == 0) {
+      displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E", fname, iter, std::sqrt(rr / norm2_src)));
+    }
+  }
+  timer.flops += iter * 2 * 1824 * indices.size() * 2;
+  rsd = std::sqrt(rr / norm2_src);
+  displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E", fname, iter, rsd));
+  return iter;
+}
+
+template <class CWM>
+inline long bicgstab_schur(FieldM<typename CWM::WilsonVectorType,1>& x, const FieldM<typename CWM::WilsonVectorType,1>& b,
+    const CWM& cwm, const double stop_rsd, const long max_num_iter, double& rsd)
+  // solve M x_e = b_e with BiCGStab
+  // x_e is the initial guess, the odd sites of b are not used and the ones of x are overwritten
+  // return the number of iterations, rsd is |b - M x| / |b|
+{
+  TIMER_VERBOSE_FLOPS("bicgstab_schur");
+  const Geometry geo = geo_resize(b.geo);
+  const std::vector<long>& indices = cwm.dsi.get(0);
+  FieldM<typename CWM::HalfWilsonVectorType,2*DIMN> hf;
+  FieldM<typename CWM::WilsonVectorType,1> r, r0, p, v, s, t;
+  r.init(geo);
+  r0.init(geo);
+  p.init(geo);
+  v.init(geo);
+  s.init(geo);
+  t.init(geo);
+  const double norm2_src = fermion_field_norm2(b, indices);
+  multiply_m_schur(v, x, cwm, hf);
+  fermion_field_copy(r, b, indices);
+  double rr = fermion_field_axpy_norm2(r, -1.0, v, indices);
+  fermion_field_copy(r0, r, indices);
+  set_zero(v);
+  set_zero(p);
+  Complex rho = 1.0, alpha = 1.0, omega = 1.0;
+  const double stop2 = sqr(stop_rsd) * norm2_src;
+  long iter = 0;
+  while (rr > stop2 and iter < max_num_iter) {
+    iter += 1;
+    const Complex rho_new = fermion_field_dot(r0, r, indices);
+    const Complex beta = (rho_new / rho) * (alpha / omega);
+    rho = rho_new;
+    fermion_field_bicgstab_p(p, beta, omega, r, v, indices);
+    multiply_m_schur(v, p, cwm, hf);
+    alpha = rho / fermion_field_dot(r0, v, indices);
+    fermion_field_copy(s, r, indices);
+    const double ss = fermion_field_axpy_norm2(s, -alpha, v, indices);
+    if (ss <= stop2) {
+      fermion_field_axpy(x, alpha, p, indices);
+      rr = ss;
+      break;
+    }
+    multiply_m_schur(t, s, cwm, hf);
+    double tt;
+    Complex ts;
+    fermion_field_dot_norm2(ts, tt, t, s, indices);
+    omega = ts / tt;
+    fermion_field_axpy(x, alpha, p, indices);
+    fermion_field_axpy(x, omega, s, indices);
+    fermion_field_copy(r, s, indices);
+    rr = fermion_field_axpy_norm2(r, -omega, t, indices);
+    if (iter % 100 == 0) {
+      displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E", fname, iter, std::sqrt(rr / norm2_src)));
+    }
+  }
+  timer.flops += iter * 2 * 1824 * indices.size() * 2;
+  rsd = std::sqrt(rr / norm2_src);
+  displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E", fname, iter, rsd));
+  return iter;
+}
+
+inline long defect_correction_schur(FermionField4d& x, const FermionField4d& b,
+    const CloverWilsonMatrix& cwm, const CloverWilsonMatrixF& cwmf, const std::string& solver,
+    const double stop_rsd, const double inner_stop_rsd, const long max_num_iter, double& rsd)
+  // solve M x_e = b_e by solving M e_e = r_e = b_e - M x_e in single precision and x_e += e_e
+  // until |r_e| / |b_e| < stop_rsd, r_e is always computed in double precision
+  // each inner solve reduces the residual by inner_stop_rsd (or less if close to the end)
+  // x_e is the initial guess, the odd sites of b are not used and the ones of x are overwritten
+  // return the total number of the inner iterations, rsd is |b - M x| / |b|
+{
+  TIMER_VERBOSE_FLOPS("defect_correction_schur");
+  const Geometry geo = geo_resize(b.geo);
+  const std::vector<long>& indices = cwm.dsi.get(0);
+  FieldM<HalfWilsonVector,2*DIMN> hf;
+  FermionField4d r;
+  FermionField4dF rf, ef;
+  r.init(geo);
+  rf.init(geo);
+  ef.init(geo);
+  const double norm2_src = fermion_field_norm2(b, indices);
+  const double stop2 = sqr(stop_rsd) * norm2_src;
+  long iter = 0;
+  long num_outer = 0;
+  double rr = 0.0;
+  while (true) {
+    multiply_m_schur(r, x, cwm, hf);
+    fermion_field_xpay(r, -1.0, b, indices);
+    rr = fermion_field_norm2(r, indices);
+    if (rr <= stop2 or iter >= max_num_iter) {
+      break;
+    }
+    num_outer += 1;
+    fermion_field_copy(rf, r, indices);
+    set_zero(ef);
+    const double inner_rsd = std::max(inner_stop_rsd, 0.5 * std::sqrt(stop2 / rr));
+    double inner_rsd_achieved = 0.0;
+    long inner_iter = 0;
+    if (solver == "cgne") {
+      inner_iter = cgne_schur(ef, rf, cwmf, inner_rsd, max_num_iter - iter, inner_rsd_achieved);
+    } else if (solver == "bicgstab") {
+      inner_iter = bicgstab_schur(ef, rf, cwmf, inner_rsd, max_num_iter - iter, inner_rsd_achieved);
+    } else {
+      qassert(false);
+    }
+    iter += inner_iter;
+    fermion_field_axpy(x, 1.0, ef, indices);
+    if (inner_iter == 0) {
+      // the single precision solver can not make any progress
+      multiply_m_schur(r, x, cwm, hf);
+      fermion_field_xpay(r, -1.0, b, indices);
+      rr = fermion_field_norm2(r, indices);
+      break;
+    }
+  }
+  timer.flops += (num_outer + 1) * 1824 * indices.size() * 2;
+  rsd = std::sqrt(rr / norm2_src);
+  displayln_info(ssprintf("%s: outer = %ld ; iter = %ld ; rsd = %.4E", fname, num_outer, iter, rsd));
+  return iter;
+}
+
+inline long cgne_schur_reliable(FermionField4d& x, const FermionField4d& b,
+    const CloverWilsonMatrix& cwm, const CloverWilsonMatrixF& cwmf,
+    const double stop_rsd, const double delta, const long max_num_iter, double& rsd)
+  // CG on M^dag M x_e = M^dag b_e with the iterations in single precision and reliable updates:
+  // when the iterated residual dropped by delta since the last update (or it reaches stop_rsd)
+  // the solution is accumulated in x and the residual is recomputed in double precision
+  // x_e is the initial guess, the odd sites of b are not used and the ones of x are overwritten
+  // return the number of iterations, rsd is |M^dag (b - M x)| / |M^dag b|
+{
+  TIMER_VERBOSE_FLOPS("cgne_schur_reliable");
+  const Geometry geo = geo_resize(b.geo);
+  const std::vector<long>& indices = cwm.dsi.get(0);
+  FieldM<HalfWilsonVector,2*DIMN> hf;
+  FieldM<HalfWilsonVectorF,2*DIMN> hff;
+  FermionField4d r, q;
+  FermionField4dF rf, pf, qf, sf, xf;
+  r.init(geo);
+  q.init(geo);
+  rf.init(geo);
+  pf.init(geo);
+  qf.init(geo);
+  sf.init(geo);
+  xf.init(geo);
+  fermion_field_copy(q, b, indices);
+  multiply_m_schur_dag(r, q, cwm, hf);
+  const double norm2_src = fermion_field_norm2(r, indices);
+  const double stop2 = sqr(stop_rsd) * norm2_src;
+  long num_updates = 0;
+  double rr = 0.0;
+  // r = M^dag (b - M x) in double precision, then restart the single precision iteration from it
+  multiply_m_schur(q, x, cwm, hf);
+  fermion_field_xpay(q, -1.0, b, indices);
+  multiply_m_schur_dag(r, q, cwm, hf);
+  rr = fermion_field_norm2(r, indices);
+  fermion_field_copy(rf, r, indices);
+  fermion_field_copy(pf, r, indices);
+  set_zero(xf);
+  double max_rr = rr;
+  long iter = 0;
+  while (rr > stop2 and iter < max_num_iter) {
+    iter += 1;
+    multiply_m_schur(qf, pf, cwmf, hff);
+    const double alpha = rr / fermion_field_norm2(qf, indices);
+    fermion_field_axpy(xf, alpha, pf, indices);
+    multiply_m_schur_dag(sf, qf, cwmf, hff);
+    double rr_new = fermion_field_axpy_norm2(rf, -alpha, sf, indices);
+    if (rr_new < sqr(delta) * max_rr or rr_new <= stop2 or iter == max_num_iter) {
+      num_updates += 1;
+      fermion_field_axpy(x, 1.0, xf, indices);
+      set_zero(xf);
+      multiply_m_schur(q, x, cwm, hf);
+      fermion_field_xpay(q, -1.0, b, indices);
+      multiply_m_schur_dag(r, q, cwm, hf);
+      rr_new = fermion_field_norm2(r, indices);
+      fermion_field_copy(rf, r, indices);
+      max_rr = rr_new;
+    } else {
+      max_rr = std::max(max_rr, rr_new);
+    }
+    fermion_field_xpay(pf, rr_new / rr, rf, indices);
+    rr = rr_new;
+    if (iter % 100 == 0) {
+      displayln_info(ssprintf("%s: iter = %ld ; rsd = %.4E", fname, iter, std::sqrt(rr / norm2_src)));
+    }
+  }
+  timer.flops += (iter + num_updates + 1) * 2 * 1824 * indices.size() * 2;
+  rsd = std::sqrt(rr / norm2_src);
+  displayln_info(ssprintf("%s: iter = %ld ; updates = %ld ; rsd = %.4E", fname, iter, num_updates, rsd));
+  return iter;
+}
+
+struct InverterCloverWilson
+  // the Inverter of inverse(sol, src, inv) and set_point_src_propagator(prop, inv, ...) in qcd.h
+{
+  Geometry geo; // of the fermion fields
+  CloverWilsonMatrix cwm;
+  CloverWilsonMatrixF cwmf; // single precision copy of cwm
+  std::string solver; // "cgne" or "bicgstab"
+  std::string mixed_precision; // "", "defect-correction" or "reliable-update" (cgne only)
+  double stop_rsd; // for the even/odd preconditioned system
+  double inner_stop_rsd; // of the single precision solves for "defect-correction"
+  double reliable_delta; // of the reliable updates for "reliable-update"
+  long max_num_iter;
+  //
+  void init()
+  {
+    geo.init();
+    cwm.init();
+    cwmf.init();
+    solver = "cgne";
+    mixed_precision = "";
+    stop_rsd = 1.0e-8;
+    inner_stop_rsd = 1.0e-5;
+    reliable_delta = 0.1;
+    max_num_iter = 10000;
+  }
+  void init(const GaugeField& gf, const FermionActionCloverWilson& fa)
+  {
+    cwm.init(gf, fa);
+    cwmf.init(cwm);
+    geo = cwm.geo;
+  }
+  //
+  InverterCloverWilson()
+  {
+    init();
+  }
+  InverterCloverWilson(const GaugeField& gf, const FermionActionCloverWilson& fa)
+  {
+    init();
+    init(gf, fa);
+  }
+};
+
+inline InverterStats& get_last_inverter_stats()
+{
+  static InverterStats stats;
+  return stats;
+}
+
+inline void set_schur_src(Field<WilsonVector>& b_e, const Field<WilsonVector>& b, const CloverWilsonMatrix& cwm,
+    Field<HalfWilsonVector>& hf)
+  // b_e = b_e - H_eo A_oo^-1 b_o on the even sites (b_e can not be b)
+{
+  TIMER("set_schur_src");
+  const Geometry& geo = b.geo;
+  Field<WilsonVector> tmp;
+  tmp.init(geo);
+  multiply_clover_term(tmp, b, cwm.ctf_inv, cwm.dsi, 1, -1.0);
+  multiply_wilson_hop(b_e, tmp, cwm.gf, cwm.dsi, 0, hf);
+  fermion_field_axpy(b_e, 1.0, b, cwm.dsi.get(0));
+}
+
+inline void set_schur_sol_odd(Field<WilsonVector>& x, const Field<WilsonVector>& b, const CloverWilsonMatrix& cwm,
+    Field<HalfWilsonVector>& hf)
+  // x_o = A_oo^-1 (b_o - H_oe x_e) from the solution x_e of the even/odd preconditioned system
+{
+  TIMER("set_schur_sol_odd");
+  const Geometry& geo = b.geo;
+  Field<WilsonVector> tmp;
+  tmp.init(geo);
+  multiply_wilson_hop(tmp, x, cwm.gf, cwm.dsi, 1, hf);
+  fermion_field_xpay(tmp, -1.0, b, cwm.dsi.get(1));
+  multiply_clover_term(x, tmp, cwm.ctf_inv, cwm.dsi, 1);
+}
+
+inline long inverse(FermionField4d& sol, const FermionField4d& src, const InverterCloverWilson& inv)
+  // sol do not need to be initialized
+  // return the number of iterations, see also get_last_inverter_stats()
+{
+  TIMER_VERBOSE("inverse(ff4d,ff4d,inv-clover-wilson)");
+  const CloverWilsonMatrix& cwm = inv.cwm;
+  const Geometry geo = geo_reform(inv.geo);
+  FieldM<HalfWilsonVector,2*DIMN> hf;
+  FermionField4d b, x, tmp;
+  b.init(geo);
+  x.init(geo);
+  tmp.init(geo);
+  b = src;
+  set_schur_src(tmp, b, cwm, hf);
+  set_zero(x);
+  InverterStats& stats = get_last_inverter_stats();
+  stats.init();
+  if (inv.mixed_precision == "defect-correction") {
+    stats.num_iter = defect_correction_schur(x, tmp, cwm, inv.cwmf, inv.solver,
+        inv.stop_rsd, inv.inner_stop_rsd, inv.max_num_iter, stats.rsd);
+  } else if (inv.mixed_precision == "reliable-update") {
+    qassert(inv.solver == "cgne");
+    stats.num_iter = cgne_schur_reliable(x, tmp, cwm, inv.cwmf,
+        inv.stop_rsd, inv.reliable_delta, inv.max_num_iter, stats.rsd);
+  } else if (inv.mixed_precision != "") {
+    qassert(false);
+  } else if (inv.solver == "cgne") {
+    stats.num_iter = cgne_schur(x, tmp, cwm, inv.stop_rsd, inv.max_num_iter, stats.rsd);
+  } else if (inv.solver == "bicgstab") {
+    stats.num_iter = bicgstab_schur(x, tmp, cwm, inv.stop_rsd, inv.max_num_iter, stats.rsd);
+  } else {
+    qassert(false);
+  }
+  set_schur_sol_odd(x, b, cwm, hf);
+  // true residual
+  multiply_clover_wilson(tmp, x, cwm.gf, cwm.ctf, cwm.dsi);
+  const std::vector<long>& indices = cwm.dsi.get(-1);
+  const double norm2_src = fermion_field_norm2(b, indices);
+  stats.true_rsd = std::sqrt(fermion_field_axpy_norm2(tmp, -1.0, b, indices) / norm2_src);
+  displayln_info(ssprintf("%s: %s%s iter = %ld ; rsd = %.4E ; true rsd = %.4E",
+        fname, inv.solver.c_str(), inv.mixed_precision == "" ? "" : (" " + inv.mixed_precision).c_str(), stats.num_iter, stats.rsd, stats.true_rsd));
+  sol.init(geo);
+  sol = x;
+  return stats.num_iter;
+}
+
+// Multiple right hand sides
+//
+// The nrhs right hand sides are the spinors of a Field<WilsonVector> with
+// multiplicity nrhs (e.g. the 4*NUM_COLOR columns of a propagator). The
+// operators above apply to all of them with one load of the links per site,
+// and block CG couples them through the nrhs x nrhs matrices below.
+
+typedef Eigen::Matrix<Complex,Eigen::Dynamic,Eigen::Dynamic> BlockMatrix;
+
+template <class V>
+inline BlockMatrix fermion_field_block_dot(const Field<V>& ff1, const Field<V>& ff2, const std::vector<long>& indices)
+  // m(i, j) = <ff1(i), ff2(j)> with i, j the spinors of the sites
+{
+  TIMER_FLOPS("fermion_field_block_dot");
+  const int nrhs = ff1.geo.multiplicity;
+  timer.flops += 8 * 4 * NUM_COLOR * indices.size() * nrhs * nrhs;
+  qassert(ff1.geo.local_volume_expanded() == ff1.geo.local_volume());
+  qassert(is_matching_geo_mult(ff1.geo, ff2.geo));
+  std::vector<std::vector<Complex> > sums(omp_get_max_threads());
+#pragma omp parallel
+  {
+    std::vector<Complex> sum(nrhs * nrhs, 0.0);
+#pragma omp for
+    for (long idx = 0; idx < (long)indices.size(); ++idx) {
+      const Vector<V> v1 = ff1.get_elems_const(indices[idx]);
+      const Vector<V> v2 = ff2.get_elems_const(indices[idx]);
+      for (int i = 0; i < nrhs; ++i) {
+        for (int j = 0; j < nrhs; ++j) {
+          Complex s = 0.0;
+          for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+            s += std::conj(Complex(v1[i].p[k])) * Complex(v2[j].p[k]);
+          }
+          sum[i * nrhs + j] += s;
+        }
+      }
+    }
+    sums[omp_get_thread_num()] = sum;
+  }
+  std::vector<Complex> sum(nrhs * nrhs, 0.0);
+  for (size_t t = 0; t < sums.size(); ++t) {
+    for (size_t i = 0; i < sums[t].size(); ++i) {
+      sum[i] += sums[t][i];
+    }
+  }
+  glb_sum(get_data(sum), ff1.geo.geon.comm);
+  BlockMatrix m(nrhs, nrhs);
+  for (int i = 0; i < nrhs; ++i) {
+    for (int j = 0; j < nrhs; ++j) {
+      m(i, j) = sum[i * nrhs + j];
+    }
+  }
+  return m;
+}
+
+template <class V>
+inline void fermion_field_block_axpy(Field<V>& y, const BlockMatrix& a, const Field<V>& x, const std::vector<long>& indices)
+  // y(j) = y(j) + sum_i x(i) a(i, j)
+{
+  TIMER_FLOPS("fermion_field_block_axpy");
+  const int nrhs = y.geo.multiplicity;
+  timer.flops += 8 * 4 * NUM_COLOR * indices.size() * nrhs * nrhs;
+  qassert(is_matching_geo_mult(y.geo, x.geo));
+  qassert(a.rows() == nrhs and a.cols() == nrhs);
+#pragma omp parallel for
+  for (long idx = 0; idx < (long)indices.size(); ++idx) {
+    Vector<V> vy = y.get_elems(indices[idx]);
+    const Vector<V> vx = x.get_elems_const(indices[idx]);
+    for (int j = 0; j < nrhs; ++j) {
+      for (int i = 0; i < nrhs; ++i) {
+        const Complex c = a(i, j);
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          vy[j].p[k] = Complex(vy[j].p[k]) + c * Complex(vx[i].p[k]);
+        }
+      }
+    }
+  }
+}
+
+template <class V>
+inline void fermion_field_block_xpay(Field<V>& y, const BlockMatrix& a, const Field<V>& x, const std::vector<long>& indices)
+  // y(j) = x(j) + sum_i y(i) a(i, j)
+{
+  TIMER_FLOPS("fermion_field_block_xpay");
+  const int nrhs = y.geo.multiplicity;
+  timer.flops += 8 * 4 * NUM_COLOR * indices.size() * nrhs * nrhs;
+  qassert(is_matching_geo_mult(y.geo, x.geo));
+  qassert(a.rows() == nrhs and a.cols() == nrhs);
+#pragma omp parallel
+  {
+    std::vector<WilsonVector> vy0(nrhs);
+#pragma omp for
+    for (long idx = 0; idx < (long)indices.size(); ++idx) {
+      Vector<V> vy = y.get_elems(indices[idx]);
+      const Vector<V> vx = x.get_elems_const(indices[idx]);
+      for (int i = 0; i < nrhs; ++i) {
+        wilson_vector_assign(vy0[i], vy[i]);
+      }
+      for (int j = 0; j < nrhs; ++j) {
+        WilsonVector v;
+        wilson_vector_assign(v, vx[j]);
+        for (int i = 0; i < nrhs; ++i) {
+          const Complex c = a(i, j);
+          for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+            v.p[k] += c * vy0[i].p[k];
+          }
+        }
+        wilson_vector_assign(vy[j], v);
+      }
+    }
+  }
+}
+
+inline BlockMatrix block_matrix_psd_solve(const BlockMatrix& a, const BlockMatrix& b)
+  // a^+ b for the hermitian positive semi-definite a (a Gram matrix of the block CG)
+  // a is scaled by its diagonal first, so that columns of very different norms (e.g. the
+  // ones that converged earlier) do not make it ill-conditioned, and the pseudo inverse from
+  // a complete orthogonal decomposition (column pivoting QR) drops the directions that are
+  // zero or linearly dependent within the threshold instead of producing NaN
+{
+  const int n = a.rows();
+  qassert(a.cols() == n and b.rows() == n);
+  const double threshold = 1.0e-12;
+  Eigen::VectorXcd d(n);
+  for (int i = 0; i < n; ++i) {
+    const double aii = a(i, i).real();
+    d(i) = aii > 0.0 ? 1.0 / std::sqrt(aii) : 0.0;
+  }
+  const BlockMatrix as = d.asDiagonal() * a * d.asDiagonal();
+  Eigen::CompleteOrthogonalDecomposition<BlockMatrix> cod;
+  cod.setThreshold(threshold);
+  cod.compute(as);
+  return d.asDiagonal() * cod.solve(BlockMatrix(d.asDiagonal() * b));
+}
+
+inline long block_cgne_schur(Field<WilsonVector>& x, const Field<WilsonVector>& b, const CloverWilsonMatrix& cwm,
+    const double stop_rsd, const long max_num_iter, std::vector<double>& rsds)
+  // solve M x_e(n) = b_e(n) for the nrhs = b.geo.multiplicity right hand sides at once
+  // with block CG (O'Leary) on M^dag M x_e = M^dag b_e
+  // x_e is the initial guess, the odd sites of b are not used and the ones of x are overwritten
+  // return the number of iterations, rsds[n] is |M^dag (b - M x)(n)| / |M^dag b(n)|
+  // the iteration stops when all rsds[n] < stop_rsd
+  // zero and linearly dependent columns of b are allowed, see block_matrix_psd_solve,
+  // and x_e(n) is set to zero (rsds[n] = 0) if b_e(n) is zero
+{
+  TIMER_VERBOSE_FLOPS("block_cgne_schur");
+  const Geometry geo = geo_resize(b.geo);
+  const int nrhs = geo.multiplicity;
+  const std::vector<long>& indices = cwm.dsi.get(0);
+  Field<HalfWilsonVector> hf;
+  Field<WilsonVector> r, p, q, s;
+  r.init(geo);
+  p.init(geo);
+  q.init(geo);
+  s.init(geo);
+  fermion_field_copy(p, b, indices);
+  multiply_m_schur_dag(r, p, cwm, hf);
+  const BlockMatrix rr_src = fermion_field_block_dot(r, r, indices);
+  for (int n = 0; n < nrhs; ++n) {
+    if (rr_src(n, n).real() == 0.0) {
+#pragma omp parallel for
+      for (long idx = 0; idx < (long)indices.size(); ++idx) {
+        set_zero(x.get_elems(indices[idx])[n]);
+      }
+    }
+  }
+  multiply_m_schur(q, x, cwm, hf);
+  multiply_m_schur_dag(s, q, cwm, hf);
+  fermion_field_axpy(r, -1.0, s, indices);
+  fermion_field_copy(p, r, indices);
+  BlockMatrix rr = fermion_field_block_dot(r, r, indices);
+  rsds.resize(nrhs);
+  long iter = 0;
+  while (true) {
+    double rsd_max = 0.0;
+    for (int n = 0; n < nrhs; ++n) {
+      rsds[n] = rr_src(n, n).real() == 0.0 ? 0.0 : std::sqrt(rr(n, n).real() / rr_src(n, n).real());
+      rsd_max = std::max(rsd_max, rsds[n]);
+    }
+    if (iter % 100 == 0 and iter != 0) {
+      displayln_info(ssprintf("%s: iter = %ld ; max rsd = %.4E", fname, iter, rsd_max));
+    }
+    if (rsd_max <= stop_rsd or iter >= max_num_iter) {
+      break;
+    }
+    iter += 1;
+    multiply_m_schur(q, p, cwm, hf);
+    // p^dag M^dag M p = q^dag q
+    const BlockMatrix alpha = block_matrix_psd_solve(fermion_field_block_dot(q, q, indices), rr);
+    fermion_field_block_axpy(x, alpha, p, indices);
+    multiply_m_schur_dag(s, q, cwm, hf);
+    fermion_field_block_axpy(r, -alpha, s, indices);
+    const BlockMatrix rr_new = fermion_field_block_dot(r, r, indices);
+    const BlockMatrix beta = block_matrix_psd_solve(rr, rr_new);
+    fermion_field_block_xpay(p, beta, r, indices);
+    rr = rr_new;
+  }
+  timer.flops += iter * 2 * 1824 * indices.size() * 2 * nrhs;
+  double rsd_max = 0.0;
+  for (int n = 0; n < nrhs; ++n) {
+    rsd_max = std::max(rsd_max, rsds[n]);
+  }
+  displayln_info(ssprintf("%s: nrhs = %d ; iter = %ld ; max rsd = %.4E", fname, nrhs, iter, rsd_max));
+  return iter;
+}
+
+inline long inverse_multi_rhs(Field<WilsonVector>& sol, const Field<WilsonVector>& src, const InverterCloverWilson& inv)
+  // solve D sol(n) = src(n) for the nrhs = src.geo.multiplicity right hand sides
+  // with block CGNE if inv.solver is "cgne" (without mixed precision)
+  // and one right hand side at a time with inverse(ff4d, ff4d, inv) otherwise
+  // sol do not need to be initialized
+  // return the number of iterations, get_last_inverter_stats() has the max rsd of the columns
+{
+  TIMER_VERBOSE("inverse_multi_rhs");
+  const CloverWilsonMatrix& cwm = inv.cwm;
+  const int nrhs = src.geo.multiplicity;
+  const Geometry geo = geo_reform(inv.geo, nrhs);
+  if (inv.solver != "cgne" or inv.mixed_precision != "") {
+    sol.init(geo);
+    InverterStats stats;
+    FermionField4d ff_src, ff_sol;
+    for (int n = 0; n < nrhs; ++n) {
+      set_fermion_field_from_block_col(ff_src, src, n);
+      stats.num_iter += inverse(ff_sol, ff_src, inv);
+      stats.rsd = std::max(stats.rsd, get_last_inverter_stats().rsd);
+      stats.true_rsd = std::max(stats.true_rsd, get_last_inverter_stats().true_rsd);
+      set_fermion_field_block_col(sol, n, ff_sol);
+    }
+    get_last_inverter_stats() = stats;
+    return stats.num_iter;
+  }
+  Field<HalfWilsonVector> hf;
+  Field<WilsonVector> b, x, tmp;
+  b.init(geo);
+  x.init(geo);
+  tmp.init(geo);
+  b = src;
+  set_schur_src(tmp, b, cwm, hf);
+  set_zero(x);
+  InverterStats& stats = get_last_inverter_stats();
+  stats.init();
+  std::vector<double> rsds;
+  stats.num_iter = block_cgne_schur(x, tmp, cwm, inv.stop_rsd, inv.max_num_iter, rsds);
+  stats.rsd = *std::max_element(rsds.begin(), rsds.end());
+  set_schur_sol_odd(x, b, cwm, hf);
+  // true residual of each column
+  multiply_clover_wilson(tmp, x, cwm.gf, cwm.ctf, cwm.dsi);
+  const std::vector<long>& indices = cwm.dsi.get(-1);
+  fermion_field_axpy(tmp, -1.0, b, indices);
+  const BlockMatrix rr = fermion_field_block_dot(tmp, tmp, indices);
+  const BlockMatrix bb = fermion_field_block_dot(b, b, indices);
+  for (int n = 0; n < nrhs; ++n) {
+    if (bb(n, n).real() > 0.0) {
+      stats.true_rsd = std::max(stats.true_rsd, std::sqrt(rr(n, n).real() / bb(n, n).real()));
+    }
+  }
+  displayln_info(ssprintf("%s: block cgne nrhs = %d ; iter = %ld ; max rsd = %.4E ; max true rsd = %.4E",
+        fname, nrhs, stats.num_iter, stats.rsd, stats.true_rsd));
+  sol.init(geo);
+  sol = x;
+  return stats.num_iter;
+}
+
+// the propagators with InverterCloverWilson solve the 4*NUM_COLOR columns at once
+// (overloads of the ones in qcd.h)
+
+inline void inverse(Propagator4d& sol, const Propagator4d& src, const InverterCloverWilson& inv)
+  // sol do not need to be initialized
+{
+  TIMER_VERBOSE("inverse(p4d,p4d,inv-clover-wilson)");
+  Field<WilsonVector> ffb_src, ffb_sol;
+  set_fermion_field_block_from_propagator(ffb_src, src);
+  inverse_multi_rhs(ffb_sol, ffb_src, inv);
+  set_propagator_from_fermion_field_block(sol, ffb_sol);
+}
+
+inline void set_point_src_propagator(Propagator4d& prop, const InverterCloverWilson& inv, const Coordinate& xg, const Complex& value = 1.0)
+{
+  TIMER_VERBOSE("set_point_src_propagator");
+  Propagator4d src;
+  set_point_src(src, inv.geo, xg, value);
+  inverse(prop, src, inv);
+}
+
+inline void set_mom_src_propagator(Propagator4d& prop, const CoordinateD& lmom, InverterCloverWilson& inverter)
+{
+  TIMER_VERBOSE("set_mom_src_propagator");
+  const Geometry geo = geo_reform(inverter.geo, 4*NUM_COLOR);
+  Field<WilsonVector> ffb_src, ffb_sol;
+  ffb_src.init(geo);
+  FermionField4d src;
+  src.init(geo_reform(geo));
+  for (int cs = 0; cs < 4*NUM_COLOR; ++cs) {
+    set_mom_src_fermion_field(src, lmom, cs);
+    set_fermion_field_block_col(ffb_src, cs, src);
+  }
+  inverse_multi_rhs(ffb_sol, ffb_src, inverter);
+  set_propagator_from_fermion_field_block(prop, ffb_sol);
+}
+
+inline void set_tslice_mom_src_propagator(Propagator4d& prop, const int tslice, const CoordinateD& lmom, InverterCloverWilson& inverter)
+{
+  TIMER_VERBOSE("set_tslice_mom_src_propagator");
+  const Geometry geo = geo_reform(inverter.geo, 4*NUM_COLOR);
+  Field<WilsonVector> ffb_src, ffb_sol;
+  ffb_src.init(geo);
+  FermionField4d src;
+  src.init(geo_reform(geo));
+  for (int cs = 0; cs < 4*NUM_COLOR; ++cs) {
+    set_tslice_mom_src_fermion_field(src, tslice, lmom, cs);
+    set_fermion_field_block_col(ffb_src, cs, src);
+  }
+  inverse_multi_rhs(ffb_sol, ffb_src, inverter);
+  set_propagator_from_fermion_field_block(prop, ffb_sol);
+}
+
+QLAT_END_NAMESPACE
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <qlat/qcd.h>
+#include <qlat/fermion-action.h>
+#include <qlat/qcd-dirac.h>
+#include <qlat/qcd-inverter.h>
+#include <qlat/qcd-dwf.h>
+#include <qlat/compressed-eigen-io.h>
+
+QLAT_START_NAMESPACE
+
+// Thick restart Lanczos (Wu, Simon, SIAM J. Matrix Anal. Appl. 22 (2000) 602)
+// for the lowest eigen pairs of M^dag M, with M the even/odd preconditioned
+// Mobius domain wall operator of qcd-dwf.h on the odd sites. The parameters
+// are the ones of LancArg:
+//
+//   n_use      : the size of the Krylov space
+//   n_get      : the number of Ritz vectors kept at each restart
+//   n_true_get : the number of eigen pairs wanted
+//   ch_alpha, ch_beta, ch_ord : the Krylov space is the one of the Chebyshev
+//     polynomial T_ch_ord(x) with x = (ch_alpha + ch_beta - 2 M^dag M) / (ch_alpha - ch_beta),
+//     which maps [ch_beta, ch_alpha] to [-1, 1] and amplifies the eigen values
+//     below ch_beta. ch_alpha has to be above the largest eigen value of M^dag M.
+//
+// Each new Lanczos vector is orthogonalized (twice) against all the previous
+// ones with the multi-vector kernels below, which read each site of the new
+// vector once for the whole basis and need one global sum, and the restarts
+// rotate the basis with a matrix product on each site.
+//
+// The eigen vectors are FermionField5d with only the odd sites set, the input
+// of compress_eigen_system and save_compressed_eigen_vectors.
+
+inline void fermion_fields_dot(std::vector<Complex>& dots, const std::vector<FermionField5d>& vs, const long n,
+    const FermionField5d& w, const std::vector<long>& indices)
+  // dots[j] = <vs[j], w> for j < n
+{
+  TIMER_FLOPS("fermion_fields_dot");
+  const int ls = w.geo.multiplicity;
+  timer.flops += 8 * 4 * NUM_COLOR * indices.size() * ls * n;
+  std::vector<std::vector<Complex> > sums(omp_get_max_threads());
+#pragma omp parallel
+  {
+    std::vector<Complex> sum(n, 0.0);
+#pragma omp for
+    for (long idx = 0; idx < (long)indices.size(); ++idx) {
+      const Vector<WilsonVector> vw = w.get_elems_const(indices[idx]);
+      for (long j = 0; j < n; ++j) {
+        const Vector<WilsonVector> v = vs[j].get_elems_const(indices[idx]);
+        Complex s = 0.0;
+        for (int m = 0; m < ls; ++m) {
+          for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+            s += std::conj(v[m].p[k]) * vw[m].p[k];
+          }
+        }
+        sum[j] += s;
+      }
+    }
+    sums[omp_get_thread_num()] = sum;
+  }
+  dots.assign(n, 0.0);
+  for (size_t t = 0; t < sums.size(); ++t) {
+    for (long j = 0; j < (long)sums[t].size(); ++j) {
+      dots[j] += sums[t][j];
+    }
+  }
+  glb_sum(get_data(dots), w.geo.geon.comm);
+}
+
+inline void fermion_fields_axpy(FermionField5d& w, const std::vector<Complex>& a, const std::vector<FermionField5d>& vs,
+    const long n, const std::vector<long>& indices)
+  // w = w + sum_{j < n} a[j] vs[j]
+{
+  TIMER_FLOPS("fermion_fields_axpy");
+  const int ls = w.geo.multiplicity;
+  timer.flops += 8 * 4 * NUM_COLOR * indices.size() * ls * n;
+#pragma omp parallel for
+  for (long idx = 0; idx < (long)indices.size(); ++idx) {
+    Vector<WilsonVector> vw = w.get_elems(indices[idx]);
+    for (long j = 0; j < n; ++j) {
+      const Vector<WilsonVector> v = vs[j].get_elems_const(indices[idx]);
+      const Complex c = a[j];
+      for (int m = 0; m < ls; ++m) {
+        for (int k = 0; k < 4 * NUM_COLOR; ++k) {
+          vw[m].p[k] += c * v[m].p[k];
+        }
+      }
+    }
+  }
+}
+
+inline void fermion_fields_rotate(std::vector<FermionField5d>& vs, const BlockMatrix& q, const std::vector<long>& indices)
+  // vs[i] = sum_j vs[j] q(j, i) for i < q.cols() and j < q.rows() (in place)
+  // on each site as the product of the (site size x q.rows()) and the q matrices
+{
+  TIMER_FLOPS("fermion_fields_rotate");
+  const long nr = q.rows();
+  const long nc = q.cols();
+  qassert(nc <= nr and nr <= (long)vs.size());
+  const int ls = vs[0].geo.multiplicity;
+  const long site_size = ls * 4 * NUM_COLOR;
+  timer.flops += 8 * site_size * indices.size() * nr * nc;
+#pragma omp parallel
+  {
+    BlockMatrix x(site_size, nr), y(site_size, nc);
+#pragma omp for
+    for (long idx = 0; idx < (long)indices.size(); ++idx) {
+      for (long j = 0; j < nr; ++j) {
+        const Complex* p = (const Complex*)vs[j].get_elems_const(indices[idx]).data();
+        for (long m = 0; m < site_size; ++m) {
+          x(m, j) = p[m];
+        }
+      }
+      y.noalias() = x * q;
+      for (long i = 0; i < nc; ++i) {
+        Complex* p = (Complex*)vs[i].get_elems(indices[idx]).data();
+        for (long m = 0; m < site_size; ++m) {
+          p[m] = y(m, i);
+        }
+      }
+    }
+  }
+}
+
+inline void multiply_chebyshev_mdag_m_schur(FermionField5d& out, const FermionField5d& in,
+    const DomainWallMatrix& dwm, const LancArg& la)
+  // out_o = T_ch_ord(x) in_o with x = (ch_alpha + ch_beta - 2 M^dag M) / (ch_alpha - ch_beta)
+  // (out can not be in)
+{
+  TIMER("multiply_chebyshev_mdag_m_schur");
+  const Geometry geo = geo_resize(in.geo);
+  const std::vector<long>& indices = dwm.dsi.get(1);
+  qassert(la.ch_alpha > la.ch_beta);
+  const double c0 = (la.ch_alpha + la.ch_beta) / (la.ch_alpha - la.ch_beta);
+  const double c1 = -2.0 / (la.ch_alpha - la.ch_beta);
+  out.init(geo);
+  qassert(is_matching_geo_mult(out.geo, geo));
+  set_zero(out);
+  fermion_field_copy(out, in, indices);
+  if (la.ch_ord <= 0) {
+    return;
+  }
+  FermionField5d t0, u;
+  t0.init(geo);
+  set_zero(t0);
+  for (long k = 1; k <= la.ch_ord; ++k) {
+    // (t0, out) = (T_{k-1}, T_k) from (T_{k-2}, T_{k-1}) with T_1 = x T_0 and T_k = 2 x T_{k-1} - T_{k-2}
+    const double coef = k == 1 ? 1.0 : 2.0;
+    const double coef_0 = k == 1 ? 0.0 : -1.0;
+    multiply_mdag_m_schur(u, out, dwm);
+#pragma omp parallel for
+    for (long idx = 0; idx < (long)indices.size(); ++idx) {
+      Vector<WilsonVector> v0 = t0.get_elems(indices[idx]);
+      Vector<WilsonVector> v1 = out.get_elems(indices[idx]);
+      const Vector<WilsonVector> vu = u.get_elems_const(indices[idx]);
+      for (int m = 0; m < v1.size(); ++m) {
+        for (int j = 0; j < 4 * NUM_COLOR; ++j) {
+          const Complex t = coef * (c0 * v1[m].p[j] + c1 * vu[m].p[j]) + coef_0 * v0[m].p[j];
+          v0[m].p[j] = v1[m].p[j];
+          v1[m].p[j] = t;
+        }
+      }
+    }
+  }
+}
+
+inline long lanczos_dwf(std::vector<double>& eigen_values, std::vector<FermionField5d>& eigen_vectors,
+    const DomainWallMatrix& dwm, const LancArg& la, const double stop_rsd = 1.0e-8, const long max_num_restart = 100)
+  // interface
+  // the la.n_true_get lowest eigen pairs of M^dag M (eigen_values ascending)
+  // converged if |M^dag M v - lambda v| < stop_rsd * la.ch_alpha
+  // return the number of restarts
+{
+  TIMER_VERBOSE("lanczos_dwf");
+  const Geometry geo = geo_resize(dwm.geo);
+  const std::vector<long>& indices = dwm.dsi.get(1);
+  const long n_use = la.n_use;
+  const long n_get = la.n_get;
+  const long n_true_get = la.n_true_get;
+  qassert(0 < n_true_get and n_true_get <= n_get and n_get < n_use);
+  qassert(0.0 < la.ch_beta and la.ch_beta < la.ch_alpha);
+  displayln_info(ssprintf("%s: n_use = %ld ; n_get = %ld ; n_true_get = %ld ; ch_alpha = %.4E ; ch_beta = %.4E ; ch_ord = %ld",
+        fname, n_use, n_get, n_true_get, la.ch_alpha, la.ch_beta, la.ch_ord));
+  std::vector<FermionField5d> vs(n_use);
+  for (long j = 0; j < n_use; ++j) {
+    vs[j].init(geo);
+    set_zero(vs[j]);
+  }
+  FermionField5d w, u;
+  w.init(geo);
+  u.init(geo);
+  RngState rs(get_global_rng_state(), fname);
+  set_g_rand_fermion_field(w, rs);
+  fermion_field_axpy(vs[0], 1.0 / std::sqrt(fermion_field_norm2(w, indices)), w, indices);
+  BlockMatrix t = BlockMatrix::Zero(n_use, n_use);
+  std::vector<Complex> h, h2;
+  std::vector<double> lambdas(n_true_get, 0.0), rsds(n_true_get, 0.0);
+  long k = 0;
+  long num_restart = 0;
+  long num_converged = 0;
+  while (true) {
+    for (long j = k; j < n_use; ++j) {
+      multiply_chebyshev_mdag_m_schur(w, vs[j], dwm, la);
+      // w = w - V V^dag w twice, h = V^dag w is the column j of t
+      h.assign(j + 1, 0.0);
+      for (int pass = 0; pass < 2; ++pass) {
+        fermion_fields_dot(h2, vs, j + 1, w, indices);
+        for (long i = 0; i <= j; ++i) {
+          h[i] += h2[i];
+          h2[i] = -h2[i];
+        }
+        fermion_fields_axpy(w, h2, vs, j + 1, indices);
+      }
+      for (long i = 0; i < j; ++i) {
+        t(i, j) = h[i];
+        t(j, i) = std::conj(h[i]);
+      }
+      t(j, j) = h[j].real();
+      const double beta = std::sqrt(fermion_field_norm2(w, indices));
+      if (j + 1 < n_use) {
+        t(j + 1, j) = beta;
+        t(j, j + 1) = beta;
+        set_zero(vs[j + 1]);
+        fermion_field_axpy(vs[j + 1], 1.0 / beta, w, indices);
+      }
+    }
+    // Ritz pairs of the largest eigen values of the Chebyshev polynomial
+    const Eigen::SelfAdjointEigenSolver<BlockMatrix> es(t);
+    BlockMatrix q(n_use, n_get);
+    std::vector<double> thetas(n_get);
+    for (long i = 0; i < n_get; ++i) {
+      q.col(i) = es.eigenvectors().col(n_use - 1 - i);
+      thetas[i] = es.eigenvalues()(n_use - 1 - i);
+    }
+    const double beta = std::sqrt(fermion_field_norm2(w, indices));
+    fermion_fields_rotate(vs, q, indices);
+    num_converged = 0;
+    for (long i = 0; i < n_true_get; ++i) {
+      multiply_mdag_m_schur(u, vs[i], dwm);
+      lambdas[i] = fermion_field_dot(vs[i], u, indices).real();
+      rsds[i] = std::sqrt(fermion_field_axpy_norm2(u, -lambdas[i], vs[i], indices));
+      if (num_converged == i and rsds[i] < stop_rsd * la.ch_alpha) {
+        num_converged += 1;
+      }
+    }
+    displayln_info(ssprintf("%s: restart = %ld ; converged = %ld / %ld ; lambda[0] = %.6E ; rsd[0] = %.2E",
+          fname, num_restart, num_converged, n_true_get, lambdas[0], rsds[0]));
+    if (num_converged >= n_true_get or num_restart >= max_num_restart) {
+      break;
+    }
+    // thick restart: t is diagonal on the Ritz vectors and the residual couples to them
+    t.setZero();
+    for (long i = 0; i < n_get; ++i) {
+      t(i, i) = thetas[i];
+      t(n_get, i) = beta * q(n_use - 1, i);
+      t(i, n_get) = std::conj(t(n_get, i));
+    }
+    set_zero(vs[n_get]);
+    fermion_field_axpy(vs[n_get], 1.0 / beta, w, indices);
+    k = n_get;
+    num_restart += 1;
+  }
+  if (num_converged < n_true_get) {
+    displayln_info(ssprintf("%s: WARNING only %ld / %ld converged", fname, num_converged, n_true_get));
+  }
+  std::vector<std::pair<double,long> > order(n_true_get);
+  for (long i = 0; i < n_true_get; ++i) {
+    order[i] = std::pair<double,long>(lambdas[i], i);
+  }
+  std::sort(order.begin(), order.end());
+  eigen_values.resize(n_true_get);
+  eigen_vectors.resize(n_true_get);
+  for (long i = 0; i < n_true_get; ++i) {
+    eigen_values[i] = order[i].first;
+    Field<WilsonVector>& f1 = eigen_vectors[i];
+    Field<WilsonVector>& f2 = vs[order[i].second];
+    std::swap(f1, f2);
+    displayln_info(ssprintf("%s: %5ld lambda = %24.17E ; rsd = %.2E", fname, i, eigen_values[i], rsds[order[i].second]));
+  }
+  return num_restart;
+}
+
+QLAT_END_NAMESPACE
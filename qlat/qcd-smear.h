@@ -43,17 +43,68 @@ inline ColorMatrix color_matrix_sub_inverse(const ColorMatrix& x, const int ind)
   }
 }
 
-inline ColorMatrix color_matrix_su_projection(const ColorMatrix& x, const double tolerance = 1.0e-8)
+inline bool color_matrix_su_projection_polar(ColorMatrix& y, const ColorMatrix& x)
+  // y = x (x^dag x)^(-1/2) det(...)^(-1/3) from the eigenvalues of x^dag x
+  // in closed form, no iteration
+  // return false (y untouched) if x is too close to singular
 {
-  // usually takes ~5 hits, so just exit
-  // if hits the max, as something is
+  qassert(3 == NUM_COLOR);
+  const ColorMatrix w = matrix_adjoint(x) * x;
+  const ColorMatrix w2 = w * w;
+  const double a = matrix_trace(w).real();
+  const double b = 0.5 * (a * a - matrix_trace(w2).real());
+  const double c = w.em().determinant().real();
+  if (!(a > 0.0)) {
+    return false;
+  }
+  // eigenvalues of w, roots of l^3 - a l^2 + b l - c
+  double ls[3];
+  const double p = (a * a - 3.0 * b) / 9.0;
+  if (p <= 1.0e-15 * a * a) {
+    ls[0] = ls[1] = ls[2] = a / 3.0;
+  } else {
+    const double r = (9.0 * a * b - 2.0 * a * a * a - 27.0 * c) / 54.0;
+    const double theta = std::acos(std::max(-1.0, std::min(1.0, r / (p * std::sqrt(p)))));
+    for (int k = 0; k < 3; ++k) {
+      ls[k] = a / 3.0 - 2.0 * std::sqrt(p) * std::cos((theta + 2.0 * PI * k) / 3.0);
+    }
+  }
+  for (int k = 0; k < 3; ++k) {
+    if (!(ls[k] > 1.0e-10 * a)) {
+      return false;
+    }
+  }
+  // w^(-1/2) = f0 + f1 w + f2 w^2
+  const double s0 = std::sqrt(ls[0]);
+  const double s1 = std::sqrt(ls[1]);
+  const double s2 = std::sqrt(ls[2]);
+  const double su = s0 + s1 + s2;
+  const double sv = s0 * s1 + s0 * s2 + s1 * s2;
+  const double sw = s0 * s1 * s2;
+  const double den = 1.0 / (sw * (su * sv - sw));
+  const double f0 = (-sw * (su * su + sv) + su * sv * sv) * den;
+  const double f1 = (-sw - su * su * su + 2.0 * su * sv) * den;
+  const double f2 = su * den;
+  ColorMatrix inv_sqrt = f1 * w + f2 * w2;
+  for (int i = 0; i < NUM_COLOR; ++i) {
+    inv_sqrt(i,i) += f0;
+  }
+  y = x * inv_sqrt;
+  const Complex det = y.em().determinant();
+  y *= std::polar(1.0, -std::arg(det) / 3.0);
+  return true;
+}
+
+inline void color_matrix_su_projection_hits(ColorMatrix& y, const ColorMatrix& x, const double tolerance)
+  // maximize Re tr(y x^dag) over SU(3) with SU(2) subgroup hits starting from y
+{
+  // usually takes ~5 hits from the unit matrix (~1 from the polar
+  // projection), so just exit if hits the max, as something is
   // probably very wrong.
   const int max_iter = 10000;
   const ColorMatrix xdag = matrix_adjoint(x);
-  ColorMatrix tmp = xdag;
-  ColorMatrix y;
-  set_unit(y);
-  double old_tr = matrix_trace(xdag).real();
+  ColorMatrix tmp = y * xdag;
+  double old_tr = matrix_trace(tmp).real();
   for (int i=0;i<max_iter;i++) {
     // loop over su2 subgroups
     double diff = 0.0;
@@ -78,17 +129,50 @@ inline ColorMatrix color_matrix_su_projection(const ColorMatrix& x, const double
     qassert(i < max_iter - 1);
   }
   unitarize(y);
+}
+
+inline ColorMatrix color_matrix_su_projection(const ColorMatrix& x, const double tolerance = 1.0e-8)
+  // SU(2) subgroup hits starting from the unit matrix
+{
+  ColorMatrix y;
+  set_unit(y);
+  color_matrix_su_projection_hits(y, x, tolerance);
+  return y;
+}
+
+inline ColorMatrix color_matrix_su_projection_polar_start(const ColorMatrix& x, const double tolerance = 1.0e-8)
+  // SU(2) subgroup hits starting from color_matrix_su_projection_polar
+  // fewer hits, but not bit for bit the result of color_matrix_su_projection
+{
+  ColorMatrix y;
+  if (!color_matrix_su_projection_polar(y, x)) {
+    set_unit(y);
+  }
+  color_matrix_su_projection_hits(y, x, tolerance);
   return y;
 }
 
+inline ColorMatrix color_matrix_su_projection_smear(const ColorMatrix& x, const bool is_polar_start)
+  // the projection of the APE, spatial APE and HYP smearing
+  // is_polar_start = false : color_matrix_su_projection, bit for bit the smeared links of the older versions
+  // is_polar_start = true : color_matrix_su_projection_polar_start, fewer SU(2) hits
+{
+  if (is_polar_start) {
+    return color_matrix_su_projection_polar_start(x);
+  } else {
+    return color_matrix_su_projection(x);
+  }
+}
+
 inline ColorMatrix gf_link_ape_smear_no_comm(const GaugeField& gf, const Coordinate& xl, const int mu,
-    const double alpha)
+    const double alpha, const bool is_polar_start = false)
 {
-  return color_matrix_su_projection(
-      (1.0 - alpha) * gf.get_elem(xl, mu) + (alpha / 6.0) * gf_staple_no_comm(gf, xl, mu));
+  return color_matrix_su_projection_smear(
+      (1.0 - alpha) * gf.get_elem(xl, mu) + (alpha / 6.0) * gf_staple_no_comm(gf, xl, mu), is_polar_start);
 }
 
-inline void gf_ape_smear_no_comm(GaugeField& gf, const GaugeField& gf0, const double alpha)
+inline void gf_ape_smear_no_comm(GaugeField& gf, const GaugeField& gf0, const double alpha,
+    const bool is_polar_start = false)
 {
   TIMER_VERBOSE("gf_ape_smear_no_comm");
   qassert(&gf != &gf0);
@@ -100,12 +184,14 @@ inline void gf_ape_smear_no_comm(GaugeField& gf, const GaugeField& gf0, const do
     const Coordinate xl = geo.coordinate_from_index(index);
     Vector<ColorMatrix> v = gf.get_elems(xl);
     for (int mu = 0; mu < DIMN; ++mu) {
-      v[mu] = gf_link_ape_smear_no_comm(gf0, xl, mu, alpha);
+      v[mu] = gf_link_ape_smear_no_comm(gf0, xl, mu, alpha, is_polar_start);
     }
   }
 }
 
-inline void gf_ape_smear(GaugeField& gf, const GaugeField& gf0, const double alpha, const long steps = 1)
+inline void gf_ape_smear(GaugeField& gf, const GaugeField& gf0, const double alpha, const long steps = 1,
+    const bool is_polar_start = false)
+  // is_polar_start : see color_matrix_su_projection_smear
 {
   TIMER_VERBOSE("gf_ape_smear");
   GaugeField gf1;
@@ -113,19 +199,20 @@ inline void gf_ape_smear(GaugeField& gf, const GaugeField& gf0, const double alp
   for (long i = 0; i < steps; ++i) {
     gf1 = gf0;
     refresh_expanded(gf1);
-    gf_ape_smear_no_comm(gf, gf1, alpha);
+    gf_ape_smear_no_comm(gf, gf1, alpha, is_polar_start);
   }
 }
 
 inline ColorMatrix gf_link_spatial_ape_smear_no_comm(const GaugeField& gf, const Coordinate& xl, const int mu,
-    const double alpha)
+    const double alpha, const bool is_polar_start = false)
 {
   const double multi = mu == 3 ? 6.0 : 3.0;
-  return color_matrix_su_projection(
-      (1.0 - alpha) * gf.get_elem(xl, mu) + (alpha / multi) * gf_spatial_staple_no_comm(gf, xl, mu));
+  return color_matrix_su_projection_smear(
+      (1.0 - alpha) * gf.get_elem(xl, mu) + (alpha / multi) * gf_spatial_staple_no_comm(gf, xl, mu), is_polar_start);
 }
 
-inline void gf_spatial_ape_smear_no_comm(GaugeField& gf, const GaugeField& gf0, const double alpha)
+inline void gf_spatial_ape_smear_no_comm(GaugeField& gf, const GaugeField& gf0, const double alpha,
+    const bool is_polar_start = false)
 {
   TIMER_VERBOSE("gf_spatial_ape_smear_no_comm");
   qassert(&gf != &gf0);
@@ -138,12 +225,14 @@ inline void gf_spatial_ape_smear_no_comm(GaugeField& gf, const GaugeField& gf0,
     Vector<ColorMatrix> v = gf.get_elems(xl);
     for (int mu = 0; mu < 3; ++mu) {
       // No need to smear the temperal link (mu == 3)
-      v[mu] = gf_link_spatial_ape_smear_no_comm(gf0, xl, mu, alpha);
+      v[mu] = gf_link_spatial_ape_smear_no_comm(gf0, xl, mu, alpha, is_polar_start);
     }
   }
 }
 
-inline void gf_spatial_ape_smear(GaugeField& gf, const GaugeField& gf0, const double alpha, const long steps = 1)
+inline void gf_spatial_ape_smear(GaugeField& gf, const GaugeField& gf0, const double alpha, const long steps = 1,
+    const bool is_polar_start = false)
+  // is_polar_start : see color_matrix_su_projection_smear
 {
   TIMER_VERBOSE("gf_spatial_ape_smear");
   const Coordinate expan_left(1,1,1,0);
@@ -153,12 +242,180 @@ inline void gf_spatial_ape_smear(GaugeField& gf, const GaugeField& gf0, const do
   for (long i = 0; i < steps; ++i) {
     gf1 = gf0;
     refresh_expanded(gf1);
-    gf_spatial_ape_smear_no_comm(gf, gf1, alpha);
+    gf_spatial_ape_smear_no_comm(gf, gf1, alpha, is_polar_start);
+  }
+}
+
+inline ColorMatrix gf_link_stout_smear_no_comm(const GaugeField& gf, const Coordinate& xl, const int mu,
+    const double rho)
+  // exp(i Q) U with i Q = TA(C U^dag) and C = rho * staples
+  // (Morningstar & Peardon, hep-lat/0311018)
+{
+  const ColorMatrix& u = gf.get_elem(xl, mu);
+  const ColorMatrix c = rho * gf_staple_no_comm(gf, xl, mu);
+  return make_color_matrix_exp_cayley_hamilton(make_tr_less_anti_herm_matrix(c * matrix_adjoint(u))) * u;
+}
+
+inline void gf_stout_smear_no_comm(GaugeField& gf, const GaugeField& gf0, const double rho)
+{
+  TIMER_VERBOSE("gf_stout_smear_no_comm");
+  qassert(&gf != &gf0);
+  const Geometry& geo = gf0.geo;
+  gf.init(geo_resize(geo));
+  qassert(is_matching_geo_mult(geo, gf.geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> v = gf.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      v[mu] = gf_link_stout_smear_no_comm(gf0, xl, mu, rho);
+    }
+  }
+}
+
+inline void gf_stout_smear(GaugeField& gf, const GaugeField& gf0, const double rho, const long steps = 1)
+  // gf can be gf0, only one expanded buffer is used for all the steps
+  // steps = 0 just copies gf0 to gf
+{
+  TIMER_VERBOSE("gf_stout_smear");
+  qassert(steps >= 0);
+  if (steps == 0) {
+    if (&gf != &gf0) {
+      gf.init(geo_resize(gf0.geo));
+      gf = gf0;
+    }
+    return;
+  }
+  GaugeField gf1;
+  gf1.init(geo_resize(gf0.geo, 1));
+  gf1 = gf0;
+  for (long i = 0; i < steps; ++i) {
+    refresh_expanded(gf1);
+    gf_stout_smear_no_comm(gf, gf1, rho);
+    if (i < steps - 1) {
+      gf1 = gf;
+    }
+  }
+}
+
+inline void gf_stout_smear_force_1_no_comm(GaugeField& sigma, GaugeField& kf,
+    const GaugeField& sigma_prime, const GaugeField& gf, const double rho)
+  // sigma = Sigma' exp(i Q) + i C^dag Lambda
+  // kf = - i rho U^dag Lambda, the coefficient of the variation of the staples
+  // sigma can be sigma_prime, gf needs expansion 1
+{
+  TIMER_VERBOSE("gf_stout_smear_force_1_no_comm");
+  const Geometry& geo = gf.geo;
+  const Complex ii(0.0, 1.0);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> vs = sigma.get_elems(xl);
+    Vector<ColorMatrix> vk = kf.get_elems(xl);
+    const Vector<ColorMatrix> vsp = sigma_prime.get_elems_const(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      const ColorMatrix& u = gf.get_elem(xl, mu);
+      const ColorMatrix c = rho * gf_staple_no_comm(gf, xl, mu);
+      const ColorMatrix q = -ii * make_tr_less_anti_herm_matrix(c * matrix_adjoint(u));
+      const ColorMatrix q2 = q * q;
+      const ColorMatrixExpCoefs coefs = make_color_matrix_exp_coefs(q, q2, true);
+      const ColorMatrix lambda = make_color_matrix_exp_lambda(coefs, q, q2, u * vsp[mu]);
+      vs[mu] = vsp[mu] * make_color_matrix_exp_from_coefs(coefs, q, q2) + ii * matrix_adjoint(c) * lambda;
+      vk[mu] = (-ii * rho) * matrix_adjoint(u) * lambda;
+    }
+  }
+}
+
+inline void gf_stout_smear_force_2_no_comm(GaugeField& sigma, const GaugeField& kf, const GaugeField& gf)
+  // add the contributions of the links in the staples of the neighboring links
+  // kf and gf need expansion 1
+{
+  TIMER_VERBOSE("gf_stout_smear_force_2_no_comm");
+  const Geometry& geo = gf.geo;
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> vs = sigma.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      const Coordinate xl_mu = coordinate_shifts(xl,mu);
+      ColorMatrix ret;
+      set_zero(ret);
+      for (int nu = 0; nu < DIMN; ++nu) {
+        if (mu == nu) {
+          continue;
+        }
+        const Coordinate xl_nu = coordinate_shifts(xl,nu);
+        const Coordinate xl_mnu = coordinate_shifts(xl,-nu-1);
+        const Coordinate xl_mu_mnu = coordinate_shifts(xl_mu,-nu-1);
+        // U_mu(x) in the staples of U_nu at x, x-nu, x+mu and x+mu-nu
+        ret += gf.get_elem(xl_mu, nu) *
+          matrix_adjoint(gf.get_elem(xl_nu, mu)) * kf.get_elem(xl, nu);
+        ret += matrix_adjoint(gf.get_elem(xl_mu_mnu, nu)) *
+          matrix_adjoint(gf.get_elem(xl_mnu, mu)) * matrix_adjoint(kf.get_elem(xl_mnu, nu));
+        ret += matrix_adjoint(gf.get_elem(xl, nu) *
+            gf.get_elem(xl_nu, mu) * kf.get_elem(xl_mu, nu));
+        ret += kf.get_elem(xl_mu_mnu, nu) *
+          matrix_adjoint(gf.get_elem(xl_mnu, mu)) * gf.get_elem(xl_mnu, nu);
+        // U_mu(x) as the middle link of the staples of U_mu(x-nu) and U_mu(x+nu)
+        ret += matrix_adjoint(gf.get_elem(xl_mu_mnu, nu)) *
+          kf.get_elem(xl_mnu, mu) * gf.get_elem(xl_mnu, nu);
+        ret += gf.get_elem(xl_mu, nu) *
+          kf.get_elem(xl_nu, mu) * matrix_adjoint(gf.get_elem(xl, nu));
+      }
+      vs[mu] += ret;
+    }
+  }
+}
+
+inline void gf_stout_smear_force(GaugeField& sigma, const GaugeField& sigma_prime, const GaugeField& gf0,
+    const double rho)
+  // chain rule through one stout step gf' = stout(gf0) in the convention
+  // delta S = Re sum_{x,mu} tr(Sigma_mu(x) delta U_mu(x))
+  // sigma_prime = Sigma' for gf' ; sigma = Sigma for gf0 ; sigma can be sigma_prime
+{
+  TIMER_VERBOSE("gf_stout_smear_force");
+  const Geometry geo1 = geo_resize(gf0.geo, 1);
+  GaugeField gf1;
+  gf1.init(geo1);
+  gf1 = gf0;
+  refresh_expanded(gf1);
+  GaugeField kf;
+  kf.init(geo1);
+  sigma.init(geo_resize(gf0.geo));
+  gf_stout_smear_force_1_no_comm(sigma, kf, sigma_prime, gf1, rho);
+  refresh_expanded(kf);
+  gf_stout_smear_force_2_no_comm(sigma, kf, gf1);
+}
+
+inline void gf_stout_smear_force(GaugeField& sigma, const GaugeField& sigma_prime, const GaugeField& gf0,
+    const double rho, const long steps)
+  // chain rule through steps stout steps, the intermediate fields are recomputed
+  // steps = 0 just copies sigma_prime to sigma
+{
+  TIMER_VERBOSE("gf_stout_smear_force-steps");
+  qassert(steps >= 0);
+  if (steps == 0) {
+    if (&sigma != &sigma_prime) {
+      sigma.init(geo_resize(sigma_prime.geo));
+      sigma = sigma_prime;
+    }
+    return;
+  }
+  std::vector<GaugeField> gfs(steps);
+  gfs[0].init(geo_resize(gf0.geo));
+  gfs[0] = gf0;
+  for (long i = 1; i < steps; ++i) {
+    gf_stout_smear(gfs[i], gfs[i-1], rho);
+  }
+  sigma.init(geo_resize(gf0.geo));
+  sigma = sigma_prime;
+  for (long i = steps - 1; i >= 0; --i) {
+    gf_stout_smear_force(sigma, sigma, gfs[i], rho);
   }
 }
 
 inline ColorMatrix gf_link_hyp_smear_3_no_comm(const GaugeField& gf, const Coordinate& xl, const int mu,
-    const int nu, const int rho, const double alpha3)
+    const int nu, const int rho, const double alpha3, const bool is_polar_start = false)
 {
   ColorMatrix ret;
   set_zero(ret);
@@ -174,57 +431,59 @@ inline ColorMatrix gf_link_hyp_smear_3_no_comm(const GaugeField& gf, const Coord
     }
   }
   ret = (1.0 - alpha3) * gf.get_elem(xl, mu) + (alpha3 / 2.0) * ret;
-  return color_matrix_su_projection(ret);
+  return color_matrix_su_projection_smear(ret, is_polar_start);
 }
 
 inline ColorMatrix gf_link_hyp_smear_2_no_comm(const GaugeField& gf, const Coordinate& xl, const int mu,
-    const int nu, const double alpha2, const double alpha3)
+    const int nu, const double alpha2, const double alpha3, const bool is_polar_start = false)
 {
   ColorMatrix ret;
   set_zero(ret);
   const Coordinate xl_mu = coordinate_shifts(xl,mu);
   for (int m = 0; m < DIMN; ++m) {
     if (mu != m && nu != m) {
-      ret += gf_link_hyp_smear_3_no_comm(gf, xl, m, mu, nu, alpha3) *
-        gf_link_hyp_smear_3_no_comm(gf,coordinate_shifts(xl, m), mu, m, nu, alpha3) *
-        matrix_adjoint(gf_link_hyp_smear_3_no_comm(gf, xl_mu, m, mu, nu, alpha3));
-      ret += matrix_adjoint(gf_link_hyp_smear_3_no_comm(gf, coordinate_shifts(xl,-m-1), m, mu, nu, alpha3)) *
-        gf_link_hyp_smear_3_no_comm(gf, coordinate_shifts(xl,-m-1), mu, m, nu, alpha3) *
-        gf_link_hyp_smear_3_no_comm(gf, coordinate_shifts(xl_mu,-m-1), m, mu, nu, alpha3);
+      ret += gf_link_hyp_smear_3_no_comm(gf, xl, m, mu, nu, alpha3, is_polar_start) *
+        gf_link_hyp_smear_3_no_comm(gf,coordinate_shifts(xl, m), mu, m, nu, alpha3, is_polar_start) *
+        matrix_adjoint(gf_link_hyp_smear_3_no_comm(gf, xl_mu, m, mu, nu, alpha3, is_polar_start));
+      ret += matrix_adjoint(gf_link_hyp_smear_3_no_comm(gf, coordinate_shifts(xl,-m-1), m, mu, nu, alpha3, is_polar_start)) *
+        gf_link_hyp_smear_3_no_comm(gf, coordinate_shifts(xl,-m-1), mu, m, nu, alpha3, is_polar_start) *
+        gf_link_hyp_smear_3_no_comm(gf, coordinate_shifts(xl_mu,-m-1), m, mu, nu, alpha3, is_polar_start);
     }
   }
   ret = (1.0 - alpha2) * gf.get_elem(xl, mu) + (alpha2 / 4.0) * ret;
-  return color_matrix_su_projection(ret);
+  return color_matrix_su_projection_smear(ret, is_polar_start);
 }
 
 inline ColorMatrix gf_link_hyp_smear_1_no_comm(const GaugeField& gf, const Coordinate& xl, const int mu,
-    const double alpha1, const double alpha2, const double alpha3)
+    const double alpha1, const double alpha2, const double alpha3, const bool is_polar_start = false)
 {
   ColorMatrix ret;
   set_zero(ret);
   const Coordinate xl_mu = coordinate_shifts(xl,mu);
   for (int m = 0; m < DIMN; ++m) {
     if (mu != m) {
-      ret += gf_link_hyp_smear_2_no_comm(gf, xl, m, mu, alpha2, alpha3) *
-        gf_link_hyp_smear_2_no_comm(gf, coordinate_shifts(xl, m), mu, m, alpha2, alpha3) *
-        matrix_adjoint(gf_link_hyp_smear_2_no_comm(gf, xl_mu, m, mu, alpha2, alpha3));
-      ret += matrix_adjoint(gf_link_hyp_smear_2_no_comm(gf, coordinate_shifts(xl,-m-1), m, mu, alpha2, alpha3)) *
-        gf_link_hyp_smear_2_no_comm(gf, coordinate_shifts(xl,-m-1), mu, m, alpha2, alpha3) *
-        gf_link_hyp_smear_2_no_comm(gf, coordinate_shifts(xl_mu,-m-1), m, mu, alpha2, alpha3);
+      ret += gf_link_hyp_smear_2_no_comm(gf, xl, m, mu, alpha2, alpha3, is_polar_start) *
+        gf_link_hyp_smear_2_no_comm(gf, coordinate_shifts(xl, m), mu, m, alpha2, alpha3, is_polar_start) *
+        matrix_adjoint(gf_link_hyp_smear_2_no_comm(gf, xl_mu, m, mu, alpha2, alpha3, is_polar_start));
+      ret += matrix_adjoint(gf_link_hyp_smear_2_no_comm(gf, coordinate_shifts(xl,-m-1), m, mu, alpha2, alpha3, is_polar_start)) *
+        gf_link_hyp_smear_2_no_comm(gf, coordinate_shifts(xl,-m-1), mu, m, alpha2, alpha3, is_polar_start) *
+        gf_link_hyp_smear_2_no_comm(gf, coordinate_shifts(xl_mu,-m-1), m, mu, alpha2, alpha3, is_polar_start);
     }
   }
   ret = (1.0 - alpha1) * gf.get_elem(xl, mu) + (alpha1 / 6.0) * ret;
-  return color_matrix_su_projection(ret);
+  return color_matrix_su_projection_smear(ret, is_polar_start);
 }
 
 inline ColorMatrix gf_link_hyp_smear_no_comm(const GaugeField& gf, const Coordinate& xl, const int mu,
-    const double alpha1, const double alpha2, const double alpha3)
+    const double alpha1, const double alpha2, const double alpha3, const bool is_polar_start = false)
 {
-  return gf_link_hyp_smear_1_no_comm(gf, xl, mu, alpha1, alpha2, alpha3);
+  return gf_link_hyp_smear_1_no_comm(gf, xl, mu, alpha1, alpha2, alpha3, is_polar_start);
 }
 
 inline void gf_hyp_smear_no_comm(GaugeField& gf, const GaugeField& gf0,
-    const double alpha1, const double alpha2, const double alpha3)
+    const double alpha1, const double alpha2, const double alpha3, const bool is_polar_start = false)
+  // recompute the decorated links for every link, gf0 needs expansion 3
+  // gf_hyp_smear uses the staged version below
 {
   TIMER_VERBOSE("gf_hyp_smear_no_comm");
   qassert(&gf != &gf0);
@@ -236,20 +495,149 @@ inline void gf_hyp_smear_no_comm(GaugeField& gf, const GaugeField& gf0,
     const Coordinate xl = geo.coordinate_from_index(index);
     Vector<ColorMatrix> v = gf.get_elems(xl);
     for (int mu = 0; mu < DIMN; ++mu) {
-      v[mu] = gf_link_hyp_smear_no_comm(gf0, xl, mu, alpha1, alpha2, alpha3);
+      v[mu] = gf_link_hyp_smear_no_comm(gf0, xl, mu, alpha1, alpha2, alpha3, is_polar_start);
+    }
+  }
+}
+
+inline int hyp_smear_index(const int mu, const int nu)
+  // (mu, nu) with mu != nu to [0, 12)
+{
+  qassert(mu != nu);
+  return mu * (DIMN - 1) + (nu < mu ? nu : nu - 1);
+}
+
+inline void gf_hyp_smear_3_no_comm(Field<ColorMatrix>& f3, const GaugeField& gf, const double alpha3,
+    const bool is_polar_start = false)
+  // f3[hyp_smear_index(mu, m)] = level 3 link in direction mu decorated only
+  // with the staples in direction m (i.e. excluding the two other directions)
+  // gf needs expansion 1
+{
+  TIMER_VERBOSE("gf_hyp_smear_3_no_comm");
+  const Geometry& geo = gf.geo;
+  qassert(f3.geo.multiplicity == DIMN * (DIMN - 1));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> v = f3.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      const Coordinate xl_mu = coordinate_shifts(xl,mu);
+      for (int m = 0; m < DIMN; ++m) {
+        if (mu != m) {
+          const ColorMatrix staple =
+            gf.get_elem(xl, m) *
+            gf.get_elem(coordinate_shifts(xl,m), mu) *
+            matrix_adjoint(gf.get_elem(xl_mu, m)) +
+            matrix_adjoint(gf.get_elem(coordinate_shifts(xl,-m-1), m)) *
+            gf.get_elem(coordinate_shifts(xl,-m-1), mu) *
+            gf.get_elem(coordinate_shifts(xl_mu,-m-1), m);
+          v[hyp_smear_index(mu, m)] = color_matrix_su_projection_smear(
+              (1.0 - alpha3) * gf.get_elem(xl, mu) + (alpha3 / 2.0) * staple, is_polar_start);
+        }
+      }
+    }
+  }
+}
+
+inline void gf_hyp_smear_2_no_comm(Field<ColorMatrix>& f2, const Field<ColorMatrix>& f3, const GaugeField& gf,
+    const double alpha2, const bool is_polar_start = false)
+  // f2[hyp_smear_index(mu, nu)] = level 2 link in direction mu excluding nu
+  // f3 needs expansion 1
+{
+  TIMER_VERBOSE("gf_hyp_smear_2_no_comm");
+  const Geometry& geo = gf.geo;
+  qassert(f2.geo.multiplicity == DIMN * (DIMN - 1));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> v = f2.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      const Coordinate xl_mu = coordinate_shifts(xl,mu);
+      for (int nu = 0; nu < DIMN; ++nu) {
+        if (mu == nu) {
+          continue;
+        }
+        ColorMatrix ret;
+        set_zero(ret);
+        for (int m = 0; m < DIMN; ++m) {
+          if (mu != m && nu != m) {
+            // the remaining direction is the only one left for the level 3 staples
+            const int r = 6 - mu - nu - m;
+            const int i_m = hyp_smear_index(m, r);
+            const int i_mu = hyp_smear_index(mu, r);
+            const Coordinate xl_mm = coordinate_shifts(xl,-m-1);
+            ret += f3.get_elem(xl, i_m) *
+              f3.get_elem(coordinate_shifts(xl,m), i_mu) *
+              matrix_adjoint(f3.get_elem(xl_mu, i_m));
+            ret += matrix_adjoint(f3.get_elem(xl_mm, i_m)) *
+              f3.get_elem(xl_mm, i_mu) *
+              f3.get_elem(coordinate_shifts(xl_mu,-m-1), i_m);
+          }
+        }
+        v[hyp_smear_index(mu, nu)] = color_matrix_su_projection_smear(
+            (1.0 - alpha2) * gf.get_elem(xl, mu) + (alpha2 / 4.0) * ret, is_polar_start);
+      }
+    }
+  }
+}
+
+inline void gf_hyp_smear_1_no_comm(GaugeField& gf, const Field<ColorMatrix>& f2, const GaugeField& gf0,
+    const double alpha1, const bool is_polar_start = false)
+  // f2 needs expansion 1
+{
+  TIMER_VERBOSE("gf_hyp_smear_1_no_comm");
+  qassert(&gf != &gf0);
+  const Geometry& geo = gf0.geo;
+  gf.init(geo_resize(geo));
+  qassert(is_matching_geo_mult(geo, gf.geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Vector<ColorMatrix> v = gf.get_elems(xl);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      const Coordinate xl_mu = coordinate_shifts(xl,mu);
+      ColorMatrix ret;
+      set_zero(ret);
+      for (int m = 0; m < DIMN; ++m) {
+        if (mu != m) {
+          const int i_m = hyp_smear_index(m, mu);
+          const int i_mu = hyp_smear_index(mu, m);
+          const Coordinate xl_mm = coordinate_shifts(xl,-m-1);
+          ret += f2.get_elem(xl, i_m) *
+            f2.get_elem(coordinate_shifts(xl,m), i_mu) *
+            matrix_adjoint(f2.get_elem(xl_mu, i_m));
+          ret += matrix_adjoint(f2.get_elem(xl_mm, i_m)) *
+            f2.get_elem(xl_mm, i_mu) *
+            f2.get_elem(coordinate_shifts(xl_mu,-m-1), i_m);
+        }
+      }
+      v[mu] = color_matrix_su_projection_smear(
+          (1.0 - alpha1) * gf0.get_elem(xl, mu) + (alpha1 / 6.0) * ret, is_polar_start);
     }
   }
 }
 
-inline void gf_hyp_smear(GaugeField& gf, const GaugeField& gf0, const double alpha1, const double alpha2, const double alpha3)
+inline void gf_hyp_smear(GaugeField& gf, const GaugeField& gf0, const double alpha1, const double alpha2, const double alpha3,
+    const bool is_polar_start = false)
   // values in paper is 0.75 0.6 0.3
+  // is_polar_start : see color_matrix_su_projection_smear
+  // the 12 level 3 and the 12 level 2 decorated links per site are computed
+  // once as fields, with their halos exchanged before the next level
 {
   TIMER_VERBOSE("gf_hyp_smear");
   GaugeField gf1;
   gf1.init(geo_resize(gf0.geo, 1));
   gf1 = gf0;
   refresh_expanded(gf1);
-  gf_hyp_smear_no_comm(gf, gf1, alpha1, alpha2, alpha3);
+  const Geometry geo_d = geo_reform(gf0.geo, DIMN * (DIMN - 1), 1);
+  Field<ColorMatrix> f3, f2;
+  f3.init(geo_d);
+  gf_hyp_smear_3_no_comm(f3, gf1, alpha3, is_polar_start);
+  refresh_expanded(f3);
+  f2.init(geo_d);
+  gf_hyp_smear_2_no_comm(f2, f3, gf1, alpha2, is_polar_start);
+  refresh_expanded(f2);
+  gf_hyp_smear_1_no_comm(gf, f2, gf1, alpha1, is_polar_start);
 }
 
 QLAT_END_NAMESPACE
@@ -50,7 +50,7 @@ inline void gf_clover_leaf_field_no_comm(CloverLeafField& clf, const GaugeField&
   const Geometry geo = geo_reform(gf1.geo, 6, 0);
   clf.init(geo);
   qassert(is_matching_geo_mult(clf.geo, geo));
-#pragma omp parallel
+#pragma omp parallel for
   for (long index = 0; index < geo.local_volume(); ++index) {
     const Coordinate xl = geo.coordinate_from_index(index);
     Vector<ColorMatrix> v = clf.get_elems(xl);
@@ -73,10 +73,10 @@ inline void gf_clover_leaf_field(CloverLeafField& clf, const GaugeField& gf)
   gf_clover_leaf_field_no_comm(clf, gf1);
 }
 
-inline double clf_plaq_action_density(const CloverLeafField& clf, const Coordinate& xl)
+inline double clf_plaq_action_density(const Vector<ColorMatrix>& v)
   // \sum_P (1 - 1/3 * Re Tr U_P)
+  // v is F_01, F_02, F_03, F_12, F_13, F_23 at one site
 {
-  const Vector<ColorMatrix> v = clf.get_elems_const(xl);
   double sum = 0.0;
   for (int i = 0; i < 6; ++i) {
     sum += 1.0 - 1.0/3.0 * matrix_trace(v[i]).real();
@@ -84,10 +84,9 @@ inline double clf_plaq_action_density(const CloverLeafField& clf, const Coordina
   return sum;
 }
 
-inline double clf_spatial_plaq_action_density(const CloverLeafField& clf, const Coordinate& xl)
+inline double clf_spatial_plaq_action_density(const Vector<ColorMatrix>& v)
   // \sum_P(spatial only) (1 - 1/3 * Re Tr U_P)
 {
-  const Vector<ColorMatrix> v = clf.get_elems_const(xl);
   double sum = 0.0;
   sum += 1.0 - 1.0/3.0 * matrix_trace(v[0]).real();
   sum += 1.0 - 1.0/3.0 * matrix_trace(v[1]).real();
@@ -95,10 +94,9 @@ inline double clf_spatial_plaq_action_density(const CloverLeafField& clf, const
   return sum;
 }
 
-inline double clf_topology_density(const CloverLeafField& clf, const Coordinate& xl)
+inline double clf_topology_density(const Vector<ColorMatrix>& v)
   // sum of the density of the topological charge Q
 {
-  const Vector<ColorMatrix> v = clf.get_elems_const(xl);
   std::array<ColorMatrix,6> arr;
   for (int i = 0; i < 6; ++i) {
     arr[i] = 0.5 * (v[i] - matrix_adjoint(v[i]));
@@ -111,6 +109,38 @@ inline double clf_topology_density(const CloverLeafField& clf, const Coordinate&
   return fac * sum;
 }
 
+inline double clf_energy_density(const Vector<ColorMatrix>& v)
+  // E = 1/4 G^a_{mu nu} G^a_{mu nu} = - \sum_{mu<nu} tr(G_{mu nu} G_{mu nu})
+  // with G_{mu nu} the traceless anti-hermitian part of the clover leaf
+{
+  double sum = 0.0;
+  for (int i = 0; i < 6; ++i) {
+    const ColorMatrix g = make_tr_less_anti_herm_matrix(v[i]);
+    sum -= matrix_trace(g * g).real();
+  }
+  return sum;
+}
+
+inline double clf_plaq_action_density(const CloverLeafField& clf, const Coordinate& xl)
+{
+  return clf_plaq_action_density(clf.get_elems_const(xl));
+}
+
+inline double clf_spatial_plaq_action_density(const CloverLeafField& clf, const Coordinate& xl)
+{
+  return clf_spatial_plaq_action_density(clf.get_elems_const(xl));
+}
+
+inline double clf_topology_density(const CloverLeafField& clf, const Coordinate& xl)
+{
+  return clf_topology_density(clf.get_elems_const(xl));
+}
+
+inline double clf_energy_density(const CloverLeafField& clf, const Coordinate& xl)
+{
+  return clf_energy_density(clf.get_elems_const(xl));
+}
+
 inline void clf_plaq_action_field(FieldM<double,1>& paf, const CloverLeafField& clf)
 {
   TIMER("clf_plaq_action_field");
@@ -150,4 +180,276 @@ inline void clf_topology_field(FieldM<double,1>& topf, const CloverLeafField& cl
   }
 }
 
+struct GaugeSiteData
+  // everything gf_observables computes at one site
+{
+  Coordinate xl;
+  std::array<ColorMatrix,DIMN> links;
+  // U_mu(x)
+  std::array<ColorMatrix,6> plaqs;
+  // U_mu(x) U_nu(x+mu) U_mu(x+nu)^dag U_nu(x)^dag
+  // for (mu,nu) = 01, 02, 03, 12, 13, 23
+  std::array<ColorMatrix,6> clf;
+  // same as CloverLeafField (only set if needed by some observable)
+};
+
+inline void set_gauge_site_data_no_comm(GaugeSiteData& gsd, const GaugeField& gf1, const Coordinate& xl,
+    const bool is_clover_leaf)
+  // assume proper communication is done (expansion 1 in both directions)
+{
+  gsd.xl = xl;
+  const Vector<ColorMatrix> v = gf1.get_elems_const(xl);
+  for (int mu = 0; mu < DIMN; ++mu) {
+    gsd.links[mu] = v[mu];
+  }
+  int i = 0;
+  for (int mu = 0; mu < DIMN; ++mu) {
+    for (int nu = mu + 1; nu < DIMN; ++nu) {
+      const ColorMatrix& u_mu_x = v[mu];
+      const ColorMatrix& u_nu_x = v[nu];
+      const ColorMatrix& u_nu_xpmu = gf1.get_elem(coordinate_shifts(xl, mu), nu);
+      const ColorMatrix& u_mu_xpnu = gf1.get_elem(coordinate_shifts(xl, nu), mu);
+      gsd.plaqs[i] = u_mu_x * u_nu_xpmu * matrix_adjoint(u_nu_x * u_mu_xpnu);
+      if (is_clover_leaf) {
+        // the other three leaves, added in the order of gf_clover_leaf_no_comm
+        const Coordinate xl_mmu = coordinate_shifts(xl, -mu-1);
+        const Coordinate xl_mnu = coordinate_shifts(xl, -nu-1);
+        const Coordinate xl_mmu_mnu = coordinate_shifts(xl_mmu, -nu-1);
+        const ColorMatrix& u_mu_xmmu = gf1.get_elem(xl_mmu, mu);
+        const ColorMatrix& u_nu_xmmu = gf1.get_elem(xl_mmu, nu);
+        const ColorMatrix& u_mu_xmnu = gf1.get_elem(xl_mnu, mu);
+        const ColorMatrix& u_nu_xmnu = gf1.get_elem(xl_mnu, nu);
+        const ColorMatrix& u_mu_xmmu_mnu = gf1.get_elem(xl_mmu_mnu, mu);
+        const ColorMatrix& u_nu_xmmu_mnu = gf1.get_elem(xl_mmu_mnu, nu);
+        const ColorMatrix& u_mu_xmmu_pnu = gf1.get_elem(coordinate_shifts(xl_mmu, nu), mu);
+        const ColorMatrix& u_nu_xpmu_mnu = gf1.get_elem(coordinate_shifts(xl_mnu, mu), nu);
+        ColorMatrix m = gsd.plaqs[i];
+        m += matrix_adjoint(u_nu_xmmu_mnu * u_mu_xmmu) * u_mu_xmmu_mnu * u_nu_xmnu;
+        m += u_nu_x * matrix_adjoint(u_nu_xmmu * u_mu_xmmu_pnu) * u_mu_xmmu;
+        m += matrix_adjoint(u_nu_xmnu) * u_mu_xmnu * u_nu_xpmu_mnu * matrix_adjoint(u_mu_x);
+        gsd.clf[i] = 0.25 * m;
+      }
+      i += 1;
+    }
+  }
+}
+
+typedef double (*GaugeSiteDensity)(const GaugeSiteData& gsd);
+
+struct GaugeObservableInfo
+{
+  std::string name;
+  GaugeSiteDensity density;
+  bool is_clover_leaf;
+  // density uses gsd.clf
+  bool is_average;
+  // divide the sum by the total volume
+};
+
+inline double gsd_plaq_density(const GaugeSiteData& gsd)
+{
+  double sum = 0.0;
+  for (int i = 0; i < 6; ++i) {
+    sum += matrix_trace(gsd.plaqs[i]).real();
+  }
+  return sum / (6 * NUM_COLOR);
+}
+
+inline double gsd_spatial_plaq_density(const GaugeSiteData& gsd)
+{
+  const double sum = matrix_trace(gsd.plaqs[0]).real()
+    + matrix_trace(gsd.plaqs[1]).real()
+    + matrix_trace(gsd.plaqs[3]).real();
+  return sum / (3 * NUM_COLOR);
+}
+
+inline double gsd_temporal_plaq_density(const GaugeSiteData& gsd)
+{
+  const double sum = matrix_trace(gsd.plaqs[2]).real()
+    + matrix_trace(gsd.plaqs[4]).real()
+    + matrix_trace(gsd.plaqs[5]).real();
+  return sum / (3 * NUM_COLOR);
+}
+
+inline double gsd_link_trace_density(const GaugeSiteData& gsd)
+{
+  double sum = 0.0;
+  for (int mu = 0; mu < DIMN; ++mu) {
+    sum += matrix_trace(gsd.links[mu]).real();
+  }
+  return sum / (DIMN * NUM_COLOR);
+}
+
+inline double gsd_clf_plaq_action_density(const GaugeSiteData& gsd)
+{
+  return clf_plaq_action_density(Vector<ColorMatrix>(gsd.clf.data(), gsd.clf.size()));
+}
+
+inline double gsd_clf_energy_density(const GaugeSiteData& gsd)
+{
+  return clf_energy_density(Vector<ColorMatrix>(gsd.clf.data(), gsd.clf.size()));
+}
+
+inline double gsd_clf_topology_density(const GaugeSiteData& gsd)
+{
+  return clf_topology_density(Vector<ColorMatrix>(gsd.clf.data(), gsd.clf.size()));
+}
+
+inline std::vector<GaugeObservableInfo>& get_gauge_observable_registry()
+  // observables known to gf_observables
+  // add new ones with register_gauge_observable
+{
+  static std::vector<GaugeObservableInfo> registry;
+  if (registry.size() == 0) {
+    const GaugeObservableInfo builtins[] = {
+      { "plaq", gsd_plaq_density, false, true },
+      { "spatial_plaq", gsd_spatial_plaq_density, false, true },
+      { "temporal_plaq", gsd_temporal_plaq_density, false, true },
+      { "link_trace", gsd_link_trace_density, false, true },
+      { "clf_plaq_action", gsd_clf_plaq_action_density, true, true },
+      { "topology", gsd_clf_topology_density, true, false },
+      { "clf_energy", gsd_clf_energy_density, true, true },
+    };
+    registry.assign(builtins, builtins + sizeof(builtins) / sizeof(GaugeObservableInfo));
+  }
+  return registry;
+}
+
+inline void register_gauge_observable(const std::string& name, const GaugeSiteDensity density,
+    const bool is_clover_leaf = false, const bool is_average = true)
+  // replace the existing observable with the same name
+{
+  std::vector<GaugeObservableInfo>& registry = get_gauge_observable_registry();
+  GaugeObservableInfo info;
+  info.name = name;
+  info.density = density;
+  info.is_clover_leaf = is_clover_leaf;
+  info.is_average = is_average;
+  for (size_t i = 0; i < registry.size(); ++i) {
+    if (registry[i].name == name) {
+      registry[i] = info;
+      return;
+    }
+  }
+  registry.push_back(info);
+}
+
+inline const GaugeObservableInfo& get_gauge_observable_info(const std::string& name)
+{
+  const std::vector<GaugeObservableInfo>& registry = get_gauge_observable_registry();
+  for (size_t i = 0; i < registry.size(); ++i) {
+    if (registry[i].name == name) {
+      return registry[i];
+    }
+  }
+  warn("get_gauge_observable_info: unknown observable '" + name + "'.");
+  qassert(false);
+  return registry[0];
+}
+
+struct GaugeObservables
+{
+  std::vector<std::string> names;
+  std::vector<double> values;
+  //
+  double get(const std::string& name) const
+  {
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (names[i] == name) {
+        return values[i];
+      }
+    }
+    warn("GaugeObservables::get: '" + name + "' not computed.");
+    qassert(false);
+    return 0.0;
+  }
+};
+
+inline GaugeObservables gf_observables_no_comm(const GaugeField& gf1,
+    const std::vector<std::string>& names = std::vector<std::string>())
+  // assume proper communication is done (expansion 1 in both directions)
+  // all the observables are computed in one sweep with one glb_sum
+  // empty names means all registered observables
+{
+  TIMER("gf_observables_no_comm");
+  std::vector<GaugeObservableInfo> infos;
+  if (names.size() == 0) {
+    infos = get_gauge_observable_registry();
+  } else {
+    for (size_t i = 0; i < names.size(); ++i) {
+      infos.push_back(get_gauge_observable_info(names[i]));
+    }
+  }
+  const int n = infos.size();
+  bool is_clover_leaf = false;
+  for (int i = 0; i < n; ++i) {
+    is_clover_leaf = is_clover_leaf || infos[i].is_clover_leaf;
+  }
+  const Geometry& geo = gf1.geo;
+  std::vector<std::vector<double> > sums(omp_get_max_threads(), std::vector<double>(n, 0.0));
+#pragma omp parallel
+  {
+    std::vector<double>& tsums = sums[omp_get_thread_num()];
+    GaugeSiteData gsd;
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      set_gauge_site_data_no_comm(gsd, gf1, xl, is_clover_leaf);
+      for (int i = 0; i < n; ++i) {
+        tsums[i] += infos[i].density(gsd);
+      }
+    }
+  }
+  GaugeObservables gos;
+  gos.values.resize(n, 0.0);
+  for (size_t k = 0; k < sums.size(); ++k) {
+    for (int i = 0; i < n; ++i) {
+      gos.values[i] += sums[k][i];
+    }
+  }
+  glb_sum_double_vec(get_data(gos.values), geo.geon.comm);
+  for (int i = 0; i < n; ++i) {
+    gos.names.push_back(infos[i].name);
+    if (infos[i].is_average) {
+      gos.values[i] /= geo.total_volume();
+    }
+  }
+  return gos;
+}
+
+inline GaugeObservables gf_observables(const GaugeField& gf,
+    const std::vector<std::string>& names = std::vector<std::string>())
+{
+  TIMER("gf_observables");
+  GaugeField gf1;
+  gf1.init(geo_resize(gf.geo, 1));
+  gf1 = gf;
+  refresh_expanded(gf1);
+  return gf_observables_no_comm(gf1, names);
+}
+
+inline void gf_show_info(const GaugeField& gf, const int level = 0)
+{
+  TIMER_VERBOSE("gf_show_info");
+  const GaugeObservables gos = gf_observables(gf);
+  displayln_info(shows("plaq : ") + show(gos.get("plaq")));
+  displayln_info(shows("trace: ") + show(gos.get("link_trace")));
+  displayln_info(shows("plaq s/t : ") + show(gos.get("spatial_plaq")) + " " + show(gos.get("temporal_plaq")));
+  displayln_info(shows("clf action : ") + show(gos.get("clf_plaq_action")));
+  displayln_info(shows("topology : ") + show(gos.get("topology")));
+  if (0 < level) {
+    displayln_info(shows("plaq 1x1 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 1, 1)).real() / 3.0));
+    displayln_info(shows("plaq 1x2 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 1, 2)).real() / 3.0));
+    displayln_info(shows("plaq 2x1 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 2, 1)).real() / 3.0));
+    displayln_info(shows("plaq 2x2 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 2, 2)).real() / 3.0));
+    displayln_info(shows("plaq 1x3 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 1, 3)).real() / 3.0));
+    displayln_info(shows("plaq 3x1 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 3, 1)).real() / 3.0));
+    displayln_info(shows("plaq 2x3 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 2, 3)).real() / 3.0));
+    displayln_info(shows("plaq 3x2 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 3, 2)).real() / 3.0));
+    displayln_info(shows("plaq 3x3 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 3, 3)).real() / 3.0));
+    displayln_info(shows("plaq (1,1,0,0)x2 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, Coordinate(1,1,0,0), 2)).real() / 3.0));
+    displayln_info(shows("plaq (2,1,0,0)x1 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, Coordinate(1,1,0,0), 1)).real() / 3.0));
+  }
+}
+
 QLAT_END_NAMESPACE
@@ -4,6 +4,7 @@
 #include <qlat/coordinate-d.h>
 #include <qlat/field.h>
 
+#include <algorithm>
 #include <map>
 #include <set>
 
@@ -130,6 +131,52 @@ inline ColorMatrix gf_spatial_staple_no_comm(const GaugeField& gf, const Coordin
   return ret;
 }
 
+inline std::vector<std::vector<int> > make_rectangular_staple_paths(const int mu)
+  // the 18 length five paths from x to x+mu which close a 1x2 or 2x1
+  // rectangle with U_mu(x)
+{
+  std::vector<std::vector<int> > paths;
+  for (int m = 0; m < DIMN; ++m) {
+    if (mu == m) {
+      continue;
+    }
+    for (int s = 0; s < 2; ++s) {
+      const int n = s == 0 ? m : -m-1;
+      const int mn = s == 0 ? -m-1 : m;
+      const int p1[5] = { n, n, mu, mn, mn };
+      const int p2[5] = { n, mu, mu, mn, -mu-1 };
+      const int p3[5] = { -mu-1, n, mu, mu, mn };
+      paths.push_back(std::vector<int>(p1, p1 + 5));
+      paths.push_back(std::vector<int>(p2, p2 + 5));
+      paths.push_back(std::vector<int>(p3, p3 + 5));
+    }
+  }
+  return paths;
+}
+
+inline const std::vector<std::vector<int> >& get_rectangular_staple_paths(const int mu)
+{
+  static const std::vector<std::vector<int> > pathss[DIMN] = {
+    make_rectangular_staple_paths(0),
+    make_rectangular_staple_paths(1),
+    make_rectangular_staple_paths(2),
+    make_rectangular_staple_paths(3),
+  };
+  return pathss[mu];
+}
+
+inline ColorMatrix gf_rectangular_staple_no_comm(const GaugeField& gf, const Coordinate& xl, const int mu)
+  // need expansion 2 in both directions
+{
+  const std::vector<std::vector<int> >& paths = get_rectangular_staple_paths(mu);
+  ColorMatrix ret;
+  set_zero(ret);
+  for (int i = 0; i < (int)paths.size(); ++i) {
+    ret += gf_wilson_line_no_comm(gf, xl, paths[i]);
+  }
+  return ret;
+}
+
 struct WilsonLinePathStop
 {
   Coordinate x;
@@ -370,9 +417,334 @@ inline void set_multiply_wilson_line_field_partial_comm(FieldM<ColorMatrix,1>& w
   }
 }
 
-inline ColorMatrix gf_avg_wilson_line(const GaugeField& gf, const WilsonLinePath& path)
+inline void make_wilson_line_path_list_acc(std::vector<std::vector<int> >& paths, std::vector<int>& path,
+    const WilsonLinePathSegment& seg, const Coordinate& c)
 {
-  TIMER("gf_avg_wilson_line");
+  if (c == seg.target) {
+    paths.push_back(path);
+    return;
+  }
+  const std::map<Coordinate,WilsonLinePathStop>::const_iterator it = seg.stops.find(c);
+  qassert(it != seg.stops.end());
+  const WilsonLinePathStop& ps = it->second;
+  for (int k = 0; k < (int)ps.paths.size(); ++k) {
+    const size_t size = path.size();
+    path.insert(path.end(), ps.paths[k].begin(), ps.paths[k].end());
+    make_wilson_line_path_list_acc(paths, path, seg, coordinate_shifts(c, ps.paths[k]));
+    path.resize(size);
+  }
+}
+
+inline std::vector<std::vector<int> > make_wilson_line_path_list(const WilsonLinePathSegment& seg)
+  // all the routes from the origin to seg.target
+  // the line field of the segment is the sum over these routes
+{
+  std::vector<std::vector<int> > paths;
+  std::vector<int> path;
+  make_wilson_line_path_list_acc(paths, path, seg, Coordinate());
+  return paths;
+}
+
+inline std::vector<std::vector<int> > make_wilson_line_path_list(const WilsonLinePath& path)
+  // all the concatenations of the routes of the segments, as many as the
+  // product of their numbers ; make_wilson_line_plan sums them at the stops
+{
+  std::vector<std::vector<int> > paths(1);
+  for (int i = 0; i < (int)path.ps.size(); ++i) {
+    const std::vector<std::vector<int> > ps = make_wilson_line_path_list(path.ps[i]);
+    std::vector<std::vector<int> > new_paths;
+    for (int j = 0; j < (int)paths.size(); ++j) {
+      for (int k = 0; k < (int)ps.size(); ++k) {
+        new_paths.push_back(paths[j]);
+        new_paths.back().insert(new_paths.back().end(), ps[k].begin(), ps[k].end());
+      }
+    }
+    paths.swap(new_paths);
+  }
+  return paths;
+}
+
+struct WilsonLinePlanNode
+{
+  std::vector<int> parents;
+  std::vector<int> dirs;
+  // the line field of this node is the sum over k of the line field of
+  // parents[k] extended by the unit step dirs[k] ; one term for a plain step,
+  // several for a stop of a segment where its routes meet
+  std::vector<int> children;
+  std::vector<int> outputs;
+  // outputs the line field of this node is added to
+  int slot;
+  // index of the pool field holding the line field of this node
+  //
+  WilsonLinePlanNode()
+  {
+    slot = -1;
+  }
+};
+
+struct WilsonLinePlan
+  // nodes[0] is the empty path and a node only depends on nodes before it
+  // nodes with the same terms are shared, so common prefixes are computed once
+  // and the routes of a segment are summed at its stops (as in
+  // set_multiply_wilson_line_field_partial_comm) instead of being expanded
+  // all the children of a node share one halo exchange
+{
+  int num_outputs;
+  int num_slots;
+  // size of the field pool
+  std::vector<WilsonLinePlanNode> nodes;
+  std::vector<int> order;
+  // nodes with children, in the order their children are computed
+  std::map<std::vector<int>,int> dict;
+  // sorted terms (parent, dir, parent, dir, ...) -> node
+  //
+  WilsonLinePlan()
+  {
+    num_outputs = 0;
+    num_slots = 0;
+    nodes.resize(1);
+  }
+};
+
+inline int add_wilson_line_plan_node(WilsonLinePlan& plan, const std::vector<int>& parents, const std::vector<int>& dirs)
+  // return the node with these terms, add it if it is new
+{
+  qassert(parents.size() == dirs.size() && parents.size() > 0);
+  std::vector<std::pair<int,int> > terms(parents.size());
+  for (int k = 0; k < (int)parents.size(); ++k) {
+    qassert(0 <= parents[k] && parents[k] < (int)plan.nodes.size());
+    qassert(-DIMN <= dirs[k] && dirs[k] < DIMN);
+    terms[k] = std::make_pair(parents[k], dirs[k]);
+  }
+  std::sort(terms.begin(), terms.end());
+  std::vector<int> key;
+  for (int k = 0; k < (int)terms.size(); ++k) {
+    key.push_back(terms[k].first);
+    key.push_back(terms[k].second);
+  }
+  const std::map<std::vector<int>,int>::const_iterator it = plan.dict.find(key);
+  if (it != plan.dict.end()) {
+    return it->second;
+  }
+  const int c = plan.nodes.size();
+  plan.dict[key] = c;
+  plan.nodes.push_back(WilsonLinePlanNode());
+  for (int k = 0; k < (int)terms.size(); ++k) {
+    WilsonLinePlanNode& node = plan.nodes[c];
+    node.parents.push_back(terms[k].first);
+    node.dirs.push_back(terms[k].second);
+    std::vector<int>& children = plan.nodes[terms[k].first].children;
+    if (children.empty() || children.back() != c) {
+      children.push_back(c);
+    }
+  }
+  return c;
+}
+
+inline int add_wilson_line_plan_path(WilsonLinePlan& plan, const int n0, const std::vector<int>& path)
+  // return the node of the line of path appended to node n0
+{
+  int n = n0;
+  for (int j = 0; j < (int)path.size(); ++j) {
+    n = add_wilson_line_plan_node(plan, std::vector<int>(1, n), std::vector<int>(1, path[j]));
+  }
+  return n;
+}
+
+inline int add_wilson_line_plan_path(WilsonLinePlan& plan, const int n0, const WilsonLinePathSegment& seg)
+  // return the node of the sum of the routes of seg appended to node n0
+  // one node per stop, created once all the routes into the stop are known
+{
+  std::map<Coordinate,std::vector<int> > parents, dirs;
+  std::map<Coordinate,int> dict;
+  std::vector<Coordinate> cs;
+  cs.push_back(Coordinate());
+  dict[Coordinate()] = n0;
+  for (int i = 0; i < (int)cs.size(); ++i) {
+    const Coordinate c = cs[i];
+    const std::map<Coordinate,WilsonLinePathStop>::const_iterator it = seg.stops.find(c);
+    qassert(it != seg.stops.end());
+    const WilsonLinePathStop& ps = it->second;
+    for (int k = 0; k < (int)ps.paths.size(); ++k) {
+      const std::vector<int>& p = ps.paths[k];
+      qassert(p.size() > 0);
+      const Coordinate nc = coordinate_shifts(c, p);
+      parents[nc].push_back(add_wilson_line_plan_path(plan, dict[c], std::vector<int>(p.begin(), p.end() - 1)));
+      dirs[nc].push_back(p.back());
+      const std::map<Coordinate,WilsonLinePathStop>::const_iterator itn = seg.stops.find(nc);
+      qassert(itn != seg.stops.end());
+      if ((int)parents[nc].size() == itn->second.num_origins) {
+        dict[nc] = add_wilson_line_plan_node(plan, parents[nc], dirs[nc]);
+        cs.push_back(nc);
+      }
+    }
+  }
+  qassert(dict.find(seg.target) != dict.end());
+  return dict[seg.target];
+}
+
+inline int add_wilson_line_plan_path(WilsonLinePlan& plan, const int n0, const WilsonLinePath& path)
+{
+  int n = n0;
+  for (int i = 0; i < (int)path.ps.size(); ++i) {
+    n = add_wilson_line_plan_path(plan, n, path.ps[i]);
+  }
+  return n;
+}
+
+inline void add_wilson_line_plan_output(WilsonLinePlan& plan, const int n, const int output)
+{
+  qassert(output >= 0);
+  plan.nodes[n].outputs.push_back(output);
+  plan.num_outputs = std::max(plan.num_outputs, output + 1);
+}
+
+inline void set_wilson_line_plan_slots(WilsonLinePlan& plan)
+  // the nodes are computed in order ; a pool field is taken when the first
+  // term of its node is computed and released once all its children are done
+{
+  plan.num_slots = 0;
+  clear(plan.order);
+  for (int n = 0; n < (int)plan.nodes.size(); ++n) {
+    plan.nodes[n].slot = -1;
+  }
+  std::vector<int> free_slots;
+  plan.nodes[0].slot = plan.num_slots++;
+  for (int n = 0; n < (int)plan.nodes.size(); ++n) {
+    const WilsonLinePlanNode& node = plan.nodes[n];
+    qassert(node.slot >= 0);
+    if (!node.children.empty()) {
+      plan.order.push_back(n);
+    }
+    for (int k = 0; k < (int)node.children.size(); ++k) {
+      WilsonLinePlanNode& child = plan.nodes[node.children[k]];
+      if (child.slot >= 0) {
+        continue;
+      } else if (free_slots.empty()) {
+        child.slot = plan.num_slots++;
+      } else {
+        child.slot = free_slots.back();
+        free_slots.pop_back();
+      }
+    }
+    free_slots.push_back(node.slot);
+  }
+}
+
+template <class Path>
+inline WilsonLinePlan make_wilson_line_plan(const std::vector<Path>& paths, const std::vector<int>& outputs)
+  // the line field of paths[i] is added to output outputs[i]
+  // Path can be std::vector<int>, WilsonLinePathSegment or WilsonLinePath
+{
+  TIMER("make_wilson_line_plan");
+  qassert(paths.size() == outputs.size());
+  WilsonLinePlan plan;
+  for (int i = 0; i < (int)paths.size(); ++i) {
+    add_wilson_line_plan_output(plan, add_wilson_line_plan_path(plan, 0, paths[i]), outputs[i]);
+  }
+  set_wilson_line_plan_slots(plan);
+  return plan;
+}
+
+template <class Path>
+inline WilsonLinePlan make_wilson_line_plan(const std::vector<Path>& paths)
+{
+  std::vector<int> outputs(paths.size());
+  for (int i = 0; i < (int)paths.size(); ++i) {
+    outputs[i] = i;
+  }
+  return make_wilson_line_plan(paths, outputs);
+}
+
+inline void set_multiply_wilson_line_field_step_no_comm(FieldM<ColorMatrix,1>& wlf, const FieldM<ColorMatrix,1>& wlf1,
+    const GaugeField& gf1, const int dir, const bool is_add = false)
+  // wlf(x) = wlf1(x - dir) * U(x - dir -> x) ; or wlf(x) += ... if is_add
+  // wlf1 need expansion 1 in the direction opposite to dir
+  // gf1 need expansion_left 1
+{
+  TIMER("set_multiply_wilson_line_field_step_no_comm");
+  const Geometry& geo = wlf.geo;
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    Coordinate xl = geo.coordinate_from_index(index);
+    ColorMatrix& l1 = wlf.get_elem(xl);
+    ColorMatrix l;
+    if (0 <= dir) {
+      xl[dir] -= 1;
+      l = wlf1.get_elem(xl) * gf1.get_elem(xl, dir);
+    } else {
+      const ColorMatrix& link = gf1.get_elem(xl, -dir-1);
+      xl[-dir-1] += 1;
+      l = wlf1.get_elem(xl) * matrix_adjoint(link);
+    }
+    if (is_add) {
+      l1 += l;
+    } else {
+      l1 = l;
+    }
+  }
+}
+
+inline void set_wilson_line_fields_expanded(std::vector<FieldM<ColorMatrix,1> >& wlfs, const GaugeField& gf1,
+    const WilsonLinePlan& plan)
+  // see set_wilson_line_fields
+  // gf1 need expansion_left 1 and to be refreshed, so that several plans can share one refresh
+{
+  TIMER_VERBOSE("set_wilson_line_fields_expanded");
+  const Geometry geo = geo_resize(geo_reform(gf1.geo));
+  clear(wlfs);
+  wlfs.resize(plan.num_outputs);
+  for (int k = 0; k < plan.num_outputs; ++k) {
+    wlfs[k].init(geo);
+    set_zero(wlfs[k]);
+  }
+  std::vector<FieldM<ColorMatrix,1> > pool(plan.num_slots);
+  for (int k = 0; k < plan.num_slots; ++k) {
+    pool[k].init(geo_resize(geo, 1));
+  }
+  std::vector<int> num_terms(plan.nodes.size(), 0);
+  set_unit(pool[plan.nodes[0].slot]);
+  for (int n = 0; n < (int)plan.nodes.size(); ++n) {
+    const WilsonLinePlanNode& node = plan.nodes[n];
+    FieldM<ColorMatrix,1>& f = pool[node.slot];
+    qassert((int)node.parents.size() == num_terms[n]);
+    for (int k = 0; k < (int)node.outputs.size(); ++k) {
+      wlfs[node.outputs[k]] += f;
+    }
+    if (node.children.empty()) {
+      continue;
+    }
+    std::string tag;
+    for (int k = 0; k < (int)node.children.size(); ++k) {
+      const WilsonLinePlanNode& child = plan.nodes[node.children[k]];
+      for (int j = 0; j < (int)child.parents.size(); ++j) {
+        if (child.parents[j] == n) {
+          tag += ssprintf(" %d", -1 - child.dirs[j]);
+        }
+      }
+    }
+    refresh_expanded(f, set_marks_field_dirs, tag);
+    for (int k = 0; k < (int)node.children.size(); ++k) {
+      const int c = node.children[k];
+      const WilsonLinePlanNode& child = plan.nodes[c];
+      for (int j = 0; j < (int)child.parents.size(); ++j) {
+        if (child.parents[j] == n) {
+          set_multiply_wilson_line_field_step_no_comm(pool[child.slot], f, gf1, child.dirs[j], num_terms[c] > 0);
+          num_terms[c] += 1;
+        }
+      }
+    }
+  }
+}
+
+inline void set_wilson_line_fields(std::vector<FieldM<ColorMatrix,1> >& wlfs, const GaugeField& gf, const WilsonLinePlan& plan)
+  // wlfs[k](x) = sum of the lines of the paths with output k
+  // a line ends at x, i.e. starts at x - (sum of the steps of the path)
+  // one halo exchange per node with children, each only for the faces its
+  // children need
+{
+  TIMER_VERBOSE("set_wilson_line_fields");
   const Geometry geo = geo_reform(gf.geo);
   const Coordinate expansion_left(1, 1, 1, 1);
   const Coordinate expansion_right(0, 0, 0, 0);
@@ -380,17 +752,24 @@ inline ColorMatrix gf_avg_wilson_line(const GaugeField& gf, const WilsonLinePath
   gf1.init(geo_resize(geo, expansion_left, expansion_right));
   gf1 = gf;
   refresh_expanded(gf1);
-  FieldM<ColorMatrix,1> wlf, wlf1;
-  wlf1.init(geo_resize(geo, 1));
-  wlf.init(geo);
-  set_unit(wlf1);
-  for (int i = 0; i < (int)path.ps.size(); ++i) {
-    set_multiply_wilson_line_field_partial_comm(wlf, wlf1, gf1, path.ps[i]);
-    if (i != (int)path.ps.size() - 1) {
-      wlf1 = wlf;
-    }
-  }
-  return field_glb_sum_double(wlf)[0] / geo.total_volume();
+  set_wilson_line_fields_expanded(wlfs, gf1, plan);
+}
+
+inline ColorMatrix gf_avg_wilson_line(const GaugeField& gf, const std::vector<std::vector<int> >& paths)
+  // volume average of the sum of the lines of paths
+{
+  TIMER("gf_avg_wilson_line(paths)");
+  std::vector<FieldM<ColorMatrix,1> > wlfs;
+  set_wilson_line_fields(wlfs, gf, make_wilson_line_plan(paths, std::vector<int>(paths.size(), 0)));
+  return field_glb_sum_double(wlfs[0])[0] / gf.geo.total_volume();
+}
+
+inline ColorMatrix gf_avg_wilson_line(const GaugeField& gf, const WilsonLinePath& path)
+{
+  TIMER("gf_avg_wilson_line");
+  std::vector<FieldM<ColorMatrix,1> > wlfs;
+  set_wilson_line_fields(wlfs, gf, make_wilson_line_plan(std::vector<WilsonLinePath>(1, path), std::vector<int>(1, 0)));
+  return field_glb_sum_double(wlfs[0])[0] / gf.geo.total_volume();
 }
 
 inline WilsonLinePath make_wilson_loop_path(const Coordinate& target_l, const int t)
@@ -405,13 +784,18 @@ inline WilsonLinePath make_wilson_loop_path(const Coordinate& target_l, const in
 }
 
 inline ColorMatrix gf_avg_wilson_loop(const GaugeField& gf, const int l, const int t)
+  // the three orientations share one plan
 {
   TIMER_VERBOSE("gf_avg_wilson_loop");
-  ColorMatrix m =
-    gf_avg_wilson_line(gf, make_wilson_loop_path(Coordinate(l, 0, 0, 0), t)) +
-    gf_avg_wilson_line(gf, make_wilson_loop_path(Coordinate(0, l, 0, 0), t)) +
-    gf_avg_wilson_line(gf, make_wilson_loop_path(Coordinate(0, 0, l, 0), t));
-  return m / 3.0;
+  std::vector<WilsonLinePath> paths;
+  for (int mu = 0; mu < 3; ++mu) {
+    Coordinate target_l;
+    target_l[mu] = l;
+    paths.push_back(make_wilson_loop_path(target_l, t));
+  }
+  std::vector<FieldM<ColorMatrix,1> > wlfs;
+  set_wilson_line_fields(wlfs, gf, make_wilson_line_plan(paths, std::vector<int>(paths.size(), 0)));
+  return field_glb_sum_double(wlfs[0])[0] / gf.geo.total_volume() / 3.0;
 }
 
 inline std::vector<Coordinate> spatial_permute_direction(const Coordinate& l)
@@ -459,35 +843,364 @@ inline std::vector<Coordinate> spatial_permute_direction(const Coordinate& l)
 }
 
 inline ColorMatrix gf_avg_wilson_loop(const GaugeField& gf, const Coordinate& l, const int t)
+  // average over the spatial images of l, which share one plan
 {
   TIMER_VERBOSE("gf_avg_wilson_loop(Coordinate&)");
-  ColorMatrix m;
-  set_zero(m);
   std::vector<Coordinate> cs = spatial_permute_direction(l);
+  std::vector<WilsonLinePath> paths;
   for (int i = 0; i < (int)cs.size(); ++i) {
-    m += gf_avg_wilson_line(gf, make_wilson_loop_path(l, t));
+    paths.push_back(make_wilson_loop_path(cs[i], t));
   }
-  return m;
+  std::vector<FieldM<ColorMatrix,1> > wlfs;
+  set_wilson_line_fields(wlfs, gf, make_wilson_line_plan(paths, std::vector<int>(paths.size(), 0)));
+  return field_glb_sum_double(wlfs[0])[0] / gf.geo.total_volume() / (double)cs.size();
 }
 
-inline void gf_show_info(const GaugeField& gf, const int level = 0)
+struct WilsonLoopTable
+  // get(i, t) = < Re tr W(rs[i], t) > / NUM_COLOR
+  // averaged over the volume and the spatial images of rs[i]
+  // spatial lines as in make_wilson_line_path_segment (sum of its paths)
 {
-  TIMER_VERBOSE("gf_show_info");
-  displayln_info(shows("plaq : ") + show(gf_avg_plaq(gf)));
-  displayln_info(shows("trace: ") + show(gf_avg_link_trace(gf)));
-  if (0 < level) {
-    displayln_info(shows("plaq 1x1 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 1, 1)).real() / 3.0));
-    displayln_info(shows("plaq 1x2 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 1, 2)).real() / 3.0));
-    displayln_info(shows("plaq 2x1 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 2, 1)).real() / 3.0));
-    displayln_info(shows("plaq 2x2 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 2, 2)).real() / 3.0));
-    displayln_info(shows("plaq 1x3 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 1, 3)).real() / 3.0));
-    displayln_info(shows("plaq 3x1 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 3, 1)).real() / 3.0));
-    displayln_info(shows("plaq 2x3 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 2, 3)).real() / 3.0));
-    displayln_info(shows("plaq 3x2 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 3, 2)).real() / 3.0));
-    displayln_info(shows("plaq 3x3 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, 3, 3)).real() / 3.0));
-    displayln_info(shows("plaq (1,1,0,0)x2 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, Coordinate(1,1,0,0), 2)).real() / 3.0));
-    displayln_info(shows("plaq (2,1,0,0)x1 : ") + show(matrix_trace(gf_avg_wilson_loop(gf, Coordinate(1,1,0,0), 1)).real() / 3.0));
+  std::vector<Coordinate> rs;
+  int max_t;
+  std::vector<double> ws;
+  //
+  double get(const int i, const int t) const
+  {
+    qassert(1 <= t && t <= max_t);
+    return ws[i * max_t + t - 1];
   }
+};
+
+inline std::vector<Coordinate> make_wilson_loop_spatial_offsets(const int max_r)
+  // one offset for each class of spatial_permute_direction with
+  // max_r >= r[0] >= r[1] >= r[2] >= 0 and r[0] > 0
+{
+  std::vector<Coordinate> rs;
+  for (int x = 1; x <= max_r; ++x) {
+    for (int y = 0; y <= x; ++y) {
+      for (int z = 0; z <= y; ++z) {
+        rs.push_back(Coordinate(x, y, z, 0));
+      }
+    }
+  }
+  return rs;
+}
+
+inline std::vector<Coordinate> spatial_permute_direction_half(const Coordinate& l)
+  // spatial_permute_direction(l) with only one of c and -c
+  // Re tr W(-c, t) = Re tr W(c, t) after averaging over the volume
+{
+  const std::vector<Coordinate> cs = spatial_permute_direction(l);
+  std::vector<Coordinate> ret;
+  for (int i = 0; i < (int)cs.size(); ++i) {
+    const Coordinate& c = cs[i];
+    if (c[0] > 0 || (c[0] == 0 && (c[1] > 0 || (c[1] == 0 && c[2] > 0)))) {
+      ret.push_back(c);
+    }
+  }
+  return ret;
+}
+
+inline void gf_dir_line_scan(FieldM<ColorMatrix,1>& lf, FieldM<ColorMatrix,1>& lt, const GaugeField& gf,
+    const int dir, const int tgref = 0)
+  // lf(x) = U_dir(x_ref) ... U_dir(x - dir), the line from the site x_ref with
+  // xg[dir] = tgref (and the other components of x) to x, wrapping around
+  // lt(x) = the line winding once around from x_ref to x_ref
+  // two level scan: products within the node, an ordered scan of the node
+  // products across the nodes along dir, and a local fix up
+{
+  TIMER("gf_dir_line_scan");
+  const Geometry geo = geo_reform(gf.geo);
+  lf.init(geo);
+  lt.init(geo);
+  qassert(is_matching_geo(lf.geo, geo));
+  qassert(is_matching_geo(lt.geo, geo));
+  const int size_t_node = geo.node_site[dir];
+  const int coor_t_node = geo.geon.coor_node[dir];
+  // the local sites with xl[dir] = 0
+  std::vector<Coordinate> xts;
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    if (0 == xl[dir]) {
+      xts.push_back(xl);
+    }
+  }
+  // lf(x) = line from the first local slice to x ; bs = line across the node
+  std::vector<ColorMatrix> bs(xts.size()), es(xts.size()), ls(xts.size());
+#pragma omp parallel for
+  for (long i = 0; i < (long)xts.size(); ++i) {
+    Coordinate xl = xts[i];
+    ColorMatrix m;
+    set_unit(m);
+    for (int t = 0; t < size_t_node; ++t) {
+      xl[dir] = t;
+      lf.get_elem(xl) = m;
+      m = m * gf.get_elem(xl, dir);
+    }
+    bs[i] = m;
+  }
+  const CommDir cd(geo.geon, dir);
+  glb_product_scan(get_data(es), get_data(ls), get_data(bs), cd.comm);
+  if (0 == coor_t_node) {
+    for (long i = 0; i < (long)xts.size(); ++i) {
+      set_unit(es[i]);
+    }
+  }
+  // now lf(x) = es * lf(x) is the line from xg[dir] = 0 and ls the winding line
+  // ms = lf(x_ref)^dag from the node holding tgref
+  const int tl_ref = tgref - coor_t_node * size_t_node;
+  std::vector<ColorMatrix> ms(xts.size());
+  if (0 != tgref) {
+    set_zero(ms);
+    if (0 <= tl_ref && tl_ref < size_t_node) {
+#pragma omp parallel for
+      for (long i = 0; i < (long)xts.size(); ++i) {
+        Coordinate xl = xts[i];
+        xl[dir] = tl_ref;
+        ms[i] = matrix_adjoint(es[i] * lf.get_elem(xl));
+      }
+    }
+    glb_sum_double_vec(get_data(ms), cd.comm);
+  }
+#pragma omp parallel for
+  for (long i = 0; i < (long)xts.size(); ++i) {
+    Coordinate xl = xts[i];
+    if (0 == tgref) {
+      for (int t = 0; t < size_t_node; ++t) {
+        xl[dir] = t;
+        ColorMatrix& l = lf.get_elem(xl);
+        l = es[i] * l;
+        lt.get_elem(xl) = ls[i];
+      }
+    } else {
+      const ColorMatrix mls = ms[i] * ls[i];
+      const ColorMatrix lsr = mls * matrix_adjoint(ms[i]);
+      for (int t = 0; t < size_t_node; ++t) {
+        xl[dir] = t;
+        ColorMatrix& l = lf.get_elem(xl);
+        l = (t >= tl_ref ? ms[i] : mls) * (es[i] * l);
+        lt.get_elem(xl) = lsr;
+      }
+    }
+  }
+}
+
+inline void acc_wilson_loop_temporal_gauge_no_comm(std::vector<double>& sums, const FieldM<ColorMatrix,1>& wlf,
+    const FieldM<ColorMatrix,1>& lt, const FieldM<ColorMatrix,1>& ltc, const int max_t)
+  // sums[t - 1] += sum_x Re tr(S(x) P(x)^k S(x + t)^dag P(x - c)^-k) for 1 <= t <= max_t
+  // in the temporal gauge of gf_dir_line_scan (along 3, from xg[3] = 0), where
+  // S(x) = wlf(x) is the spatial line from x - c to x, P = lt the only non unit
+  // temporal link (entering xg[3] = 0), ltc(x) = lt(x - c), and k the number of
+  // times the temporal line from x to x + t goes through it
+  // wlf need expansion_right min(max_t, total_site[3] - node_site[3]) along 3
+{
+  TIMER("acc_wilson_loop_temporal_gauge_no_comm");
+  const Geometry& geo = lt.geo;
+  const int t_size = geo.total_site()[3];
+  qassert((int)sums.size() >= max_t);
+  std::vector<std::vector<double> > sums_t(omp_get_max_threads(), std::vector<double>(max_t, 0.0));
+#pragma omp parallel
+  {
+    std::vector<double>& sum = sums_t[omp_get_thread_num()];
+#pragma omp for
+    for (long index = 0; index < geo.local_volume(); ++index) {
+      const Coordinate xl = geo.coordinate_from_index(index);
+      const int tg = geo.coordinate_g_from_l(xl)[3];
+      const ColorMatrix& s0 = wlf.get_elem(xl);
+      const ColorMatrix& p = lt.get_elem(xl);
+      const ColorMatrix pcdag = matrix_adjoint(ltc.get_elem(xl));
+      ColorMatrix sp = s0;
+      for (int t = 1; t <= max_t; ++t) {
+        if ((tg + t - 1) % t_size == t_size - 1) {
+          // the step from x + t - 1 to x + t enters xg[3] = 0
+          sp = sp * p;
+        }
+        Coordinate xl_t = xl;
+        xl_t[3] = (xl[3] + t) % t_size;
+        ColorMatrix m = sp * matrix_adjoint(wlf.get_elem(xl_t));
+        for (int j = 0; j < (tg + t) / t_size; ++j) {
+          m = m * pcdag;
+        }
+        sum[t - 1] += matrix_trace(m).real();
+      }
+    }
+  }
+  for (int i = 0; i < (int)sums_t.size(); ++i) {
+    for (int t = 0; t < max_t; ++t) {
+      sums[t] += sums_t[i][t];
+    }
+  }
+}
+
+inline WilsonLoopTable gf_wilson_loop_table(const GaugeField& gf, const std::vector<Coordinate>& rs, const int max_t)
+  // all the (r, t) with r in rs and 1 <= t <= max_t in one pass
+  // in the temporal gauge, the temporal lines are unit except through the links
+  // entering xg[3] = 0 (see acc_wilson_loop_temporal_gauge_no_comm), so for each
+  // spatial image c only the spatial line and the links entering xg[3] = 0 at
+  // x - c are communicated, once for all the t ; one global sum at the end
+  // the gauge field is expanded and refreshed once for the spatial lines of all the c
+{
+  TIMER_VERBOSE("gf_wilson_loop_table");
+  const Geometry geo = geo_reform(gf.geo);
+  // gf1 = gf in the temporal gauge, gt(x) the temporal line from xg[3] = 0 to x
+  FieldM<ColorMatrix,1> gt, lt;
+  gf_dir_line_scan(gt, lt, gf, 3);
+  FieldM<ColorMatrix,1> gt1;
+  gt1.init(geo_resize(geo, Coordinate(), Coordinate(1, 1, 1, 1)));
+  gt1 = gt;
+  refresh_expanded(gt1);
+  const Coordinate expansion_left(1, 1, 1, 1);
+  const Coordinate expansion_right(0, 0, 0, 0);
+  GaugeField gf1;
+  gf1.init(geo_resize(geo, expansion_left, expansion_right));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    for (int mu = 0; mu < DIMN; ++mu) {
+      gf1.get_elem(xl, mu) = gt1.get_elem(xl) * gf.get_elem(xl, mu) *
+        matrix_adjoint(gt1.get_elem(coordinate_shifts(xl, mu)));
+    }
+  }
+  refresh_expanded(gf1);
+  const Coordinate expansion_t(0, 0, 0, std::min(max_t, geo.total_site()[3] - geo.node_site[3]));
+  WilsonLoopTable wlt;
+  wlt.rs = rs;
+  wlt.max_t = max_t;
+  wlt.ws.resize(rs.size() * max_t, 0.0);
+  std::vector<FieldM<ColorMatrix,1> > wlfs;
+  FieldM<ColorMatrix,1> wlf, ltc;
+  std::vector<double> sums(max_t);
+  for (int i = 0; i < (int)rs.size(); ++i) {
+    const std::vector<Coordinate> cs = spatial_permute_direction_half(rs[i]);
+    const double coef = 1.0 / (cs.size() * NUM_COLOR * geo.total_volume());
+    for (int k = 0; k < (int)cs.size(); ++k) {
+      const Coordinate& c = cs[k];
+      // wlf(x) = S(x - c -> x)
+      const std::vector<WilsonLinePathSegment> segs(1, make_wilson_line_path_segment(c));
+      set_wilson_line_fields_expanded(wlfs, gf1, make_wilson_line_plan(segs, std::vector<int>(1, 0)));
+      wlf.init(geo_resize(geo, Coordinate(), expansion_t));
+      wlf = wlfs[0];
+      refresh_expanded(wlf);
+      // ltc(x) = lt(x - c)
+      field_shift(ltc, lt, -c);
+      sums.assign(max_t, 0.0);
+      acc_wilson_loop_temporal_gauge_no_comm(sums, wlf, lt, ltc, max_t);
+      for (int t = 1; t <= max_t; ++t) {
+        wlt.ws[i * max_t + t - 1] += coef * sums[t - 1];
+      }
+    }
+  }
+  glb_sum_double_vec(get_data(wlt.ws), geo.geon.comm);
+  return wlt;
+}
+
+inline void gf_polyakov_line_field(FieldM<ColorMatrix,1>& plf, const GaugeField& gf, const int dir = 3)
+  // plf(x) = the static quark line winding once around along dir from x to x
+{
+  TIMER("gf_polyakov_line_field");
+  const Geometry geo = geo_reform(gf.geo);
+  FieldM<ColorMatrix,1> lf, lt;
+  gf_dir_line_scan(lf, lt, gf, dir);
+  plf.init(geo);
+  qassert(is_matching_geo(plf.geo, geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const ColorMatrix& l = lf.get_elem(xl);
+    plf.get_elem(xl) = matrix_adjoint(l) * lt.get_elem(xl) * l;
+  }
+}
+
+inline void gf_polyakov_loop_field(FieldM<Complex,1>& pf, const GaugeField& gf, const int dir = 3)
+  // pf(x) = tr(P(x)) / NUM_COLOR with P the Polyakov line along dir
+  // independent of x[dir]
+{
+  TIMER("gf_polyakov_loop_field");
+  const Geometry geo = geo_reform(gf.geo);
+  FieldM<ColorMatrix,1> lf, lt;
+  gf_dir_line_scan(lf, lt, gf, dir);
+  pf.init(geo);
+  qassert(is_matching_geo(pf.geo, geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    pf.get_elem(xl) = matrix_trace(lt.get_elem(xl)) / (double)NUM_COLOR;
+  }
+}
+
+inline Complex gf_avg_polyakov_loop(const GaugeField& gf, const int dir = 3)
+{
+  TIMER("gf_avg_polyakov_loop");
+  FieldM<Complex,1> pf;
+  gf_polyakov_loop_field(pf, gf, dir);
+  return field_glb_sum_double(pf)[0] / (double)gf.geo.total_volume();
+}
+
+inline void polyakov_loop_correlator_field(FieldM<Complex,1>& cf, const FieldM<Complex,1>& pf, const int dir = 3)
+  // cf(r) = < pf(x)^* pf(x + r) >_x for r orthogonal to dir
+  // pf should be independent of x[dir] ; FFT along the other directions
+{
+  TIMER("polyakov_loop_correlator_field");
+  const Geometry geo = geo_reform(pf.geo);
+  cf.init(geo);
+  cf = pf;
+  Coordinate dirs;
+  for (int mu = 0; mu < DIMN; ++mu) {
+    if (mu != dir) {
+      set_zero(dirs);
+      dirs[mu] = 1;
+      fft_complex_field_dirs(cf, dirs);
+    }
+  }
+  const double vol = geo.total_volume() / geo.total_site()[dir];
+  const double coef = 1.0 / (vol * vol);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    Complex& c = cf.get_elem(xl);
+    c = coef * std::norm(c);
+  }
+  for (int mu = 0; mu < DIMN; ++mu) {
+    if (mu != dir) {
+      set_zero(dirs);
+      dirs[mu] = -1;
+      fft_complex_field_dirs(cf, dirs);
+    }
+  }
+}
+
+inline std::vector<double> gf_polyakov_loop_correlator(const GaugeField& gf, const int max_r2, const int dir = 3)
+  // ret[r2] = Re < p(x)^* p(x + r) > with p = tr(P) / NUM_COLOR, P the Polyakov line
+  // averaged over the r orthogonal to dir with |r|^2 = r2 (0 if there is none)
+{
+  TIMER_VERBOSE("gf_polyakov_loop_correlator");
+  const Geometry geo = geo_reform(gf.geo);
+  FieldM<Complex,1> pf, cf;
+  gf_polyakov_loop_field(pf, gf, dir);
+  polyakov_loop_correlator_field(cf, pf, dir);
+  const Coordinate total_site = geo.total_site();
+  std::vector<double> ret(max_r2 + 1, 0.0), counts(max_r2 + 1, 0.0);
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const Coordinate xg = geo.coordinate_g_from_l(xl);
+    if (0 != xg[dir]) {
+      continue;
+    }
+    const long r2 = distance_sq_relative_coordinate_g(smod(xg, total_site));
+    if (r2 <= max_r2) {
+      ret[r2] += cf.get_elem(xl).real();
+      counts[r2] += 1.0;
+    }
+  }
+  glb_sum_double_vec(get_data(ret), geo.geon.comm);
+  glb_sum_double_vec(get_data(counts), geo.geon.comm);
+  for (int r2 = 0; r2 <= max_r2; ++r2) {
+    if (0.0 != counts[r2]) {
+      ret[r2] /= counts[r2];
+    }
+  }
+  return ret;
 }
 
 QLAT_END_NAMESPACE
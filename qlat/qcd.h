@@ -63,10 +63,11 @@ inline void unitarize(Field<ColorMatrix>& gf)
   }
 }
 
-inline double gf_avg_plaq_no_comm(const GaugeField& gf)
+inline double gf_local_sum_plaq_no_comm(const GaugeField& gf)
   // assume proper communication is done
+  // sum over the local sites only, see gf_avg_plaq_no_comm
 {
-  TIMER("gf_avg_plaq_no_comm");
+  TIMER("gf_local_sum_plaq_no_comm");
   const Geometry& geo = gf.geo;
   std::vector<double> sums(omp_get_max_threads(), 0.0);
 #pragma omp parallel
@@ -76,7 +77,7 @@ inline double gf_avg_plaq_no_comm(const GaugeField& gf)
     for (long index = 0; index < geo.local_volume(); ++index) {
       Coordinate xl = geo.coordinate_from_index(index);
       const Vector<ColorMatrix> v = gf.get_elems_const(xl);
-      std::vector<Vector<ColorMatrix> > vms(DIMN);
+      std::array<Vector<ColorMatrix>,DIMN> vms;
       for (int m = 0; m < DIMN; ++m) {
         xl[m] += 1;
         vms[m] = gf.get_elems_const(xl);
@@ -102,8 +103,16 @@ inline double gf_avg_plaq_no_comm(const GaugeField& gf)
   for (size_t i = 0; i < sums.size(); ++i) {
     sum += sums[i];
   }
+  return sum;
+}
+
+inline double gf_avg_plaq_no_comm(const GaugeField& gf)
+  // assume proper communication is done
+{
+  TIMER("gf_avg_plaq_no_comm");
+  double sum = gf_local_sum_plaq_no_comm(gf);
   glb_sum(sum);
-  sum /= geo.total_volume();
+  sum /= gf.geo.total_volume();
   return sum;
 }
 
@@ -117,9 +126,10 @@ inline double gf_avg_plaq(const GaugeField& gf)
   return gf_avg_plaq_no_comm(gf1);
 }
 
-inline double gf_avg_link_trace(const GaugeField& gf)
+inline double gf_local_sum_link_trace(const GaugeField& gf)
+  // sum over the local sites only, see gf_avg_link_trace
 {
-  TIMER("gf_avg_link_trace");
+  TIMER("gf_local_sum_link_trace");
   const Geometry& geo = gf.geo;
   std::vector<double> sums(omp_get_max_threads(), 0.0);
 #pragma omp parallel
@@ -142,8 +152,15 @@ inline double gf_avg_link_trace(const GaugeField& gf)
   for (size_t i = 0; i < sums.size(); ++i) {
     sum += sums[i];
   }
+  return sum;
+}
+
+inline double gf_avg_link_trace(const GaugeField& gf)
+{
+  TIMER("gf_avg_link_trace");
+  double sum = gf_local_sum_link_trace(gf);
   glb_sum(sum);
-  sum /= geo.total_volume();
+  sum /= gf.geo.total_volume();
   return sum;
 }
 
@@ -404,6 +421,65 @@ inline void set_fermion_field_from_propagator_col(FermionField4d& ff, const Prop
   }
 }
 
+inline void set_fermion_field_block_col(Field<WilsonVector>& ffb, const int idx, const FermionField4d& ff)
+  // ffb need to be initialized, the spinors of a site are the columns of the block
+{
+  TIMER("set_fermion_field_block_col");
+  const Geometry& geo = ff.geo;
+  qassert(0 <= idx && idx < ffb.geo.multiplicity);
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    ffb.get_elem(xl, idx) = ff.get_elem(xl);
+  }
+}
+
+inline void set_fermion_field_from_block_col(FermionField4d& ff, const Field<WilsonVector>& ffb, const int idx)
+{
+  TIMER("set_fermion_field_from_block_col");
+  const Geometry& geo = ffb.geo;
+  ff.init(geo_reform(geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    ff.get_elem(xl) = ffb.get_elem(xl, idx);
+  }
+}
+
+inline void set_fermion_field_block_from_propagator(Field<WilsonVector>& ffb, const Propagator4d& prop)
+  // the 4*NUM_COLOR columns of prop as a block of spinors (multiplicity 4*NUM_COLOR)
+{
+  TIMER("set_fermion_field_block_from_propagator");
+  const Geometry& geo = prop.geo;
+  ffb.init(geo_reform(geo, 4*NUM_COLOR));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    const WilsonMatrix& wm = prop.get_elem(xl);
+    Vector<WilsonVector> v = ffb.get_elems(xl);
+    for (int j = 0; j < 4*NUM_COLOR; ++j) {
+      set_wilson_vector_from_matrix_col(v[j], wm, j);
+    }
+  }
+}
+
+inline void set_propagator_from_fermion_field_block(Propagator4d& prop, const Field<WilsonVector>& ffb)
+{
+  TIMER("set_propagator_from_fermion_field_block");
+  const Geometry& geo = ffb.geo;
+  qassert(4*NUM_COLOR == geo.multiplicity);
+  prop.init(geo_reform(geo));
+#pragma omp parallel for
+  for (long index = 0; index < geo.local_volume(); ++index) {
+    const Coordinate xl = geo.coordinate_from_index(index);
+    WilsonMatrix& wm = prop.get_elem(xl);
+    const Vector<WilsonVector> v = ffb.get_elems_const(xl);
+    for (int j = 0; j < 4*NUM_COLOR; ++j) {
+      set_wilson_matrix_col_from_vector(wm, j, v[j]);
+    }
+  }
+}
+
 inline void fermion_field_5d_from_4d(FermionField5d& ff5d, const FermionField4d& ff4d, const int upper, const int lower)
   // ff5d need to be initialized
   // upper componets are right handed
@@ -8,6 +8,7 @@
 #include <qlat/mvector.h>
 #include <qlat/matrix.h>
 #include <qlat/mpi.h>
+#include <qlat/task-farm.h>
 #include <qlat/utils-io.h>
 #include <qlat/field.h>
 #include <qlat/field-utils.h>
@@ -17,14 +18,24 @@
 #include <qlat/field-serial-io.h>
 #include <qlat/field-dist-io.h>
 #include <qlat/field-expand.h>
+#include <qlat/field-shift.h>
 #include <qlat/qed.h>
 #include <qlat/qcd.h>
 #include <qlat/qcd-utils.h>
 #include <qlat/qcd-gauge-transformation.h>
 #include <qlat/qcd-smear.h>
+#include <qlat/qcd-compact.h>
 #include <qlat/qcd-topology.h>
+#include <qlat/qcd-flow.h>
+#include <qlat/qcd-gauge-update.h>
+#include <qlat/qcd-hmc.h>
 #include <qlat/fermion-action.h>
+#include <qlat/qcd-dirac.h>
+#include <qlat/qcd-inverter.h>
+#include <qlat/qcd-dwf.h>
 #include <qlat/compressed-eigen-io.h>
+#include <qlat/qcd-lanczos.h>
+#include <qlat/qcd-deflation.h>
 
 QLAT_START_NAMESPACE
 
@@ -0,0 +1,681 @@
+#pragma once
+
+#include <qlat/config.h>
+#include <qlat/utils.h>
+#include <qlat/mpi.h>
+#include <qlat/utils-io.h>
+
+#include <deque>
+#include <vector>
+
+QLAT_START_NAMESPACE
+
+// Scheduler for many independent jobs of uneven cost.
+//
+// All nodes call run_job_scheduler with the same list of jobs. The nodes are
+// split into groups (see init_node_group). A job is run by one group with
+// CommSwitch in effect, so Geometry, CommPlan and FFT plans created inside the
+// job belong to the group. Only job indices and results are sent between
+// groups, through a private duplicate of get_comm().
+//
+// Master/worker mode: node 0 only schedules. Every group keeps up to
+// batch_size + n_prefetch jobs queued, so that the next job has usually
+// arrived before the current one finishes, and returns results in batches.
+//
+// Work-stealing mode: the jobs are split evenly among the groups. A group
+// which runs out of jobs takes half of the remaining queue of another group.
+// Results are sent in batches to node 0 (which runs jobs as well) and node 0
+// ends the run once all results are in.
+//
+// Node 0 saves the results to checkpoint_path (if not empty) every
+// checkpoint_interval seconds and at the end. Jobs found done in an existing
+// checkpoint are not run again.
+//
+// J and R must be plain data (copied with memcpy).
+
+struct JobSchedulerParams
+{
+  bool is_work_stealing;
+  Coordinate size_node_group;
+  int n_prefetch;
+  // master/worker mode: jobs queued in addition to the batch
+  int batch_size;
+  // number of results per message
+  std::string checkpoint_path;
+  double checkpoint_interval;
+  //
+  void init()
+  {
+    is_work_stealing = false;
+    size_node_group = Coordinate(1, 1, 1, 1);
+    n_prefetch = 1;
+    batch_size = 1;
+    checkpoint_path = "";
+    checkpoint_interval = 600.0;
+  }
+  //
+  JobSchedulerParams()
+  {
+    init();
+  }
+};
+
+struct JobStats
+{
+  long num_job;
+  // jobs run in this call (excluding those restored from the checkpoint)
+  double total_time;
+  double min_time;
+  double max_time;
+  std::vector<double> job_time;
+  // job_time[idx] (negative if restored from the checkpoint)
+  std::vector<long> group_num_job;
+  std::vector<double> group_busy_time;
+};
+
+template <class R>
+struct JobRecord
+{
+  long idx;
+  int id_group;
+  double time;
+  R result;
+};
+
+template <class R>
+struct JobTable
+{
+  long num_done;
+  std::vector<char> is_done;
+  std::vector<char> is_restored;
+  std::vector<int> id_group;
+  std::vector<double> time;
+  std::vector<R> results;
+  //
+  void init(const long num_job)
+  {
+    num_done = 0;
+    is_done.resize(num_job, 0);
+    is_restored.resize(num_job, 0);
+    id_group.resize(num_job, -1);
+    time.resize(num_job, 0.0);
+    results.resize(num_job);
+  }
+  //
+  void add(const JobRecord<R>& rec)
+  {
+    qassert(0 <= rec.idx && rec.idx < (long)is_done.size());
+    qassert(!is_done[rec.idx]);
+    is_done[rec.idx] = 1;
+    id_group[rec.idx] = rec.id_group;
+    time[rec.idx] = rec.time;
+    results[rec.idx] = rec.result;
+    num_done += 1;
+  }
+};
+
+template <class R>
+inline void save_job_table(const std::string& path, const JobTable<R>& jt)
+  // only called on node 0
+{
+  TIMER_VERBOSE("save_job_table");
+  const int64_t header[2] = { (int64_t)jt.is_done.size(), (int64_t)sizeof(R) };
+  FILE* fp = qopen(path + ".partial", "w");
+  qassert(fp != NULL);
+  std::fwrite(header, sizeof(int64_t), 2, fp);
+  std::fwrite(jt.is_done.data(), sizeof(char), jt.is_done.size(), fp);
+  std::fwrite(jt.id_group.data(), sizeof(int), jt.id_group.size(), fp);
+  std::fwrite(jt.time.data(), sizeof(double), jt.time.size(), fp);
+  std::fwrite(jt.results.data(), sizeof(R), jt.results.size(), fp);
+  qclose(fp);
+  qrename(path + ".partial", path);
+}
+
+template <class R>
+inline bool load_job_table(JobTable<R>& jt, const std::string& path)
+  // only called on node 0
+  // jt needs to be initialized with the right number of jobs
+{
+  TIMER_VERBOSE("load_job_table");
+  if (!does_file_exist(path)) {
+    return false;
+  }
+  FILE* fp = qopen(path, "r");
+  qassert(fp != NULL);
+  int64_t header[2];
+  bool b = 2 == std::fread(header, sizeof(int64_t), 2, fp);
+  b = b && header[0] == (int64_t)jt.is_done.size() && header[1] == (int64_t)sizeof(R);
+  if (b) {
+    const long n = header[0];
+    b = b && n == (long)std::fread(jt.is_done.data(), sizeof(char), n, fp);
+    b = b && n == (long)std::fread(jt.id_group.data(), sizeof(int), n, fp);
+    b = b && n == (long)std::fread(jt.time.data(), sizeof(double), n, fp);
+    b = b && n == (long)std::fread(jt.results.data(), sizeof(R), n, fp);
+  }
+  qclose(fp);
+  if (!b) {
+    warn(ssprintf("load_job_table: '%s' does not match the job list.", path.c_str()));
+    jt.init(0);
+    return false;
+  }
+  jt.num_done = 0;
+  for (size_t i = 0; i < jt.is_done.size(); ++i) {
+    jt.is_restored[i] = jt.is_done[i];
+    jt.num_done += jt.is_done[i];
+  }
+  displayln_info(ssprintf("load_job_table: %ld/%ld jobs restored from '%s'.",
+        jt.num_done, (long)jt.is_done.size(), path.c_str()));
+  return true;
+}
+
+template <class R>
+inline void bcast(JobTable<R>& jt, const int root = 0)
+{
+  bcast(get_data(jt.num_done), root);
+  bcast(get_data(jt.is_done), root);
+  bcast(get_data(jt.is_restored), root);
+  bcast(get_data(jt.id_group), root);
+  bcast(get_data(jt.time), root);
+  bcast(get_data(jt.results), root);
+}
+
+inline int job_scheduler_root_of_group(const int id_group, const JobSchedulerParams& sp, const int num_node_reserved)
+  // id_node (in the parent comm) of node 0 of the group
+{
+  return num_node_reserved + id_group * product(sp.size_node_group);
+}
+
+template <class J, class R, class F>
+inline bool job_scheduler_group_run(JobRecord<R>& rec, NodeGroup& ng, const long idx,
+    const std::vector<J>& jobs, const F& compute)
+  // collective within the group
+  // idx only needs to be set on node 0 of the group
+  // return false if idx < 0 (no more jobs for this group)
+{
+  CommSwitch cs(ng);
+  long i = idx;
+  bcast(get_data(i));
+  if (i < 0) {
+    return false;
+  }
+  const double time_start = get_time();
+  rec.result = compute(jobs[i]);
+  rec.idx = i;
+  rec.id_group = ng.id_group;
+  rec.time = get_time() - time_start;
+  return true;
+}
+
+template <class R>
+inline void job_scheduler_checkpoint(double& last_time, const JobTable<R>& jt,
+    const JobSchedulerParams& sp, const bool is_forced = false)
+{
+  if (sp.checkpoint_path != "" && (is_forced || get_time() - last_time >= sp.checkpoint_interval)) {
+    save_job_table(sp.checkpoint_path, jt);
+    last_time = get_time();
+  }
+}
+
+template <class J, class R, class F>
+inline void job_scheduler_serial(JobTable<R>& jt, const std::vector<long>& todo,
+    const std::vector<J>& jobs, const F& compute, const JobSchedulerParams& sp)
+{
+  TIMER_VERBOSE("job_scheduler_serial");
+  double last_checkpoint_time = get_time();
+  for (size_t i = 0; i < todo.size(); ++i) {
+    JobRecord<R> rec;
+    const double time_start = get_time();
+    rec.result = compute(jobs[todo[i]]);
+    rec.idx = todo[i];
+    rec.id_group = 0;
+    rec.time = get_time() - time_start;
+    jt.add(rec);
+    job_scheduler_checkpoint(last_checkpoint_time, jt, sp);
+  }
+}
+
+#ifdef USE_MULTI_NODE
+
+struct JobSchedulerTag
+{
+  static const int jobs = 1;
+  static const int results = 2;
+  static const int steal_request = 3;
+  static const int steal_reply = 4;
+  static const int terminate = 5;
+  static const int stealer_done = 6;
+  static const int stealer_exit = 7;
+};
+
+template <class R>
+inline void job_scheduler_send_records(std::vector<JobRecord<R> >& records, const MPI_Comm& comm)
+{
+  if (records.size() > 0) {
+    MPI_Send(records.data(), records.size() * sizeof(JobRecord<R>), MPI_BYTE, 0,
+        JobSchedulerTag::results, comm);
+    records.clear();
+  }
+}
+
+template <class R>
+inline int job_scheduler_recv_records(JobTable<R>& jt, const MPI_Status& status, const MPI_Comm& comm)
+  // receive the message found by MPI_Probe or MPI_Iprobe
+  // return the number of records received
+{
+  int count;
+  MPI_Get_count(&status, MPI_BYTE, &count);
+  qassert(count % sizeof(JobRecord<R>) == 0);
+  std::vector<JobRecord<R> > records(count / sizeof(JobRecord<R>));
+  MPI_Recv(records.data(), count, MPI_BYTE, status.MPI_SOURCE, JobSchedulerTag::results, comm, MPI_STATUS_IGNORE);
+  for (size_t i = 0; i < records.size(); ++i) {
+    jt.add(records[i]);
+  }
+  return records.size();
+}
+
+template <class R>
+inline void job_scheduler_master(JobTable<R>& jt, const std::vector<long>& todo,
+    const NodeGroup& ng, const JobSchedulerParams& sp, const MPI_Comm& comm)
+{
+  TIMER_VERBOSE("job_scheduler_master");
+  const int depth = sp.batch_size + sp.n_prefetch;
+  std::vector<long> num_queued(ng.num_group, 0);
+  long num_sent = 0;
+  double last_checkpoint_time = get_time();
+  for (int g = 0; g < ng.num_group; ++g) {
+    const long n = std::min((long)depth, (long)todo.size() - num_sent);
+    if (n > 0) {
+      MPI_Send((void*)&todo[num_sent], n, MPI_LONG, job_scheduler_root_of_group(g, sp, 1),
+          JobSchedulerTag::jobs, comm);
+      num_sent += n;
+      num_queued[g] += n;
+    }
+  }
+  while (num_sent < (long)todo.size() || jt.num_done < (long)jt.is_done.size()) {
+    MPI_Status status;
+    MPI_Probe(MPI_ANY_SOURCE, JobSchedulerTag::results, comm, &status);
+    const int g = (status.MPI_SOURCE - 1) / product(sp.size_node_group);
+    num_queued[g] -= job_scheduler_recv_records(jt, status, comm);
+    const long n = std::min(depth - num_queued[g], (long)todo.size() - num_sent);
+    if (n > 0) {
+      MPI_Send((void*)&todo[num_sent], n, MPI_LONG, status.MPI_SOURCE,
+          JobSchedulerTag::jobs, comm);
+      num_sent += n;
+      num_queued[g] += n;
+    }
+    job_scheduler_checkpoint(last_checkpoint_time, jt, sp);
+  }
+  for (int g = 0; g < ng.num_group; ++g) {
+    MPI_Send(NULL, 0, MPI_LONG, job_scheduler_root_of_group(g, sp, 1), JobSchedulerTag::jobs, comm);
+  }
+}
+
+template <class J, class R, class F>
+inline void job_scheduler_worker(NodeGroup& ng, const std::vector<J>& jobs, const F& compute,
+    const JobSchedulerParams& sp, const MPI_Comm& comm)
+  // node 0 of the group only
+{
+  TIMER_VERBOSE("job_scheduler_worker");
+  const int depth = sp.batch_size + sp.n_prefetch;
+  std::deque<long> queue;
+  std::vector<long> buffer(depth);
+  std::vector<JobRecord<R> > records;
+  MPI_Request req;
+  MPI_Irecv(buffer.data(), depth, MPI_LONG, 0, JobSchedulerTag::jobs, comm, &req);
+  bool is_end = false;
+  while (true) {
+    if (queue.empty()) {
+      job_scheduler_send_records(records, comm);
+    }
+    if (!is_end) {
+      // prefetch: the next jobs are received while the current one runs
+      int flag = 0;
+      MPI_Status status;
+      if (queue.empty()) {
+        MPI_Wait(&req, &status);
+        flag = 1;
+      } else {
+        MPI_Test(&req, &flag, &status);
+      }
+      if (flag) {
+        int count;
+        MPI_Get_count(&status, MPI_LONG, &count);
+        if (0 == count) {
+          is_end = true;
+        } else {
+          queue.insert(queue.end(), buffer.begin(), buffer.begin() + count);
+          MPI_Irecv(buffer.data(), depth, MPI_LONG, 0, JobSchedulerTag::jobs, comm, &req);
+        }
+      }
+    }
+    if (queue.empty()) {
+      if (is_end) {
+        break;
+      } else {
+        continue;
+      }
+    }
+    const long idx = queue.front();
+    queue.pop_front();
+    JobRecord<R> rec;
+    job_scheduler_group_run(rec, ng, idx, jobs, compute);
+    records.push_back(rec);
+    if ((int)records.size() >= sp.batch_size) {
+      job_scheduler_send_records(records, comm);
+    }
+  }
+  qassert(records.empty());
+}
+
+inline void job_scheduler_stealer_reply(std::deque<long>& queue, const MPI_Comm& comm)
+  // answer all the pending steal requests, each gets half of the queue (possibly no jobs)
+{
+  int flag;
+  MPI_Status status;
+  MPI_Iprobe(MPI_ANY_SOURCE, JobSchedulerTag::steal_request, comm, &flag, &status);
+  while (flag) {
+    MPI_Recv(NULL, 0, MPI_LONG, status.MPI_SOURCE, JobSchedulerTag::steal_request, comm, MPI_STATUS_IGNORE);
+    const long n = queue.size() / 2;
+    std::vector<long> give(queue.end() - n, queue.end());
+    queue.erase(queue.end() - n, queue.end());
+    MPI_Send(give.data(), give.size(), MPI_LONG, status.MPI_SOURCE, JobSchedulerTag::steal_reply, comm);
+    MPI_Iprobe(MPI_ANY_SOURCE, JobSchedulerTag::steal_request, comm, &flag, &status);
+  }
+}
+
+template <class J, class R, class F>
+inline void job_scheduler_stealer(JobTable<R>& jt, NodeGroup& ng, const std::vector<long>& todo,
+    const std::vector<J>& jobs, const F& compute, const JobSchedulerParams& sp, const MPI_Comm& comm)
+  // node 0 of the group only
+  // node 0 of group 0 (id_node == 0) collects the results and ends the run
+{
+  TIMER_VERBOSE("job_scheduler_stealer");
+  const bool is_collector = 0 == ng.id_group;
+  std::deque<long> queue;
+  {
+    const long start = todo.size() * ng.id_group / ng.num_group;
+    const long end = todo.size() * (ng.id_group + 1) / ng.num_group;
+    queue.insert(queue.end(), todo.begin() + start, todo.begin() + end);
+  }
+  std::vector<JobRecord<R> > records;
+  double last_checkpoint_time = get_time();
+  int victim = ng.id_group;
+  int num_failure = 0;
+  bool is_stealing = false;
+  long num_stolen = 0;
+  MPI_Request steal_req;
+  while (true) {
+    int flag;
+    MPI_Status status;
+    // give away half of the queue
+    job_scheduler_stealer_reply(queue, comm);
+    if (is_collector) {
+      MPI_Iprobe(MPI_ANY_SOURCE, JobSchedulerTag::results, comm, &flag, &status);
+      while (flag) {
+        job_scheduler_recv_records(jt, status, comm);
+        MPI_Iprobe(MPI_ANY_SOURCE, JobSchedulerTag::results, comm, &flag, &status);
+      }
+      job_scheduler_checkpoint(last_checkpoint_time, jt, sp);
+      if (jt.num_done == (long)jt.is_done.size()) {
+        for (int g = 1; g < ng.num_group; ++g) {
+          MPI_Send(NULL, 0, MPI_LONG, job_scheduler_root_of_group(g, sp, 0), JobSchedulerTag::terminate, comm);
+        }
+        break;
+      }
+    } else {
+      MPI_Iprobe(0, JobSchedulerTag::terminate, comm, &flag, &status);
+      if (flag) {
+        MPI_Recv(NULL, 0, MPI_LONG, 0, JobSchedulerTag::terminate, comm, MPI_STATUS_IGNORE);
+        break;
+      }
+    }
+    if (!queue.empty()) {
+      const long idx = queue.front();
+      queue.pop_front();
+      JobRecord<R> rec;
+      job_scheduler_group_run(rec, ng, idx, jobs, compute);
+      if (is_collector) {
+        jt.add(rec);
+      } else {
+        records.push_back(rec);
+        if ((int)records.size() >= sp.batch_size) {
+          job_scheduler_send_records(records, comm);
+        }
+      }
+      continue;
+    }
+    job_scheduler_send_records(records, comm);
+    if (1 == ng.num_group) {
+      continue;
+    }
+    if (!is_stealing) {
+      victim = (victim + 1) % ng.num_group;
+      if (victim == ng.id_group) {
+        victim = (victim + 1) % ng.num_group;
+      }
+      MPI_Isend(NULL, 0, MPI_LONG, job_scheduler_root_of_group(victim, sp, 0),
+          JobSchedulerTag::steal_request, comm, &steal_req);
+      is_stealing = true;
+    } else {
+      const int id_node_victim = job_scheduler_root_of_group(victim, sp, 0);
+      MPI_Iprobe(id_node_victim, JobSchedulerTag::steal_reply, comm, &flag, &status);
+      if (flag) {
+        int count;
+        MPI_Get_count(&status, MPI_LONG, &count);
+        std::vector<long> take(count);
+        MPI_Recv(take.data(), count, MPI_LONG, id_node_victim, JobSchedulerTag::steal_reply, comm, MPI_STATUS_IGNORE);
+        MPI_Wait(&steal_req, MPI_STATUS_IGNORE);
+        is_stealing = false;
+        queue.insert(queue.end(), take.begin(), take.end());
+        num_stolen += count;
+        if (0 == count) {
+          num_failure += 1;
+          if (num_failure % (ng.num_group - 1) == 0) {
+            // nobody has spare jobs: all remaining jobs are running
+            ssleep(1.0e-3);
+          }
+        } else {
+          num_failure = 0;
+        }
+      }
+    }
+  }
+  qassert(queue.empty());
+  qassert(records.empty());
+  // shutdown: all the jobs are done, but steal requests may still be in flight
+  // every root answers them (with no jobs) and completes its own request before sending
+  // stealer_done to the collector, which lets the roots go (stealer_exit) once all are done
+  // so no message is left unmatched when comm is freed
+  // stealer_done carries num_stolen of the group, the collector displays all of them
+  std::vector<long> group_num_stolen(ng.num_group, 0);
+  group_num_stolen[ng.id_group] = num_stolen;
+  int num_group_done = 0;
+  bool is_done_sent = false;
+  while (true) {
+    int flag;
+    MPI_Status status;
+    job_scheduler_stealer_reply(queue, comm);
+    if (is_stealing) {
+      const int id_node_victim = job_scheduler_root_of_group(victim, sp, 0);
+      MPI_Iprobe(id_node_victim, JobSchedulerTag::steal_reply, comm, &flag, &status);
+      if (flag) {
+        int count;
+        MPI_Get_count(&status, MPI_LONG, &count);
+        qassert(0 == count);
+        MPI_Recv(NULL, 0, MPI_LONG, id_node_victim, JobSchedulerTag::steal_reply, comm, MPI_STATUS_IGNORE);
+        MPI_Wait(&steal_req, MPI_STATUS_IGNORE);
+        is_stealing = false;
+      }
+    }
+    if (!is_stealing && !is_done_sent) {
+      if (!is_collector) {
+        const long msg[2] = { ng.id_group, num_stolen };
+        MPI_Send((void*)msg, 2, MPI_LONG, 0, JobSchedulerTag::stealer_done, comm);
+      }
+      is_done_sent = true;
+    }
+    if (is_collector) {
+      MPI_Iprobe(MPI_ANY_SOURCE, JobSchedulerTag::stealer_done, comm, &flag, &status);
+      while (flag) {
+        long msg[2];
+        MPI_Recv(msg, 2, MPI_LONG, status.MPI_SOURCE, JobSchedulerTag::stealer_done, comm, MPI_STATUS_IGNORE);
+        qassert(0 < msg[0] && msg[0] < ng.num_group);
+        group_num_stolen[msg[0]] = msg[1];
+        num_group_done += 1;
+        MPI_Iprobe(MPI_ANY_SOURCE, JobSchedulerTag::stealer_done, comm, &flag, &status);
+      }
+      if (is_done_sent && num_group_done == ng.num_group - 1) {
+        for (int g = 1; g < ng.num_group; ++g) {
+          MPI_Send(NULL, 0, MPI_LONG, job_scheduler_root_of_group(g, sp, 0), JobSchedulerTag::stealer_exit, comm);
+        }
+        break;
+      }
+    } else if (is_done_sent) {
+      MPI_Iprobe(0, JobSchedulerTag::stealer_exit, comm, &flag, &status);
+      if (flag) {
+        MPI_Recv(NULL, 0, MPI_LONG, 0, JobSchedulerTag::stealer_exit, comm, MPI_STATUS_IGNORE);
+        break;
+      }
+    }
+  }
+  if (is_collector) {
+    for (int g = 0; g < ng.num_group; ++g) {
+      displayln_info(ssprintf("job_scheduler_stealer: id_group = %4d ; num_stolen = %6ld", g, group_num_stolen[g]));
+    }
+  }
+}
+
+#endif
+
+inline void display_job_stats(const JobStats& stats)
+{
+  displayln_info(ssprintf("display_job_stats: num_job = %ld ; total_time = %.3E sec", stats.num_job, stats.total_time));
+  if (stats.num_job > 0) {
+    displayln_info(ssprintf("display_job_stats: min/avg/max time = %.3E/%.3E/%.3E sec",
+          stats.min_time, stats.total_time / stats.num_job, stats.max_time));
+  }
+  for (size_t g = 0; g < stats.group_num_job.size(); ++g) {
+    displayln_info(ssprintf("display_job_stats: id_group = %4d ; num_job = %6ld ; busy_time = %.3E sec",
+          (int)g, stats.group_num_job[g], stats.group_busy_time[g]));
+  }
+}
+
+template <class R>
+inline void set_job_stats(JobStats& stats, const JobTable<R>& jt, const int num_group)
+{
+  stats.num_job = 0;
+  stats.total_time = 0.0;
+  stats.min_time = 0.0;
+  stats.max_time = 0.0;
+  stats.job_time.resize(jt.is_done.size());
+  stats.group_num_job.clear();
+  stats.group_num_job.resize(num_group, 0);
+  stats.group_busy_time.clear();
+  stats.group_busy_time.resize(num_group, 0.0);
+  for (size_t i = 0; i < jt.is_done.size(); ++i) {
+    if (jt.is_restored[i]) {
+      stats.job_time[i] = -1.0;
+      continue;
+    }
+    const double t = jt.time[i];
+    stats.job_time[i] = t;
+    if (0 == stats.num_job || t < stats.min_time) {
+      stats.min_time = t;
+    }
+    if (0 == stats.num_job || t > stats.max_time) {
+      stats.max_time = t;
+    }
+    stats.num_job += 1;
+    stats.total_time += t;
+    const int g = jt.id_group[i];
+    if (0 <= g && g < num_group) {
+      stats.group_num_job[g] += 1;
+      stats.group_busy_time[g] += t;
+    }
+  }
+}
+
+template <class J, class R, class F>
+inline std::vector<R> run_job_scheduler(JobStats& stats, const std::vector<J>& jobs, const F& compute,
+    const JobSchedulerParams& sp)
+  // R compute(const J& job) is called collectively within one group.
+  // Returns the results of all jobs (in the order of jobs) on all nodes.
+{
+  TIMER_VERBOSE("run_job_scheduler");
+  qassert(sp.batch_size >= 1);
+  qassert(sp.n_prefetch >= 0);
+  JobTable<R> jt;
+  jt.init(jobs.size());
+  if (sp.checkpoint_path != "" && 0 == get_id_node()) {
+    if (!load_job_table(jt, sp.checkpoint_path)) {
+      jt.init(jobs.size());
+    }
+  }
+  bcast(jt);
+  std::vector<long> todo;
+  for (long i = 0; i < (long)jobs.size(); ++i) {
+    if (!jt.is_done[i]) {
+      todo.push_back(i);
+    }
+  }
+  if (1 == get_num_node()) {
+    job_scheduler_serial(jt, todo, jobs, compute, sp);
+    if (sp.checkpoint_path != "") {
+      save_job_table(sp.checkpoint_path, jt);
+    }
+    set_job_stats(stats, jt, 1);
+    display_job_stats(stats);
+    return jt.results;
+  }
+#ifdef USE_MULTI_NODE
+  // master/worker mode needs a node for the master
+  const bool is_work_stealing = sp.is_work_stealing;
+  const int num_node_reserved = is_work_stealing ? 0 : 1;
+  NodeGroup ng;
+  init_node_group(ng, sp.size_node_group, num_node_reserved);
+  MPI_Comm comm;
+  MPI_Comm_dup(get_comm(), &comm);
+  if (ng.is_member() && 0 != ng.geon.id_node) {
+    JobRecord<R> rec;
+    while (job_scheduler_group_run(rec, ng, -1, jobs, compute)) {
+    }
+  } else if (is_work_stealing && ng.is_member()) {
+    job_scheduler_stealer(jt, ng, todo, jobs, compute, sp, comm);
+    JobRecord<R> rec;
+    job_scheduler_group_run(rec, ng, -1, jobs, compute);
+  } else if (0 == get_id_node()) {
+    job_scheduler_master(jt, todo, ng, sp, comm);
+  } else if (ng.is_member()) {
+    job_scheduler_worker<J,R>(ng, jobs, compute, sp, comm);
+    JobRecord<R> rec;
+    job_scheduler_group_run(rec, ng, -1, jobs, compute);
+  }
+  if (0 == get_id_node()) {
+    qassert(jt.num_done == (long)jobs.size());
+    double last_checkpoint_time = get_time();
+    job_scheduler_checkpoint(last_checkpoint_time, jt, sp, true);
+  }
+  MPI_Barrier(comm);
+  MPI_Comm_free(&comm);
+  if (ng.is_member()) {
+    MPI_Comm_free(&ng.comm);
+  }
+  bcast(jt);
+  set_job_stats(stats, jt, ng.num_group);
+  display_job_stats(stats);
+#endif
+  return jt.results;
+}
+
+template <class J, class R, class F>
+inline std::vector<R> run_task_farm(const std::vector<J>& jobs, const F& compute, const Coordinate& size_node_group)
+  // master/worker mode without prefetch or checkpoint
+{
+  JobSchedulerParams sp;
+  sp.size_node_group = size_node_group;
+  sp.n_prefetch = 0;
+  JobStats stats;
+  return run_job_scheduler<J,R>(stats, jobs, compute, sp);
+}
+
+QLAT_END_NAMESPACE